@@ -1,4 +1,9 @@
 {
+  'variables': {
+    # build with node-gyp rebuild -Dnwm_xcb=1
+    # to pipeline window property fetches over XCB
+    'nwm_xcb%': 0
+  },
   'targets': [
     {
       'target_name': 'nwm',
@@ -7,6 +12,23 @@
       ],
       'dependencies': ['listc', 'nwmc']
     },
+    {
+      # the synthetic clients of the benchmark (src/bench/run.sh); make bench
+      # in src builds the same program as src/bench/clients
+      'target_name': 'nwm_bench_clients',
+      'type': 'executable',
+      'sources': [
+        'src/bench/clients.c',
+        'src/nwm/stats.c'
+      ],
+      'include_dirs': ['src/nwm'],
+      'cflags': ['-std=c99', '-pedantic', '-Wall'],
+      'link_settings': {
+        'libraries': [
+          '-lX11'
+        ]
+      }
+    },
     {
       'target_name': 'listc',
       'type': 'static_library',
@@ -19,14 +41,33 @@
       'target_name': 'nwmc',
       'type': 'static_library',
       'sources': [
-        'src/nwm/nwm.c'
+        'src/nwm/nwm.c',
+        'src/nwm/winset.c',
+        'src/nwm/winstack.c',
+        'src/nwm/layout.c',
+        'src/nwm/log.c',
+        'src/nwm/fetch.c',
+        'src/nwm/stats.c',
+        'src/nwm/ring.c',
+        'src/nwm/session.c',
+        'src/nwm/track.c'
       ],
       'cflags': ['-fPIC', '-std=c99', '-pedantic', '-Wall'],
       'link_settings': {
         'libraries': [
-          '-lX11', '-lXinerama'
+          '-lX11', '-lXinerama', '-lXrandr', '-lpthread'
         ],
-      }
+      },
+      'conditions': [
+        ['nwm_xcb==1', {
+          'defines': ['NWM_XCB'],
+          'link_settings': {
+            'libraries': [
+              '-lX11-xcb', '-lxcb'
+            ]
+          }
+        }]
+      ]
     }
   ]
 }
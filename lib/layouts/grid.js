@@ -26,7 +26,7 @@
 
 function grid(workspace) {
   var windows = workspace.visible();
-  var screen = workspace.monitor;
+  var screen = workspace.monitor.workarea;
   var window_ids = Object.keys(windows);
   if(window_ids.length < 1) {
     return;
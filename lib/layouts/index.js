@@ -2,5 +2,7 @@ module.exports = {
   tile: require('./tile.js'),
   monocle: require('./monocle.js'),
   wide: require('./wide.js'),
-  grid: require('./grid.js')
+  grid: require('./grid.js'),
+  // native(name) returns a layout backed by the binding, e.g. native('tile')
+  native: require('./native.js')
 }
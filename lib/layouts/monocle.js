@@ -26,7 +26,7 @@
 
 function monocle(workspace){
   var windows = workspace.visible();
-  var screen = workspace.monitor;
+  var screen = workspace.monitor.workarea;
   // make sure that the main window is visible, always!
   var mainId = workspace.mainWindow;
   if(!workspace.nwm.windows.exists(mainId)) {
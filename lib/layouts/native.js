@@ -0,0 +1,72 @@
+/**
+ * Native layouts
+ *
+ * Returns a layout callback for one of the bundled layouts (tile, wide, grid
+ * or monocle) that computes and applies the geometry of every window in a
+ * single call to the binding, instead of one moveWindow/resizeWindow per window.
+ *
+ *   nwm.addLayout('tile', layouts.native('tile'));
+ *
+ * Registering a Javascript layout under the same name overrides it as usual.
+ */
+function native(name) {
+  return function(workspace) {
+    var nwm = workspace.nwm;
+    var windows = workspace.visible();
+    var window_ids = Object.keys(windows);
+    var mainId = workspace.mainWindow;
+    var ids;
+
+    if(name == 'monocle') {
+      // make sure that the main window is visible, always!
+      if(!nwm.windows.exists(mainId)) {
+        return;
+      }
+      ids = [ mainId ];
+    } else {
+      if(window_ids.length < 1) {
+        return;
+      }
+      var mainPos = window_ids.indexOf(''+mainId);
+      mainPos = (mainPos == -1 ? 0 : mainPos);
+      if(name == 'grid') {
+        // the others are in numeric order (with wraparound)
+        ids = window_ids.slice(mainPos).concat(window_ids.slice(0, mainPos));
+      } else {
+        ids = [ window_ids[mainPos] ].concat(window_ids.filter(function(id, index) {
+          return index != mainPos;
+        }));
+      }
+    }
+    ids = ids.map(function(id) { return parseInt(id, 10); });
+
+    var placed = nwm.wm.layout(name, workspace.monitor.workarea, ids, workspace.getMainWindowScale());
+    // keep the window objects in sync with what was applied
+    placed.forEach(function(geometry) {
+      var window = nwm.windows.get(geometry.id);
+      if(window) {
+        window.x = geometry.x;
+        window.y = geometry.y;
+        window.width = geometry.width;
+        window.height = geometry.height;
+        window.visible = true;
+      }
+      if(nwm.pending) {
+        delete nwm.pending[geometry.id];
+      }
+    });
+
+    if(name == 'monocle') {
+      // hide the rest
+      window_ids.forEach(function(id) {
+        if(id != mainId) {
+          windows[id].hide();
+        }
+      });
+    }
+  };
+}
+
+if (typeof module != 'undefined') {
+  module.exports = native;
+}
@@ -27,7 +27,7 @@ function wide(workspace) {
   // the way DWM does it is to reserve half the screen for the first screen,
   // then split the other half among the rest of the screens
   var windows = workspace.visible();
-  var screen = workspace.monitor;
+  var screen = workspace.monitor.workarea;
   var window_ids = Object.keys(windows);
   if(window_ids.length < 1) {
     return;
@@ -11,6 +11,8 @@ var Monitor = function(nwm, monitor) {
   this.height = monitor.height;
   this.x = monitor.x;
   this.y = monitor.y;
+  // The part not taken by panels, which layouts fill
+  this.workarea = monitor.workarea || { x: monitor.x, y: monitor.y, width: monitor.width, height: monitor.height };
   // List of window ids
   this.window_ids = [];
   // List of workspaces
@@ -21,6 +23,7 @@ var Monitor = function(nwm, monitor) {
     // Use the current workspace, or if that does not exist, the default values
     var layout_names = Object.keys(self.nwm.layouts);
     if(self.workspaces.exists(self.workspaces.current)) {
+      var current = self.workspaces.get(self.workspaces.current);
       return new Workspace(self.nwm, id, current.layout || layout_names[0], self);
     } else {
       return new Workspace(self.nwm, id, layout_names[0], self);
@@ -93,8 +96,9 @@ var Monitor = function(nwm, monitor) {
         var window = nwm.windows.get(wid);
         window.monitor = remaining_id;
         window.workspace = remaining.workspaces.current;
+        remaining.window_ids.push(wid);
       });
-      nwm.monitors.current = remaining;
+      nwm.monitors.current = remaining_id;
       remaining.workspaces.get(remaining.workspaces.current).rearrange();
     }
   });
@@ -120,20 +124,23 @@ Monitor.prototype.filter = function(filtercb) {
 Monitor.prototype.go = function(workspace_id) {
   var windows = this.filter();
   var window_ids = Object.keys(windows);
-  window_ids.forEach(function(window_id) {
-    var window = windows[window_id];
-    if(window.workspace != workspace_id) {
-      window.hide();
-    } else {
-      window.show();
+  var monitor = this;
+  // hide, show and lay out the windows in a single switchWorkspace
+  this.nwm.batch(function() {
+    window_ids.forEach(function(window_id) {
+      var window = windows[window_id];
+      if(window.workspace != workspace_id) {
+        window.hide();
+      } else {
+        window.show();
+      }
+    });
+    if(workspace_id != monitor.workspaces.current) {
+      monitor.workspaces.current = workspace_id;
     }
+    // always rearrange
+    monitor.workspaces.get(monitor.workspaces.current).rearrange();
   });
-  var monitor = this;
-  if(workspace_id != monitor.workspaces.current) {
-    monitor.workspaces.current = workspace_id;
-  }
-  // always rearrange
-  monitor.workspaces.get(monitor.workspaces.current).rearrange();
 };
 
 // Move a window to a different workspace
@@ -12,7 +12,8 @@ var Window = function(nwm, window) {
   this.instance = window.instance;
   this.class = window.class;
   this.isfloating = window.isfloating;
-  this.visible = true;
+  // windows restored hidden from a session snapshot stay hidden
+  this.visible = !window.hidden;
   this.workspace =  window.workspace;
 };
 
@@ -36,7 +37,9 @@ Window.prototype.move = function(x, y) {
   this.x = x;
   this.y = y;
   console.log('move', this.id, x, y);
-  this.nwm.wm.moveWindow(this.id, x, y);
+  if(!this.nwm.queueGeometry(this.id, { x: x, y: y })) {
+    this.nwm.wm.moveWindow(this.id, x, y);
+  }
 };
 
 // Resize a window
@@ -44,22 +47,17 @@ Window.prototype.resize = function(width, height) {
   this.width = width;
   this.height = height;
   console.log('resize', this.id, width, height);
-  this.nwm.wm.resizeWindow(this.id, width, height);
+  if(!this.nwm.queueGeometry(this.id, { width: width, height: height })) {
+    this.nwm.wm.resizeWindow(this.id, width, height);
+  }
 };
 
-// Hide a window
+// Hide a window: the binding unmaps it and sets it to IconicState
 Window.prototype.hide = function() {
   if(this.visible) {
     this.visible = false;
 //    console.log('hide', this.id);
-    // window should be moved to twice the total monitor width
-    var total = 0;
-    var monitors = Object.keys(this.nwm.monitors.items);
-    var self = this;
-    monitors.forEach(function(id) {
-      total += self.nwm.monitors.get(id).width;
-    })
-    this.nwm.wm.moveWindow(this.id, this.x + 2 * total, this.y);
+    this.nwm.setVisible(this.id, false);
   }
 };
 
@@ -68,7 +66,7 @@ Window.prototype.show = function() {
   if(!this.visible) {
     this.visible = true;
 //    console.log('show', this.id);
-    this.nwm.wm.moveWindow(this.id, this.x, this.y);
+    this.nwm.setVisible(this.id, true);
   }
 };
 
@@ -64,7 +64,11 @@ Workspace.prototype.visible = function() {
 Workspace.prototype.rearrange = function() {
   console.log('rearrange', this.layout);
   var callback = this.nwm.layouts[this.layout];
-  callback(this);
+  var self = this;
+  // send the whole layout to the binding at once
+  this.nwm.batch(function() {
+    callback(self);
+  });
 };
 
 // Get the main window scale
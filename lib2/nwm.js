@@ -48,12 +48,11 @@ Nwm.fullscreen = function(id, status) {
 
 Nwm.keypress = function(event) {
   console.log('keyPress', event, String.fromCharCode(event.keysym));
-  // find the matching callback and emit it
-  this.shortcuts.forEach(function(shortcut) {
-    if(event.keysym == shortcut.key && event.modifier == shortcut.modifier ) {
-      shortcut.callback(event);
-    };
-  });
+  // the binding has already matched the key; event.id is the shortcut index
+  var shortcut = this.shortcuts[event.id];
+  if(shortcut) {
+    shortcut.callback(event);
+  }
 };
 
 module.exports = Nwm;
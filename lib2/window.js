@@ -33,12 +33,13 @@ Window.prototype.sync = function() {
       changedProperties = propertyNames.filter(function(prop) {
         return (this.pending['_'+prop] && this.pending['_'+prop] != this['_'+prop]);
       });
-  // persist dimension change
-  if(changedProperties.indexOf('width') + changedProperties.indexOf('height') > -1) {
-    wm.resizeWindow(this.id, this.pending._width, this.pending._height);
-  }
-  if(changedProperties.indexOf('x') + changedProperties.indexOf('y') > -1) {
-    wm.moveWindow(this.id, this.pending._x, this.pending._y);
+  // persist the changed properties with a single call
+  if(changedProperties.length > 0) {
+    var geometry = { id: this.id };
+    changedProperties.forEach(function(prop) {
+      geometry[prop] = self.pending['_'+prop];
+    });
+    wm.applyLayout([ geometry ]);
   }
 };
 
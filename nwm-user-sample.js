@@ -45,6 +45,13 @@ if ( process.env.DISPLAY && process.env.DISPLAY == ':1' ) {
   baseModifier = Xh.Mod4Mask|Xh.ControlMask; // Win + Ctrl
 }
 
+// base modifier + left mouse button moves windows, + right mouse button resizes them
+nwm.dragModifier = baseModifier;
+// focus windows natively when the mouse enters them, rather than through a round trip to Javascript
+nwm.focusFollowsMouse = true;
+// restarting nwm (e.g. after editing this file) keeps the windows on their workspaces
+nwm.sessionFile = '/dev/shm/nwm-session-' + (process.env.DISPLAY || ':0').replace(/[^0-9.]/g, '');
+
 var keyboard_shortcuts = [
   {
     key: [1, 2, 3, 4, 5, 6, 7, 8, 9], // number keys are used to move between screens
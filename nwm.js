@@ -10,11 +10,19 @@ var Collection = require('./lib/collection.js'),
     Monitor = require('./lib/monitor.js'),
     Window = require('./lib/window.js');
 
+// The nwm C++ X11 binding; the first NWM uses the module itself, every
+// further one a separate native instance from create()
+var binding = require('./build/Release/nwm.node'),
+    bindingUsed = false;
+
 // Node Window Manager
 // -------------------
 var NWM = function() {
   // A reference to the nwm C++ X11 binding
-  this.wm = require('./build/Release/nwm.node');
+  this.wm = (bindingUsed ? binding.create() : binding);
+  bindingUsed = true;
+  // the X display to manage, e.g. ':1' (null: $DISPLAY)
+  this.display = null;
   // Known layouts
   this.layouts = {};
   // Keyboard shortcut lookup
@@ -24,6 +32,39 @@ var NWM = function() {
   // windows -- this is the global storage for windows, any other objects just store ids referring to this hash.
   this.windows = new Collection(this, 'window', 1);
   this.floaters = [];
+  // geometry changes queued by the current batch, keyed by window id
+  this.pending = null;
+  // windows hidden (false) or shown (true) by the current batch, keyed by window id
+  this.visibility = null;
+  this.batchDepth = 0;
+  // set to true before start() to receive all the events of a loop tick in one call
+  this.batchEvents = false;
+  // hold this modifier mask and drag with the left / right button to move / resize windows (0: off)
+  this.dragModifier = 0;
+  // focus windows in the binding as soon as the pointer enters them; enterNotify
+  // then only keeps track of the focused window and monitor
+  this.focusFollowsMouse = false;
+  // read X events on a separate native thread, so that the connection keeps
+  // being drained while JS is busy (e.g. in a slow layout)
+  this.threaded = false;
+  // how the binding answers configure requests without calling configureRequest:
+  // 'allow', 'deny' (reply with the current geometry) or 'forward' (to the handler below),
+  // per kind of window and optionally per window class, e.g. classes: { MPlayer: 'allow' }
+  this.configurePolicy = { unmanaged: 'allow', floating: 'allow', tiled: 'deny' };
+  // instrumentation: log wm.stats() every statsInterval ms (0: off), and/or keep the
+  // native stats of this display in a shared file (e.g. '/dev/shm/nwm-stats') for external tools
+  this.statsInterval = 0;
+  this.statsFile = null;
+  // hot restart: keep the windows and the workspace state in this file (e.g.
+  // '/dev/shm/nwm-session'); the next nwm started on the display takes them over
+  this.sessionFile = null;
+  // what start() set up in JS, which stop() takes down again
+  this.intervals = [];
+  this.onExit = null;
+  // the workspace state changed since it was last saved
+  this.sessionDirty = false;
+  // ids of the monitors that need a new layout at the next rearrange
+  this.dirtyMonitors = {};
 }
 
 require('util').inherits(NWM, require('events').EventEmitter);
@@ -39,15 +80,15 @@ NWM.prototype.events = {
     this.monitors.current = monitor.id;
   },
 
-  // A monitor is updated
+  // A monitor is moved or resized; the rearrange that follows lays out its current workspace
   updateMonitor: function(monitor) {
     this.monitors.update(monitor.id, monitor);
   },
 
   // A monitor is removed
-  removeMonitor: function(id) {
-    console.log('Remove monitor', id);
-    this.monitors.remove(function(monitor){ return (monitor.id != id); });
+  removeMonitor: function(removed) {
+    console.log('Remove monitor', removed.id);
+    this.monitors.remove(function(monitor){ return (monitor.id != removed.id); });
   },
 
   // Window events
@@ -73,6 +114,7 @@ NWM.prototype.events = {
         this.floaters.push(window.id);
         return;
       }
+      this.dirtyMonitors[window.monitor] = true;
       var win = new Window(this, window);
       // windows might be placed outside the screen if the wm was terminated
       if(win.x > current_monitor.width || win.y > current_monitor.height) {
@@ -91,6 +133,10 @@ NWM.prototype.events = {
 
   // When a window is removed
   removeWindow: function(window) {
+    // windows on hidden workspaces leave no gap to fill
+    if(this.windows.exists(window.id) && this.windows.get(window.id).visible) {
+      this.dirtyMonitors[this.windows.get(window.id).monitor] = true;
+    }
     this.windows.remove(function(item) {
       if(item && item.id && window.id) {
         return (item.id != window.id);
@@ -103,9 +149,7 @@ NWM.prototype.events = {
     if(pos > -1) {
       this.floaters = this.floaters.splice(pos, 1);
     }
-    // moved rearrange here to ensure that it occurs after everything else
-    var current_monitor = this.monitors.get(this.monitors.current);
-    current_monitor.workspaces.get(current_monitor.workspaces.current).rearrange();
+    // the binding follows up with a rearrange, once per loop tick
   },
 
   // When a window is updated
@@ -120,8 +164,26 @@ NWM.prototype.events = {
     }
   },
 
+  // The windows that already existed when nwm started (e.g. after a restart),
+  // delivered at once; a single rearrange follows
+  adoptWindows: function(ev) {
+    var self = this;
+    var session = this.sessionFile && this.wm.sessionState();
+    this.batch(function() {
+      ev.windows.forEach(function(window) {
+        self.events.addWindow.call(self, window);
+        self.events.updateWindow.call(self, window);
+      });
+      // put the windows back on the workspaces of the previous instance
+      if(session) {
+        self.restoreSession(JSON.parse(session));
+      }
+    });
+  },
+
   // When a window requests full screen mode
-  fullscreen: function(id, status) {
+  fullscreen: function(ev) {
+    var id = ev.id, status = ev.fullscreen;
     console.log('Client Fullscreen', id, status);
     console.log(id, '!! exists? ', this.windows.exists(id));
     if(this.windows.exists(id)) {
@@ -149,6 +211,7 @@ NWM.prototype.events = {
   },
 
   // ConfigureRequest is generated when a client window wants to change its size, stacking order or border width
+  // Only requests that this.configurePolicy forwards end up here
   configureRequest: function(ev){
     console.log('configureRequest', ev);
     this.wm.configureWindow(ev.id, ev.x, ev.y, ev.width, ev.height, ev.border_width,
@@ -191,14 +254,14 @@ NWM.prototype.events = {
     this.wm.focusWindow(event.id);
   },
 
-  // A mouse drag is in progress
+  // A mouse drag has ended; the binding already moved or resized the window
   mouseDrag: function(event) {
-    // move when drag is triggered
-    var change_x = event.move_x - event.x;
-    var change_y = event.move_y - event.y;
     var window = this.windows.exists(event.id) && this.windows.get(event.id);
     if(window) {
-      this.wm.moveWindow(event.id, window.x+change_x, window.y+change_y);
+      window.x = event.move_x;
+      window.y = event.move_y;
+      window.width = event.width;
+      window.height = event.height;
     }
   },
 
@@ -210,7 +273,9 @@ NWM.prototype.events = {
       if(this.monitors.exists(window.monitor)) {
         this.monitors.get(window.monitor).focused_window = event.id;
       }
-      this.wm.focusWindow(event.id);
+      if(!this.focusFollowsMouse) {
+        this.wm.focusWindow(event.id);
+      }
     } else {
       console.log('WARNING got focus event for nonexistent (transient) window', event);
     }
@@ -237,27 +302,38 @@ NWM.prototype.events = {
 
   // Screen events
   // -------------
-  rearrange: function() {
+  // Lays out the current workspace of the monitors the binding marked and of
+  // the ones windows were added to or removed from since the last rearrange
+  // (the binding only knows which monitor a window is on from its geometry)
+  rearrange: function(event) {
     var self = this;
-    // rearrange current workspace on all monitors
-    var monitors = Object.keys(this.monitors.items);
-    monitors.forEach(function(id) {
-      var monitor = self.monitors.get(id);
-      monitor.workspaces.get(monitor.workspaces.current).rearrange();
+    var dirty = this.dirtyMonitors;
+    this.dirtyMonitors = {};
+    if(event && event.monitors) {
+      event.monitors.forEach(function(id) { dirty[id] = true; });
+    } else {
+      dirty = this.monitors.items;
+    }
+    this.batch(function() {
+      Object.keys(dirty).forEach(function(id) {
+        if(self.monitors.exists(id)) {
+          var monitor = self.monitors.get(id);
+          monitor.workspaces.get(monitor.workspaces.current).rearrange();
+        }
+      });
     });
   },
 
   // Keyboard events
   // ---------------
   // A key has been pressed
+  // The binding matches the key natively; event.id is the index of the shortcut
   keyPress: function(event) {
     console.log('keyPress', event, String.fromCharCode(event.keysym));
-    // find the matching callback and emit it
-    this.shortcuts.forEach(function(shortcut) {
-      if(event.keysym == shortcut.key && event.modifier == shortcut.modifier ) {
-        shortcut.callback(event);
-      };
-    });
+    var shortcut = this.shortcuts[event.id];
+    if(shortcut) {
+      shortcut.callback(event);
+    }
   }
 };
 
@@ -277,6 +353,143 @@ NWM.prototype.nextLayout = function(name) {
   return (keys[pos+1] ? keys[pos+1] : keys[0] );
 };
 
+// Geometry batching
+// -----------------
+
+// Run fn, sending all the window moves and resizes it makes in one applyLayout call,
+// or, if it also hides or shows windows, in one switchWorkspace call.
+// Batches can be nested; the outermost batch sends the changes, also those
+// queued before fn threw.
+NWM.prototype.batch = function(fn) {
+  var pending = this.pending = this.pending || {};
+  var visibility = this.visibility = this.visibility || {};
+  this.batchDepth++;
+  try {
+    fn();
+  } finally {
+    this.batchDepth--;
+    if(this.batchDepth == 0) {
+      this.pending = null;
+      this.visibility = null;
+      this.flushBatch(pending, visibility);
+    }
+  }
+};
+
+NWM.prototype.flushBatch = function(pending, visibility) {
+  this.sessionDirty = true;
+  var geometry = Object.keys(pending).map(function(id) { return pending[id]; });
+  var hide = [], show = [];
+  Object.keys(visibility).forEach(function(id) {
+    (visibility[id] ? show : hide).push(parseInt(id, 10));
+  });
+  if(hide.length > 0 || show.length > 0) {
+    this.wm.switchWorkspace(hide, show, geometry);
+  } else if(geometry.length > 0) {
+    this.wm.applyLayout(geometry);
+  }
+};
+
+// Hide or show a window; inside a batch, this happens together with the rest of it
+NWM.prototype.setVisible = function(id, visible) {
+  if(this.visibility) {
+    this.visibility[id] = visible;
+  } else {
+    this.wm.switchWorkspace(visible ? [] : [id], visible ? [id] : [], []);
+  }
+};
+
+// Queue geometry changes for a window; returns false if there is no open batch
+NWM.prototype.queueGeometry = function(id, changes) {
+  if(!this.pending) {
+    return false;
+  }
+  var entry = this.pending[id] || (this.pending[id] = { id: id });
+  Object.keys(changes).forEach(function(key) {
+    entry[key] = changes[key];
+  });
+  return true;
+};
+
+// Session operations
+// ------------------
+
+// The workspace state a restarted nwm needs to put the windows back: the
+// workspace and monitor of every window, and per monitor the current workspace
+// and the layout, main window and scale of each workspace
+NWM.prototype.sessionState = function() {
+  var self = this;
+  var state = { monitors: {}, windows: {} };
+  Object.keys(this.monitors.items).forEach(function(id) {
+    var monitor = self.monitors.get(id);
+    var workspaces = {};
+    Object.keys(monitor.workspaces.items).forEach(function(ws_id) {
+      var workspace = monitor.workspaces.get(ws_id);
+      workspaces[ws_id] = {
+        layout: workspace.layout,
+        main_window: workspace.main_window,
+        main_window_scale: workspace.main_window_scale
+      };
+    });
+    state.monitors[id] = {
+      current: monitor.workspaces.current,
+      focused_window: monitor.focused_window,
+      workspaces: workspaces
+    };
+  });
+  Object.keys(this.windows.items).forEach(function(id) {
+    var window = self.windows.get(id);
+    state.windows[id] = { workspace: window.workspace, monitor: window.monitor };
+  });
+  return state;
+};
+
+// Apply a saved sessionState() to the adopted windows; monitors and windows that
+// are gone are skipped. The binding kept hidden windows hidden, so switching to
+// the saved workspaces only shows or hides the windows the snapshot disagrees on.
+NWM.prototype.restoreSession = function(state) {
+  var self = this;
+  Object.keys(state.windows).forEach(function(id) {
+    var saved = state.windows[id];
+    if(self.windows.exists(id) && self.monitors.exists(saved.monitor)) {
+      var window = self.windows.get(id);
+      window.workspace = saved.workspace;
+      window.monitor = saved.monitor;
+    }
+  });
+  Object.keys(state.monitors).forEach(function(id) {
+    if(!self.monitors.exists(id)) {
+      return;
+    }
+    var monitor = self.monitors.get(id);
+    var saved = state.monitors[id];
+    Object.keys(saved.workspaces).forEach(function(ws_id) {
+      var workspace = monitor.workspaces.get(ws_id);
+      var values = saved.workspaces[ws_id];
+      if(self.layouts[values.layout]) {
+        workspace.layout = values.layout;
+      }
+      workspace.main_window = values.main_window;
+      workspace.main_window_scale = values.main_window_scale;
+    });
+    if(self.windows.exists(saved.focused_window)) {
+      monitor.focused_window = saved.focused_window;
+    }
+    monitor.go(saved.current);
+  });
+};
+
+// Save the workspace state into the session file if it changed (or if forced);
+// the binding keeps the window list in it up to date by itself
+NWM.prototype.saveSession = function(force) {
+  if(this.sessionFile && (this.sessionDirty || force)) {
+    this.sessionDirty = false;
+    if(!this.wm.saveSession(JSON.stringify(this.sessionState()))) {
+      console.log('Could not save the session in', this.sessionFile);
+    }
+  }
+};
+
 // Keyboard shortcut operations
 // ----------------------------
 
@@ -289,13 +502,31 @@ NWM.prototype.addKey = function(keyobj, callback) {
 NWM.prototype.start = function(callback) {
   var self = this;
   // Initialize event handlers, bind this in the functions to nwm
-  Object.keys(this.events).forEach(function(eventname) {
-    self.wm.on(eventname, function() {
-      var args = Array.prototype.slice.call(arguments);
-      console.log('JS: ', eventname, args);
-      self.events[eventname].apply(self, args);
+  if(this.batchEvents) {
+    // one call per loop tick; the geometry changes of all handlers are sent together
+    this.wm.onBatch(function(events) {
+      self.batch(function() {
+        // one failing handler does not drop the rest of the tick's events
+        events.forEach(function(event) {
+          if(self.events[event.type]) {
+            try {
+              self.events[event.type].call(self, event);
+            } catch(e) {
+              console.log('Error in', event.type, 'handler:', e.stack || e);
+            }
+          }
+        });
+      });
     });
-  });
+  } else {
+    Object.keys(this.events).forEach(function(eventname) {
+      self.wm.on(eventname, function() {
+        var args = Array.prototype.slice.call(arguments);
+        console.log('JS: ', eventname, args);
+        self.events[eventname].apply(self, args);
+      });
+    });
+  }
 
   var grab_keys = [];
   console.log(this.shortcuts);
@@ -303,12 +534,49 @@ NWM.prototype.start = function(callback) {
     grab_keys.push( { key: shortcut.key, modifier: shortcut.modifier });
   });
   this.wm.keys(grab_keys);
-  this.wm.start();
+  this.wm.dragModifier(this.dragModifier);
+  this.wm.focusFollowsMouse(this.focusFollowsMouse);
+  this.wm.configurePolicy(this.configurePolicy);
+  this.wm.threaded(this.threaded);
+  if(this.statsFile && !this.wm.shareStats(this.statsFile)) {
+    console.log('Could not share stats in', this.statsFile);
+  }
+  if(this.sessionFile) {
+    if(this.wm.sessionFile(this.sessionFile)) {
+      this.intervals.push(setInterval(function() { self.saveSession(); }, 250));
+      this.onExit = function() { self.saveSession(true); };
+      process.on('exit', this.onExit);
+    } else {
+      console.log('Could not open the session file', this.sessionFile);
+      this.sessionFile = null;
+    }
+  }
+  if(this.statsInterval > 0) {
+    this.intervals.push(setInterval(function() {
+      console.log('stats', JSON.stringify(self.wm.stats()));
+    }, this.statsInterval));
+  }
+  this.wm.start(this.display);
+  var counters = this.wm.counters();
+  console.log('Adopted', counters.adopted, 'windows in', counters.adopt_usec / 1000, 'ms');
   if(callback) {
     callback();
   }
 };
 
+// Stop managing the display, e.g. one of several in this process. The binding
+// disconnects and forgets the event handlers; start() sets everything up again.
+NWM.prototype.stop = function() {
+  this.saveSession(true);
+  this.intervals.forEach(clearInterval);
+  this.intervals = [];
+  if(this.onExit) {
+    process.removeListener('exit', this.onExit);
+    this.onExit = null;
+  }
+  this.wm.stop();
+};
+
 if (module == require.main) {
   console.log('Please run nwm via "node nwm-user-sample.js" (or some other custom config file).');
 }
@@ -0,0 +1,318 @@
+// Synthetic X clients for benchmarking nwm (see run.sh).
+//
+//   clients -p -n N          map N windows and keep them open until killed; start
+//                            this before nwm to measure startup adoption
+//   clients -n N -r RATE -s STATS_FILE
+//                            run the workload against a running nwm and print the
+//                            results as JSON on stdout
+//
+// The workload maps N windows one after another, then retitles, resizes and
+// focuses each of them, toggles fullscreen on each, and finally unmaps them,
+// issuing at most RATE operations per second. Latencies are measured on the
+// client side from the request to the event that shows the window manager
+// acted on it. STATS_FILE is the file nwm shares its stats in (NWM.statsFile);
+// its rearrange, layout and adoption figures are included in the report.
+#define _POSIX_C_SOURCE 200112L
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <X11/Xatom.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include "nwm.h"
+#include "stats.h"
+
+// how long to wait for the window manager to react, in usec
+#define TIMEOUT 1000000
+
+static Display *dpy;
+static Window root;
+static volatile sig_atomic_t done = 0;
+
+// client side latencies (usec)
+enum measure_map {
+  measureMap,
+  measureArranged,
+  measureConfigure,
+  measureFocus,
+  measureFullscreen,
+  measureLast
+};
+
+static const char *measure_names[measureLast] = {
+  [measureMap] = "map",
+  [measureArranged] = "arranged",
+  [measureConfigure] = "configure",
+  [measureFocus] = "focus",
+  [measureFullscreen] = "fullscreen"
+};
+
+static nwm_histogram measures[measureLast];
+static unsigned long timeouts[measureLast];
+static unsigned long operations = 0;
+
+static void on_signal(int sig) {
+  done = 1;
+}
+
+// waits up to timeout usec for an event of the given type on win; if real_only,
+// synthetic (send_event) events are skipped. Returns 1 if it arrived.
+static int wait_event(Window win, int type, Bool real_only, unsigned long timeout) {
+  unsigned long start = nwm_stats_now();
+  struct pollfd fd = { ConnectionNumber(dpy), POLLIN, 0 };
+  XEvent ev;
+
+  while(1) {
+    while(XPending(dpy)) {
+      XNextEvent(dpy, &ev);
+      if(ev.type == type && ev.xany.window == win && !(real_only && ev.xany.send_event)) {
+        return 1;
+      }
+    }
+    unsigned long elapsed = nwm_stats_now() - start;
+    if(elapsed >= timeout) {
+      return 0;
+    }
+    poll(&fd, 1, (timeout - elapsed) / 1000 + 1);
+  }
+}
+
+// records how long win took to produce the event, or a timeout
+static void measure(int what, Window win, int type, Bool real_only, unsigned long start) {
+  if(wait_event(win, type, real_only, TIMEOUT)) {
+    nwm_histogram_add(&measures[what], nwm_stats_now() - start);
+  } else {
+    timeouts[what]++;
+  }
+}
+
+static void sleep_usec(unsigned long usec) {
+  struct timespec delay;
+  delay.tv_sec = usec / 1000000;
+  delay.tv_nsec = (usec % 1000000) * 1000;
+  nanosleep(&delay, NULL);
+}
+
+// sleeps so that operations are issued at most rate per second
+static void pace(int rate) {
+  operations++;
+  if(rate > 0) {
+    sleep_usec(1000000 / rate);
+  }
+}
+
+static Window create_window(int i) {
+  char title[32];
+  XSetWindowAttributes wa;
+  Window win;
+
+  wa.background_pixel = BlackPixel(dpy, DefaultScreen(dpy));
+  wa.event_mask = StructureNotifyMask|FocusChangeMask;
+  win = XCreateWindow(dpy, root, 10 + i, 10 + i, 200, 100, 0, CopyFromParent, InputOutput,
+      CopyFromParent, CWBackPixel|CWEventMask, &wa);
+  snprintf(title, sizeof title, "bench %d", i);
+  XStoreName(dpy, win, title);
+  return win;
+}
+
+static void fullscreen(Window win, Bool on) {
+  XEvent ev;
+  memset(&ev, 0, sizeof ev);
+  ev.xclient.type = ClientMessage;
+  ev.xclient.window = win;
+  ev.xclient.message_type = XInternAtom(dpy, "_NET_WM_STATE", False);
+  ev.xclient.format = 32;
+  ev.xclient.data.l[0] = (on ? 1 : 0);
+  ev.xclient.data.l[1] = XInternAtom(dpy, "_NET_WM_STATE_FULLSCREEN", False);
+  XSendEvent(dpy, root, False, SubstructureRedirectMask|SubstructureNotifyMask, &ev);
+  XFlush(dpy);
+}
+
+static void print_histogram(const char *name, nwm_histogram *h, unsigned long timeouts, int last) {
+  printf("    \"%s\": { \"count\": %lu, \"timeouts\": %lu, \"mean\": %.1f, \"p50\": %lu, \"p99\": %lu, \"max\": %lu }%s\n",
+      name, h->count, timeouts, (h->count ? (double) h->total / h->count : 0.0),
+      nwm_histogram_percentile(h, 0.5), nwm_histogram_percentile(h, 0.99), h->max, (last ? "" : ","));
+}
+
+// maps the stats file nwm shares and waits for the startup scan to finish
+static nwm_stats* open_stats(const char *path) {
+  nwm_stats *stats;
+  unsigned long start = nwm_stats_now();
+  int fd;
+
+  while((fd = open(path, O_RDONLY)) < 0) {
+    if(nwm_stats_now() - start > 10 * TIMEOUT) {
+      return NULL;
+    }
+    sleep_usec(10000);
+  }
+  stats = mmap(NULL, sizeof(nwm_stats), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if(stats == MAP_FAILED) {
+    return NULL;
+  }
+  while(stats->magic != NWM_STATS_MAGIC || !stats->adopt_done) {
+    if(nwm_stats_now() - start > 10 * TIMEOUT) {
+      break;
+    }
+    sleep_usec(10000);
+  }
+  if(stats->magic != NWM_STATS_MAGIC || stats->version != NWM_STATS_VERSION || stats->size != sizeof(nwm_stats)) {
+    fprintf(stderr, "clients: %s is not a compatible nwm stats file\n", path);
+    munmap(stats, sizeof(nwm_stats));
+    return NULL;
+  }
+  return stats;
+}
+
+// copies the shared stats, retrying while nwm is in the middle of an update
+static void read_stats(nwm_stats *shared, nwm_stats *copy) {
+  unsigned long sequence;
+  do {
+    sequence = shared->sequence;
+    memcpy(copy, shared, sizeof(nwm_stats));
+  } while((sequence & 1) || sequence != shared->sequence);
+}
+
+static int prespawn(int count) {
+  int i;
+  signal(SIGTERM, on_signal);
+  signal(SIGINT, on_signal);
+  for(i = 0; i < count; i++) {
+    XMapWindow(dpy, create_window(i));
+  }
+  XSync(dpy, False);
+  fprintf(stderr, "clients: %d windows mapped\n", count);
+  while(!done) {
+    while(XPending(dpy)) {
+      XEvent ev;
+      XNextEvent(dpy, &ev);
+    }
+    sleep_usec(100000);
+  }
+  return 0;
+}
+
+static int workload(int count, int rate, const char *stats_path) {
+  Window *wins = malloc(count * sizeof(Window));
+  nwm_stats *shared = NULL, stats;
+  unsigned long start, elapsed;
+  int i;
+
+  if(count > 0 && !wins) {
+    fprintf(stderr, "clients: could not malloc() %d windows\n", count);
+    return 1;
+  }
+  if(stats_path && !(shared = open_stats(stats_path))) {
+    fprintf(stderr, "clients: could not open the stats file %s\n", stats_path);
+  }
+  start = nwm_stats_now();
+  // map -> MapNotify (the wm mapped it) and -> the ConfigureNotify of the layout
+  for(i = 0; i < count; i++) {
+    unsigned long t;
+    wins[i] = create_window(i);
+    XSync(dpy, False);
+    t = nwm_stats_now();
+    XMapWindow(dpy, wins[i]);
+    XFlush(dpy);
+    measure(measureMap, wins[i], MapNotify, False, t);
+    measure(measureArranged, wins[i], ConfigureNotify, True, t);
+    pace(rate);
+  }
+  // retitle and request a resize -> ConfigureNotify (real, or synthetic if denied)
+  for(i = 0; i < count; i++) {
+    char title[32];
+    unsigned long t;
+    snprintf(title, sizeof title, "bench %d retitled", i);
+    XStoreName(dpy, wins[i], title);
+    pace(rate);
+    t = nwm_stats_now();
+    XResizeWindow(dpy, wins[i], 300 + i, 150 + i);
+    XFlush(dpy);
+    measure(measureConfigure, wins[i], ConfigureNotify, False, t);
+    pace(rate);
+  }
+  // focus switch: pointer into the window -> FocusIn
+  for(i = 0; i < count; i++) {
+    XWindowAttributes wa;
+    unsigned long t;
+    if(!XGetWindowAttributes(dpy, wins[i], &wa) || wa.map_state != IsViewable) {
+      continue;
+    }
+    t = nwm_stats_now();
+    XWarpPointer(dpy, None, wins[i], 0, 0, 0, 0, wa.width / 2, wa.height / 2);
+    XFlush(dpy);
+    measure(measureFocus, wins[i], FocusIn, False, t);
+    pace(rate);
+  }
+  // fullscreen on and off -> ConfigureNotify
+  for(i = 0; i < count; i++) {
+    unsigned long t = nwm_stats_now();
+    fullscreen(wins[i], True);
+    measure(measureFullscreen, wins[i], ConfigureNotify, True, t);
+    pace(rate);
+    fullscreen(wins[i], False);
+    pace(rate);
+  }
+  for(i = 0; i < count; i++) {
+    XUnmapWindow(dpy, wins[i]);
+    XDestroyWindow(dpy, wins[i]);
+    XFlush(dpy);
+    pace(rate);
+  }
+  XSync(dpy, False);
+  elapsed = nwm_stats_now() - start;
+
+  printf("{\n  \"windows\": %d,\n  \"rate\": %d,\n", count, rate);
+  printf("  \"throughput\": { \"operations\": %lu, \"seconds\": %.3f, \"per_second\": %.1f },\n",
+      operations, elapsed / 1e6, operations / (elapsed / 1e6));
+  printf("  \"latency_usec\": {\n");
+  for(i = 0; i < measureLast; i++) {
+    print_histogram(measure_names[i], &measures[i], timeouts[i], i == measureLast - 1);
+  }
+  if(shared) {
+    read_stats(shared, &stats);
+    printf("  },\n  \"wm\": {\n");
+    printf("    \"adopted\": %lu,\n    \"adopt_usec\": %lu,\n", stats.adopted, stats.adopt_usec);
+    printf("    \"errors_benign\": %lu,\n    \"errors_unexpected\": %lu,\n",
+        stats.errors_benign, stats.errors_unexpected);
+    print_histogram("rearrange", &stats.rearrange, 0, 0);
+    print_histogram("apply_layout", &stats.apply_layout, 0, 0);
+    print_histogram("batch_size", &stats.batch_size, 0, 1);
+    printf("  }\n}\n");
+    munmap(shared, sizeof(nwm_stats));
+  } else {
+    printf("  }\n}\n");
+  }
+  free(wins);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  int opt, count = 20, rate = 50, persist = 0;
+  const char *stats_path = NULL;
+
+  while((opt = getopt(argc, argv, "pn:r:s:")) != -1) {
+    switch(opt) {
+      case 'p': persist = 1; break;
+      case 'n': count = atoi(optarg); break;
+      case 'r': rate = atoi(optarg); break;
+      case 's': stats_path = optarg; break;
+      default:
+        fprintf(stderr, "usage: %s [-p] [-n windows] [-r operations per second] [-s stats file]\n", argv[0]);
+        return 1;
+    }
+  }
+  if(!(dpy = XOpenDisplay(NULL))) {
+    fprintf(stderr, "clients: cannot open display\n");
+    return 1;
+  }
+  root = DefaultRootWindow(dpy);
+  return (persist ? prespawn(count) : workload(count, rate, stats_path));
+}
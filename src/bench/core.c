@@ -0,0 +1,253 @@
+// Micro-benchmark of the native core, without Node (see core.sh).
+//
+//   core [-w] [-n windows] [-r repetitions]
+//
+// Runs nwm in process against a recording emit function, which answers
+// nothing: no layouts are applied and configure requests are left alone.
+// A second connection plays the clients. Measured, and printed as JSON:
+//
+//   handler_nsec   cost of each event handler, by X event type, while N
+//                  windows are mapped, retitled, configured, entered and
+//                  destroyed; with the requests each handler sent, and
+//                  the round trips among them
+//   winset_nsec    WinSet_get hits and misses with 10, 100 and 1000 windows
+//   usec           grab_keys: nwm_grab_keys with 64 bindings, until the
+//                  server is done; monitors: a rescan that finds no changes
+//
+// nwm.c is included rather than linked, so that its handler table and static
+// functions can be timed directly. -w waits up to 5 s for the display.
+#include "nwm.c"
+
+#define KEY_BINDINGS 64
+#define LOOKUPS 1000000
+
+// the clients' connection
+static Display *cdpy;
+// callbacks emitted by nwm, by callback_map
+static unsigned long emitted[onLast];
+// handler costs by event type, filled in by timed_handler
+static nwm_histogram handler_nsec[LASTEvent];
+static void (*timed[LASTEvent]) (NodeWinMan *, XEvent *);
+
+static unsigned long now_nsec() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+static void record_emit(NodeWinMan *nwm, callback_map event, void *ev) {
+  emitted[event]++;
+}
+
+static void timed_handler(NodeWinMan *nwm, XEvent *e) {
+  unsigned long start = now_nsec();
+  timed[e->type](nwm, e);
+  nwm_histogram_add(&handler_nsec[e->type], now_nsec() - start);
+}
+
+// puts timed_handler in front of every handler nwm_handle dispatches to
+static void time_handlers() {
+  int i;
+  for(i = 0; i < LASTEvent; i++) {
+    if(handler[i]) {
+      timed[i] = handler[i];
+      handler[i] = timed_handler;
+    }
+  }
+}
+
+// lets nwm handle everything the clients caused, including the events that
+// its own requests cause in turn
+static void pump(NodeWinMan *nwm) {
+  XSync(cdpy, False);
+  XSync(nwm->dpy, False);
+  while(XPending(nwm->dpy)) {
+    nwm_loop(nwm);
+    XSync(nwm->dpy, False);
+  }
+}
+
+static void client_windows(NodeWinMan *nwm, Window *wins, int count) {
+  char title[32];
+  int i;
+
+  // a grid of small windows, so that each can be entered
+  for(i = 0; i < count; i++) {
+    wins[i] = XCreateSimpleWindow(cdpy, DefaultRootWindow(cdpy), (i % 32) * 40, (i / 32) * 40, 30, 30, 0, 0, 0);
+    XMapWindow(cdpy, wins[i]);
+  }
+  pump(nwm);
+  for(i = 0; i < count; i++) {
+    snprintf(title, sizeof(title), "window %d", i);
+    XStoreName(cdpy, wins[i], title);
+  }
+  pump(nwm);
+  for(i = 0; i < count; i++) {
+    XMoveResizeWindow(cdpy, wins[i], (i % 32) * 40, (i / 32) * 40, 32, 32);
+  }
+  pump(nwm);
+  for(i = 0; i < count; i++) {
+    XWarpPointer(cdpy, None, wins[i], 0, 0, 0, 0, 5, 5);
+    // one EnterNotify per batch, or all but the last are coalesced
+    pump(nwm);
+  }
+  for(i = 0; i < count; i++) {
+    XDestroyWindow(cdpy, wins[i]);
+  }
+  pump(nwm);
+}
+
+static void print_histogram(const char *name, nwm_histogram *h, int last) {
+  printf("    \"%s\": { \"count\": %lu, \"mean\": %.1f, \"p50\": %lu, \"p99\": %lu, \"max\": %lu }%s\n",
+      name, h->count, (h->count ? (double) h->total / h->count : 0.0),
+      nwm_histogram_percentile(h, 0.5), nwm_histogram_percentile(h, 0.99), h->max, (last ? "" : ","));
+}
+
+static void print_handlers(NodeWinMan *nwm) {
+  int i, last = -1;
+  nwm_histogram *h;
+
+  for(i = 0; i < LASTEvent; i++) {
+    if(handler_nsec[i].count) {
+      last = i;
+    }
+  }
+  printf("  \"handler_nsec\": {\n");
+  for(i = 0; i <= last; i++) {
+    h = &handler_nsec[i];
+    if(!h->count) {
+      continue;
+    }
+    printf("    \"%s\": { \"count\": %lu, \"mean\": %.1f, \"p50\": %lu, \"p99\": %lu, \"max\": %lu, \"requests\": %.2f, \"round_trips\": %.2f }%s\n",
+        nwm_get_event_name(i), h->count, (double) h->total / h->count,
+        nwm_histogram_percentile(h, 0.5), nwm_histogram_percentile(h, 0.99), h->max,
+        (double) nwm->stats->requests[i] / h->count,
+        (double) nwm->stats->round_trips[i] / h->count, (i == last ? "" : ","));
+  }
+  printf("  },\n");
+}
+
+// window ids as several clients would have them: a resource base per client
+static Window fake_id(unsigned int i) {
+  return ((i % 8) + 1) << 21 | (i / 8 + 1);
+}
+
+// mean nsec per WinSet_get over LOOKUPS lookups, of windows in the set or not
+static double winset_lookup(unsigned int count, Bool hits) {
+  WinSet set;
+  unsigned int i, found = 0;
+  unsigned long start;
+
+  WinSet_init(&set, 0);
+  for(i = 0; i < count; i++) {
+    WinSet_add(&set, fake_id(i));
+  }
+  start = now_nsec();
+  for(i = 0; i < LOOKUPS; i++) {
+    // a fixed, scattered order; misses use ids of windows not added
+    unsigned int k = (i * 7919) % count;
+    found += (WinSet_get(&set, fake_id(hits ? k : count + k)) != NULL);
+  }
+  start = now_nsec() - start;
+  WinSet_free(&set);
+  if(found != (hits ? LOOKUPS : 0)) {
+    fprintf(stderr, "core: WinSet lookups found %u windows\n", found);
+  }
+  return (double) start / LOOKUPS;
+}
+
+static void grab_keys(NodeWinMan *nwm, int repetitions, nwm_histogram *h) {
+  unsigned int mods[] = { Mod4Mask, Mod4Mask|ShiftMask, Mod4Mask|ControlMask, Mod1Mask };
+  unsigned long start;
+  int i;
+
+  nwm_empty_keys(nwm);
+  for(i = 0; i < KEY_BINDINGS; i++) {
+    nwm_add_key(nwm, XK_a + i % 26, mods[i / 26 % 4], i);
+  }
+  for(i = 0; i < repetitions; i++) {
+    start = now_nsec();
+    nwm_grab_keys(nwm);
+    XSync(nwm->dpy, False);
+    nwm_histogram_add(h, (now_nsec() - start) / 1000);
+  }
+}
+
+static void scan_monitors(NodeWinMan *nwm, int repetitions, nwm_histogram *h) {
+  unsigned long start;
+  int i;
+
+  for(i = 0; i < repetitions; i++) {
+    start = now_nsec();
+    nwm_scan_monitors(nwm);
+    nwm_histogram_add(h, (now_nsec() - start) / 1000);
+  }
+}
+
+int main(int argc, char **argv) {
+  int opt, i, count = 100, repetitions = 100, wait = 0;
+  unsigned int sizes[] = { 10, 100, 1000 };
+  unsigned long emits = 0;
+  nwm_histogram grab_usec = { 0 }, monitors_usec = { 0 };
+  struct timespec delay = { 0, 100000000L };
+  NodeWinMan *nwm;
+  Window *wins;
+
+  while((opt = getopt(argc, argv, "wn:r:")) != -1) {
+    switch(opt) {
+      case 'w': wait = 1; break;
+      case 'n': count = atoi(optarg); break;
+      case 'r': repetitions = atoi(optarg); break;
+      default:
+        fprintf(stderr, "usage: %s [-w] [-n windows] [-r repetitions]\n", argv[0]);
+        return 1;
+    }
+  }
+  for(i = 0; !(cdpy = XOpenDisplay(NULL)); i++) {
+    if(!wait || i == 50) {
+      fprintf(stderr, "core: cannot open display\n");
+      return 1;
+    }
+    nanosleep(&delay, NULL);
+  }
+  if(count < 0 || !(wins = malloc((count ? count : 1) * sizeof(Window)))) {
+    fprintf(stderr, "core: cannot make %d windows\n", count);
+    return 1;
+  }
+  nwm_set_log_level(NWM_LOG_WARN);
+  nwm = nwm_new();
+  nwm_set_emit_function(nwm, record_emit);
+  if(nwm_init(nwm, NULL) < 0) {
+    fprintf(stderr, "core: nwm cannot open the display\n");
+    return 1;
+  }
+  // only what the clients cause is timed
+  pump(nwm);
+  nwm_stats_reset(nwm->stats);
+  time_handlers();
+  client_windows(nwm, wins, count);
+
+  printf("{\n  \"windows\": %d,\n  \"repetitions\": %d,\n", count, repetitions);
+  print_handlers(nwm);
+  for(i = 0; i < onLast; i++) {
+    emits += emitted[i];
+  }
+  printf("  \"emits\": %lu,\n", emits);
+  printf("  \"winset_nsec\": {\n");
+  for(i = 0; i < 3; i++) {
+    printf("    \"%u\": { \"hit\": %.1f, \"miss\": %.1f }%s\n", sizes[i],
+        winset_lookup(sizes[i], True), winset_lookup(sizes[i], False), (i == 2 ? "" : ","));
+  }
+  printf("  },\n");
+  grab_keys(nwm, repetitions, &grab_usec);
+  scan_monitors(nwm, repetitions, &monitors_usec);
+  printf("  \"usec\": {\n");
+  print_histogram("grab_keys", &grab_usec, 0);
+  print_histogram("monitors", &monitors_usec, 1);
+  printf("  }\n}\n");
+
+  nwm_free(nwm);
+  XCloseDisplay(cdpy);
+  free(wins);
+  return 0;
+}
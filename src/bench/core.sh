@@ -0,0 +1,30 @@
+#!/bin/sh
+# Runs the native core benchmark on a headless Xvfb server and prints the
+# results as JSON. Run from src/ after building it (make bench-core does both).
+# Arguments are passed on to ./core, e.g. -n 1000 -r 20.
+#
+#   NWM_BENCH_DISPLAY   display for Xvfb (:98)
+#
+# The binary keeps its frame pointers, so it can also be profiled, e.g.
+#   perf record -g ./core -w      (with DISPLAY set to a running Xvfb)
+cd "$(dirname "$0")"
+
+DISPLAY=${NWM_BENCH_DISPLAY:-:98}
+export DISPLAY
+
+if ! command -v Xvfb >/dev/null; then
+  echo "core.sh: Xvfb not found" >&2
+  exit 1
+fi
+
+cleanup() {
+  kill $XVFB 2>/dev/null
+  wait 2>/dev/null
+}
+trap cleanup EXIT INT TERM
+
+Xvfb "$DISPLAY" -screen 0 1280x1024x24 -nolisten tcp >/dev/null 2>&1 &
+XVFB=$!
+
+# -w waits for the server to accept connections
+./core -w "$@"
@@ -0,0 +1,16 @@
+// Minimal nwm configuration for the benchmark (see run.sh):
+// one tiling layout, no shortcuts, stats shared in $NWM_STATS_FILE.
+// Set NWM_BENCH_LAYOUT=js to benchmark the Javascript layout instead of the native one.
+var NWM = require('../../nwm.js'),
+    layouts = require('../../lib/layouts');
+
+var nwm = new NWM();
+
+if(process.env.NWM_BENCH_LAYOUT == 'js') {
+  nwm.addLayout('tile', layouts.tile);
+} else {
+  nwm.addLayout('tile', layouts.native('tile'));
+}
+nwm.statsFile = process.env.NWM_STATS_FILE || '/dev/shm/nwm-bench-stats';
+
+nwm.start(function() {});
@@ -0,0 +1,57 @@
+#!/bin/sh
+# Runs nwm against synthetic clients on a headless Xvfb server and prints the
+# results as JSON. Run from src/ after building the binding and the clients
+# (make bench builds the clients; node-gyp builds both).
+#
+#   NWM_BENCH_WINDOWS   windows mapped before nwm starts, and by the workload (20)
+#   NWM_BENCH_RATE      workload operations per second, 0 for no limit (50)
+#   NWM_BENCH_DISPLAY   display for Xvfb (:99)
+#   NWM_BENCH_LAYOUT    'js' to use the Javascript tile layout instead of the native one
+cd "$(dirname "$0")"
+
+WINDOWS=${NWM_BENCH_WINDOWS:-20}
+RATE=${NWM_BENCH_RATE:-50}
+DISPLAY=${NWM_BENCH_DISPLAY:-:99}
+NWM_STATS_FILE=/tmp/nwm-bench-stats.$$
+export DISPLAY NWM_STATS_FILE
+# built by make bench, or by node-gyp as the nwm_bench_clients target
+CLIENTS=./clients
+if [ ! -x "$CLIENTS" ] && [ -x ../../build/Release/nwm_bench_clients ]; then
+  CLIENTS=../../build/Release/nwm_bench_clients
+fi
+
+if ! command -v Xvfb >/dev/null; then
+  echo "run.sh: Xvfb not found" >&2
+  exit 1
+fi
+
+cleanup() {
+  kill $NWM $PRESPAWN $XVFB 2>/dev/null
+  wait 2>/dev/null
+  rm -f "$NWM_STATS_FILE"
+}
+trap cleanup EXIT INT TERM
+
+Xvfb "$DISPLAY" -screen 0 1280x1024x24 -nolisten tcp >/dev/null 2>&1 &
+XVFB=$!
+# wait for the server to accept connections
+i=0
+until "$CLIENTS" -n 0 >/dev/null 2>&1; do
+  i=$((i + 1))
+  if [ $i -gt 50 ]; then
+    echo "run.sh: Xvfb did not start on $DISPLAY" >&2
+    exit 1
+  fi
+  sleep 0.1
+done
+
+# windows that already exist when nwm starts, to measure adoption
+"$CLIENTS" -p -n "$WINDOWS" &
+PRESPAWN=$!
+sleep 0.5
+
+rm -f "$NWM_STATS_FILE"
+node nwm-bench.js >nwm-bench.log 2>&1 &
+NWM=$!
+
+"$CLIENTS" -n "$WINDOWS" -r "$RATE" -s "$NWM_STATS_FILE"
@@ -0,0 +1,380 @@
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <X11/Xatom.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#ifdef NWM_XCB
+#include <xcb/xcb.h>
+#include <X11/Xlib-xcb.h>
+#endif
+#include "fetch.h"
+
+// copies a text property into text, converting it to the locale encoding if needed
+static Bool copy_text(Display *dpy, XTextProperty *prop, char *text) {
+  char **list = NULL;
+  int n;
+
+  text[0] = '\0';
+  if(!prop->nitems || !prop->value)
+    return False;
+  if(prop->encoding == XA_STRING || prop->format != 8) {
+    strncpy(text, (char *)prop->value, NWM_TEXT_LEN - 1);
+  } else if(XmbTextPropertyToTextList(dpy, prop, &list, &n) >= Success && n > 0 && *list) {
+    strncpy(text, *list, NWM_TEXT_LEN - 1);
+    XFreeStringList(list);
+  }
+  text[NWM_TEXT_LEN - 1] = '\0';
+  return True;
+}
+
+// _NET_WM_STRUT only has the four widths, which then span the whole edge
+static void fill_strut(long *strut, const long *values, unsigned long length) {
+  unsigned long i;
+  for(i = 0; i < length; i++) {
+    strut[i] = values[i];
+  }
+  if(length < StrutLast) {
+    strut[StrutLeftStartY] = strut[StrutRightStartY] = 0;
+    strut[StrutTopStartX] = strut[StrutBottomStartX] = 0;
+    strut[StrutLeftEndY] = strut[StrutRightEndY] = LONG_MAX;
+    strut[StrutTopEndX] = strut[StrutBottomEndX] = LONG_MAX;
+  }
+}
+
+// maps the atoms listed in WM_PROTOCOLS to fetch_protocols flags
+static unsigned int protocol_flags(const nwm_fetch_atoms *atoms, Atom *protocols, int n) {
+  unsigned int flags = 0;
+  while(n--) {
+    if(protocols[n] == atoms->wm_delete_window)
+      flags |= ProtocolDelete;
+    else if(protocols[n] == atoms->wm_take_focus)
+      flags |= ProtocolTakeFocus;
+  }
+  return flags;
+}
+
+#ifndef NWM_XCB
+
+static void copy_class(nwm_window_info *info, const char *instance, const char *klass) {
+  strncpy(info->instance, instance, NWM_TEXT_LEN - 1);
+  info->instance[NWM_TEXT_LEN - 1] = '\0';
+  strncpy(info->klass, klass, NWM_TEXT_LEN - 1);
+  info->klass[NWM_TEXT_LEN - 1] = '\0';
+}
+
+static Bool fetch_text(Display *dpy, Window win, Atom atom, char *text, unsigned int *trips) {
+  XTextProperty prop;
+  Bool found;
+
+  text[0] = '\0';
+  (*trips)++;
+  if(!XGetTextProperty(dpy, win, &prop, atom))
+    return False;
+  found = copy_text(dpy, &prop, text);
+  if(prop.value)
+    XFree(prop.value);
+  return found;
+}
+
+static Bool fetch_strut(Display *dpy, Window win, Atom property, unsigned long length, long *strut,
+    unsigned int *trips) {
+  Atom type;
+  int format;
+  unsigned long n, extra;
+  unsigned char *value = NULL;
+  Bool found = False;
+
+  (*trips)++;
+  if(XGetWindowProperty(dpy, win, property, 0L, length, False, XA_CARDINAL,
+      &type, &format, &n, &extra, &value) == Success && value) {
+    if(n == length && format == 32) {
+      fill_strut(strut, (long *) value, length);
+      found = True;
+    }
+    XFree(value);
+  }
+  return found;
+}
+
+unsigned int nwm_fetch_windows(Display *dpy, const nwm_fetch_atoms *atoms, Window *ids,
+    unsigned int count, unsigned int flags, nwm_window_info *out) {
+  unsigned int i, trips = 0;
+
+  for(i = 0; i < count; i++) {
+    nwm_window_info *info = &out[i];
+    Window win = ids[i];
+
+    memset(info, 0, sizeof(nwm_window_info));
+    info->id = win;
+    if(flags & FetchAttributes) {
+      // GetWindowAttributes, then GetGeometry
+      trips += 2;
+      info->ok = XGetWindowAttributes(dpy, win, &info->wa);
+      if(!info->ok)
+        continue;
+    }
+    if(flags & FetchTransient) {
+      trips++;
+      if(!XGetTransientForHint(dpy, win, &info->transient_for))
+        info->transient_for = None;
+    }
+    if(flags & FetchTitle) {
+      if(!fetch_text(dpy, win, atoms->net_wm_name, info->title, &trips))
+        fetch_text(dpy, win, XA_WM_NAME, info->title, &trips);
+    }
+    if(flags & FetchClass) {
+      XClassHint ch = { 0 };
+      trips++;
+      if(XGetClassHint(dpy, win, &ch)) {
+        copy_class(info, (ch.res_name ? ch.res_name : ""), (ch.res_class ? ch.res_class : ""));
+        if(ch.res_class)
+          XFree(ch.res_class);
+        if(ch.res_name)
+          XFree(ch.res_name);
+      }
+    }
+    if(flags & FetchProtocols) {
+      Atom *protocols;
+      int n;
+      trips++;
+      if(XGetWMProtocols(dpy, win, &protocols, &n)) {
+        info->protocols = protocol_flags(atoms, protocols, n);
+        XFree(protocols);
+      }
+    }
+    if(flags & FetchState) {
+      Atom type;
+      int format;
+      unsigned long n, extra;
+      unsigned char *value = NULL;
+      info->state = WithdrawnState;
+      trips++;
+      if(XGetWindowProperty(dpy, win, atoms->wm_state, 0L, 2L, False, atoms->wm_state,
+          &type, &format, &n, &extra, &value) == Success && value) {
+        if(n > 0 && format == 32)
+          info->state = *(long *) value;
+        XFree(value);
+      }
+    }
+    if(flags & FetchStrut) {
+      if(!fetch_strut(dpy, win, atoms->net_wm_strut_partial, StrutLast, info->strut, &trips))
+        fetch_strut(dpy, win, atoms->net_wm_strut, 4, info->strut, &trips);
+    }
+  }
+  return trips;
+}
+
+#else
+
+// cookies for one window; all requests are sent before any reply is read
+typedef struct {
+  xcb_get_window_attributes_cookie_t attributes;
+  xcb_get_geometry_cookie_t geometry;
+  xcb_get_property_cookie_t transient;
+  xcb_get_property_cookie_t net_wm_name;
+  xcb_get_property_cookie_t wm_name;
+  xcb_get_property_cookie_t wm_class;
+  xcb_get_property_cookie_t protocols;
+  xcb_get_property_cookie_t state;
+  xcb_get_property_cookie_t strut_partial;
+  xcb_get_property_cookie_t strut;
+} fetch_cookies;
+
+// property replies carry at most this many 32-bit units
+#define TEXT_UNITS (NWM_TEXT_LEN / 4)
+
+static xcb_get_property_reply_t* property_reply(xcb_connection_t *c, xcb_get_property_cookie_t cookie) {
+  xcb_generic_error_t *error = NULL;
+  xcb_get_property_reply_t *reply = xcb_get_property_reply(c, cookie, &error);
+  // errors are collected here so they never reach the Xlib error handler
+  free(error);
+  if(reply && !xcb_get_property_value_length(reply)) {
+    free(reply);
+    return NULL;
+  }
+  return reply;
+}
+
+static Bool reply_text(Display *dpy, xcb_get_property_reply_t *reply, char *text) {
+  XTextProperty prop;
+  int length = xcb_get_property_value_length(reply);
+  // the value is not null-terminated; the text helpers expect it to be
+  char *value = malloc(length + 1);
+  Bool found;
+
+  if(!value)
+    return False;
+  memcpy(value, xcb_get_property_value(reply), length);
+  value[length] = '\0';
+  prop.value = (unsigned char *) value;
+  prop.encoding = reply->type;
+  prop.format = reply->format;
+  prop.nitems = (reply->format == 8 ? length : 0);
+  found = copy_text(dpy, &prop, text);
+  free(value);
+  return found;
+}
+
+static void reply_strut(xcb_get_property_reply_t *reply, unsigned int length, long *strut) {
+  uint32_t *values = xcb_get_property_value(reply);
+  long copied[StrutLast];
+  unsigned int i;
+
+  if(reply->format != 32 || xcb_get_property_value_length(reply) != (int) (length * 4))
+    return;
+  for(i = 0; i < length; i++) {
+    copied[i] = values[i];
+  }
+  fill_strut(strut, copied, length);
+}
+
+// copies the null-terminated (or length-bounded) string at value, returns its length
+static int copy_string(char *text, const char *value, int length) {
+  const char *end = memchr(value, '\0', length);
+  int n = (end ? end - value : length);
+  int copied = (n < NWM_TEXT_LEN ? n : NWM_TEXT_LEN - 1);
+  memcpy(text, value, copied);
+  text[copied] = '\0';
+  return n;
+}
+
+unsigned int nwm_fetch_windows(Display *dpy, const nwm_fetch_atoms *atoms, Window *ids,
+    unsigned int count, unsigned int flags, nwm_window_info *out) {
+  xcb_connection_t *c = XGetXCBConnection(dpy);
+  fetch_cookies *cookies;
+  unsigned int i;
+
+  if(!count)
+    return 0;
+  if(!(cookies = malloc(count * sizeof(fetch_cookies)))) {
+    fprintf( stderr, "fatal: could not malloc() %lu bytes\n", count * sizeof(fetch_cookies));
+    exit( -1 );
+  }
+  // send all requests
+  for(i = 0; i < count; i++) {
+    xcb_window_t win = (xcb_window_t) ids[i];
+    if(flags & FetchAttributes) {
+      cookies[i].attributes = xcb_get_window_attributes(c, win);
+      cookies[i].geometry = xcb_get_geometry(c, win);
+    }
+    if(flags & FetchTransient) {
+      cookies[i].transient = xcb_get_property(c, 0, win, XCB_ATOM_WM_TRANSIENT_FOR, XCB_ATOM_WINDOW, 0, 1);
+    }
+    if(flags & FetchTitle) {
+      cookies[i].net_wm_name = xcb_get_property(c, 0, win, atoms->net_wm_name, XCB_GET_PROPERTY_TYPE_ANY, 0, TEXT_UNITS);
+      cookies[i].wm_name = xcb_get_property(c, 0, win, XCB_ATOM_WM_NAME, XCB_GET_PROPERTY_TYPE_ANY, 0, TEXT_UNITS);
+    }
+    if(flags & FetchClass) {
+      cookies[i].wm_class = xcb_get_property(c, 0, win, XCB_ATOM_WM_CLASS, XCB_ATOM_STRING, 0, 2 * TEXT_UNITS);
+    }
+    if(flags & FetchProtocols) {
+      cookies[i].protocols = xcb_get_property(c, 0, win, atoms->wm_protocols, XCB_ATOM_ATOM, 0, TEXT_UNITS);
+    }
+    if(flags & FetchState) {
+      cookies[i].state = xcb_get_property(c, 0, win, atoms->wm_state, atoms->wm_state, 0, 2);
+    }
+    if(flags & FetchStrut) {
+      cookies[i].strut_partial = xcb_get_property(c, 0, win, atoms->net_wm_strut_partial, XCB_ATOM_CARDINAL, 0, StrutLast);
+      cookies[i].strut = xcb_get_property(c, 0, win, atoms->net_wm_strut, XCB_ATOM_CARDINAL, 0, 4);
+    }
+  }
+  xcb_flush(c);
+
+  // collect the replies in the same order; every cookie must be consumed
+  for(i = 0; i < count; i++) {
+    nwm_window_info *info = &out[i];
+    xcb_get_property_reply_t *reply;
+
+    memset(info, 0, sizeof(nwm_window_info));
+    info->id = ids[i];
+    if(flags & FetchAttributes) {
+      xcb_generic_error_t *error = NULL;
+      xcb_get_window_attributes_reply_t *attributes;
+      xcb_get_geometry_reply_t *geometry;
+
+      attributes = xcb_get_window_attributes_reply(c, cookies[i].attributes, &error);
+      free(error);
+      error = NULL;
+      geometry = xcb_get_geometry_reply(c, cookies[i].geometry, &error);
+      free(error);
+      if(attributes && geometry) {
+        info->ok = True;
+        info->wa.x = geometry->x;
+        info->wa.y = geometry->y;
+        info->wa.width = geometry->width;
+        info->wa.height = geometry->height;
+        info->wa.border_width = geometry->border_width;
+        info->wa.map_state = attributes->map_state;
+        info->wa.override_redirect = attributes->override_redirect;
+      }
+      free(attributes);
+      free(geometry);
+    }
+    if(flags & FetchTransient) {
+      if((reply = property_reply(c, cookies[i].transient))) {
+        info->transient_for = *(xcb_window_t *) xcb_get_property_value(reply);
+        free(reply);
+      }
+    }
+    if(flags & FetchTitle) {
+      xcb_get_property_reply_t *fallback = property_reply(c, cookies[i].wm_name);
+      if((reply = property_reply(c, cookies[i].net_wm_name))) {
+        reply_text(dpy, reply, info->title);
+        free(reply);
+      } else if(fallback) {
+        reply_text(dpy, fallback, info->title);
+      }
+      free(fallback);
+    }
+    if(flags & FetchClass) {
+      if((reply = property_reply(c, cookies[i].wm_class))) {
+        // "instance\0class\0"
+        int length = xcb_get_property_value_length(reply);
+        char *value = xcb_get_property_value(reply);
+        int split = copy_string(info->instance, value, length);
+        if(split < length) {
+          copy_string(info->klass, value + split + 1, length - split - 1);
+        }
+        free(reply);
+      }
+    }
+    if(flags & FetchProtocols) {
+      if((reply = property_reply(c, cookies[i].protocols))) {
+        // 32-bit atoms in the reply, Atom is wider on 64-bit Xlib
+        xcb_atom_t *values = xcb_get_property_value(reply);
+        int j, n = xcb_get_property_value_length(reply) / 4;
+        Atom protocols[TEXT_UNITS];
+        for(j = 0; j < n && j < TEXT_UNITS; j++) {
+          protocols[j] = values[j];
+        }
+        info->protocols = protocol_flags(atoms, protocols, j);
+        free(reply);
+      }
+    }
+    if(flags & FetchState) {
+      info->state = WithdrawnState;
+      if((reply = property_reply(c, cookies[i].state))) {
+        if(reply->format == 32)
+          info->state = *(uint32_t *) xcb_get_property_value(reply);
+        free(reply);
+      }
+    }
+    if(flags & FetchStrut) {
+      xcb_get_property_reply_t *fallback = property_reply(c, cookies[i].strut);
+      if((reply = property_reply(c, cookies[i].strut_partial))) {
+        reply_strut(reply, StrutLast, info->strut);
+        free(reply);
+      } else if(fallback) {
+        reply_strut(fallback, 4, info->strut);
+      }
+      free(fallback);
+    }
+  }
+  free(cookies);
+  // the replies were waited for together
+  return 1;
+}
+
+#endif
@@ -0,0 +1,71 @@
+#include <X11/Xlib.h>
+
+// Reads the client window state nwm needs when adopting or updating a window.
+// The Xlib backend issues one blocking request per field. Building with
+// NWM_XCB sends every request for every window first and then collects the
+// replies, so fetching any number of windows costs about one round trip.
+
+#define NWM_TEXT_LEN 256
+
+enum fetch_flags {
+  FetchAttributes = 1,
+  FetchTransient = 2,
+  FetchTitle = 4,
+  FetchClass = 8,
+  FetchProtocols = 16,
+  FetchState = 32,
+  FetchStrut = 64,
+  FetchAll = 127
+};
+
+// FetchStrut: the _NET_WM_STRUT_PARTIAL fields
+enum fetch_strut {
+  StrutLeft, StrutRight, StrutTop, StrutBottom,
+  StrutLeftStartY, StrutLeftEndY, StrutRightStartY, StrutRightEndY,
+  StrutTopStartX, StrutTopEndX, StrutBottomStartX, StrutBottomEndX,
+  StrutLast
+};
+
+// FetchProtocols: the WM_PROTOCOLS a window takes part in
+enum fetch_protocols {
+  ProtocolDelete = 1,
+  ProtocolTakeFocus = 2
+};
+
+// the atoms that are read or compared against, interned by the caller
+typedef struct {
+  Atom net_wm_name;
+  Atom wm_protocols;
+  Atom wm_delete_window;
+  Atom wm_take_focus;
+  Atom wm_state;
+  Atom net_wm_strut_partial;
+  Atom net_wm_strut;
+} nwm_fetch_atoms;
+
+typedef struct {
+  Window id;
+  // FetchAttributes: False if the window could not be read (e.g. it is already gone).
+  // Only x, y, width, height, border_width, map_state and override_redirect are filled in.
+  Bool ok;
+  XWindowAttributes wa;
+  // FetchTransient: WM_TRANSIENT_FOR, or None
+  Window transient_for;
+  // FetchTitle / FetchClass: empty if the property is not set
+  char title[NWM_TEXT_LEN];
+  char instance[NWM_TEXT_LEN];
+  char klass[NWM_TEXT_LEN];
+  // FetchProtocols: fetch_protocols flags
+  unsigned int protocols;
+  // FetchState: the ICCCM WM_STATE (e.g. IconicState), or WithdrawnState if not set
+  long state;
+  // FetchStrut: _NET_WM_STRUT_PARTIAL, or the older _NET_WM_STRUT with the
+  // ranges covering the whole edge; all zero if neither is set
+  long strut[StrutLast];
+} nwm_window_info;
+
+// Fetches the fields selected by flags for count windows into out.
+// _NET_WM_NAME is preferred over WM_NAME for the title. Returns the number of
+// round trips it waited for: one per request with Xlib, one in all with XCB.
+extern unsigned int nwm_fetch_windows(Display *dpy, const nwm_fetch_atoms *atoms, Window *ids,
+    unsigned int count, unsigned int flags, nwm_window_info *out);
@@ -0,0 +1,135 @@
+#include <math.h>
+#include <string.h>
+#include "nwm.h"
+#include "layout.h"
+
+static const char *layout_names[layoutLast] = {
+  [layoutTile] = "tile",
+  [layoutWide] = "wide",
+  [layoutGrid] = "grid",
+  [layoutMonocle] = "monocle"
+};
+
+static void place(nwm_geometry *g, Window id, int x, int y, int width, int height, int border_width) {
+  g->id = id;
+  g->x = x;
+  g->y = y;
+  g->width = width;
+  g->height = height;
+  g->value_mask = CWX|CWY|CWWidth|CWHeight;
+  g->border_width = border_width;
+  g->stack = -1;
+}
+
+int nwm_layout_lookup(const char *name) {
+  int i;
+  for(i = 0; i < layoutLast; i++) {
+    if(strcmp(name, layout_names[i]) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// Dwm's tiling a.k.a "Vertical Stack Tiling", see lib/layouts/tile.js
+static unsigned int layout_tile(nwm_monitor *m, Window *ids, unsigned int count,
+    int scale, int border_width, nwm_geometry *out) {
+  unsigned int i;
+  int half_width, remain_width, slice_height;
+
+  if(count == 1) {
+    place(&out[0], ids[0], m->x, m->y, m->width, m->height, border_width);
+    return 1;
+  }
+  // as lib/layouts/tile.js computes it, which can be a pixel less than width * scale / 100
+  half_width = (int) floor(m->width / (100.0 / scale));
+  remain_width = m->width - half_width;
+  slice_height = m->height / (count - 1);
+  place(&out[0], ids[0], m->x, m->y, half_width, m->height, border_width);
+  for(i = 1; i < count; i++) {
+    place(&out[i], ids[i], m->x + half_width, m->y + (i - 1) * slice_height,
+      remain_width, slice_height, border_width);
+  }
+  return count;
+}
+
+// Bottom Stack Tiling (a.k.a. wide), see lib/layouts/wide.js
+static unsigned int layout_wide(nwm_monitor *m, Window *ids, unsigned int count,
+    int scale, int border_width, nwm_geometry *out) {
+  unsigned int i;
+  int half_height, remain_height, slice_width;
+
+  if(count == 1) {
+    place(&out[0], ids[0], m->x, m->y, m->width, m->height, border_width);
+    return 1;
+  }
+  half_height = (int) floor(m->height / (100.0 / scale));
+  remain_height = m->height - half_height;
+  slice_width = m->width / (count - 1);
+  place(&out[0], ids[0], m->x, m->y, m->width, half_height, border_width);
+  for(i = 1; i < count; i++) {
+    place(&out[i], ids[i], m->x + (i - 1) * slice_width, m->y + half_height,
+      slice_width, remain_height, border_width);
+  }
+  return count;
+}
+
+// Grid (a.k.a fair), see lib/layouts/grid.js
+static unsigned int layout_grid(nwm_monitor *m, Window *ids, unsigned int count,
+    int scale, int border_width, nwm_geometry *out) {
+  unsigned int i, rows, cols;
+  double cell_width, cell_height, adjust_width, adjust_height;
+
+  for(cols = 0; cols * 2 <= count; cols++) {
+    if(cols * cols >= count) {
+      break;
+    }
+  }
+  rows = ((cols && (cols - 1) * cols >= count) ? cols - 1 : cols);
+  cell_height = (double) m->height / (rows ? rows : 1);
+  cell_width = (double) m->width / (cols ? cols : 1);
+
+  for(i = 0; i < count; i++) {
+    // the last row shares the full width
+    if(rows > 1 && i == rows * cols - cols) {
+      cell_width = (double) m->width / (count - i);
+    }
+    // adjust height/width of last row/col's windows
+    adjust_height = (i >= cols * (rows - 1) ? m->height - cell_height * rows : 0);
+    if(rows > 1 && i == count - 1 && (count - i) < (count % cols)) {
+      adjust_width = m->width - cell_width * (count % cols);
+    } else {
+      adjust_width = ((i + 1) % cols == 0 ? m->width - cell_width * cols : 0);
+    }
+    place(&out[i], ids[i],
+      (int) floor(m->x + (i % cols) * cell_width),
+      (int) floor(m->y + (i / cols) * cell_height),
+      (int) floor(cell_width + adjust_width),
+      (int) floor(cell_height + adjust_height), border_width);
+  }
+  return count;
+}
+
+// Monocle (a.k.a. fullscreen): only the main window is placed, the caller hides the rest
+static unsigned int layout_monocle(nwm_monitor *m, Window *ids, unsigned int count,
+    int scale, int border_width, nwm_geometry *out) {
+  place(&out[0], ids[0], m->x, m->y, m->width, m->height, border_width);
+  return 1;
+}
+
+static unsigned int (*layouts[layoutLast]) (nwm_monitor *m, Window *ids, unsigned int count,
+    int scale, int border_width, nwm_geometry *out) = {
+  [layoutTile] = layout_tile,
+  [layoutWide] = layout_wide,
+  [layoutGrid] = layout_grid,
+  [layoutMonocle] = layout_monocle
+};
+
+unsigned int nwm_layout(layout_map layout, nwm_monitor *monitor,
+    Window *ids, unsigned int count, int scale, int border_width, nwm_geometry *out) {
+  if(count < 1 || layout < 0 || layout >= layoutLast) {
+    return 0;
+  }
+  scale = (scale < 1 ? 1 : (scale > 99 ? 99 : scale));
+  return layouts[layout](monitor, ids, count, scale, border_width, out);
+}
@@ -0,0 +1,22 @@
+// Native implementations of the bundled layouts (lib/layouts/*.js).
+// Include after nwm.h.
+
+enum layout_map {
+  layoutTile,
+  layoutWide,
+  layoutGrid,
+  layoutMonocle,
+  layoutLast
+};
+typedef enum layout_map layout_map;
+
+// returns the layout with the given name (e.g. "tile"), or -1
+extern int nwm_layout_lookup(const char *name);
+
+// Computes the geometry of the windows in ids on the monitor. ids[0] is the
+// main window, the rest are laid out in the given order. scale is the main
+// window scale (1-99) and border_width the border (-1 for the default).
+// Writes at most count entries to out and returns how many were written;
+// monocle only places the main window.
+extern unsigned int nwm_layout(layout_map layout, nwm_monitor *monitor,
+    Window *ids, unsigned int count, int scale, int border_width, nwm_geometry *out);
@@ -3,32 +3,100 @@
 #include <string.h>
 #include "list.h"
 
+// list nodes from every list share one pool
+static Pool list_pool = POOL_INITIALIZER(sizeof(List), 64);
+
+void Pool_init(Pool *pool, size_t size, unsigned int per_block) {
+  pool->size = size;
+  pool->per_block = per_block;
+  pool->live = 0;
+  pool->blocks = NULL;
+  pool->free_items = NULL;
+}
+
+// the item size actually used: big enough for the free list link, pointer aligned
+static size_t pool_item_size(Pool *pool) {
+  size_t size = (pool->size < sizeof(void *) ? sizeof(void *) : pool->size);
+  return (size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+}
+
+static int pool_grow(Pool *pool) {
+  size_t size = pool_item_size(pool);
+  size_t header = (sizeof(PoolBlock) + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+  unsigned int i;
+  PoolBlock *block;
+  char *items;
+
+  if(!(block = malloc(header + size * pool->per_block))) {
+    return -1;
+  }
+  block->next = pool->blocks;
+  pool->blocks = block;
+  // thread the new items onto the free list, lowest address first
+  items = (char *)block + header;
+  for(i = pool->per_block; i > 0; i--) {
+    void **item = (void **)(items + size * (i - 1));
+    *item = pool->free_items;
+    pool->free_items = item;
+  }
+  return 0;
+}
+
+void* Pool_alloc(Pool *pool) {
+  void **item;
+  if(!pool->free_items && pool_grow(pool) != 0) {
+    return NULL;
+  }
+  item = pool->free_items;
+  pool->free_items = *item;
+  pool->live++;
+  return (void *)item;
+}
+
+void Pool_release(Pool *pool, void *item) {
+  *(void **)item = pool->free_items;
+  pool->free_items = item;
+  pool->live--;
+}
+
+void Pool_free(Pool *pool) {
+  PoolBlock *next;
+  for( ; pool->blocks; pool->blocks = next) {
+    next = pool->blocks->next;
+    free(pool->blocks);
+  }
+  pool->free_items = NULL;
+  pool->live = 0;
+}
+
 List* List_push(List **list, void *data) {
   List *newnode;
 
-  if(!(newnode = malloc(sizeof(newnode)))) {
+  if(!(newnode = Pool_alloc(&list_pool))) {
     return NULL;
   }
 
   newnode->data = data;
   newnode->next = *list;
   *list = newnode;
-
-  fprintf(stdout, "list item data pointer %p.\n", data);
   return newnode;
 }
 
 /*
- * Note that this function only calls free() for the node, not whatever
+ * Note that this function only releases the node, not whatever
  * is contained in the data
  */
 int List_remove(List **list, List *node){
   List *current = *list;
 
+  if(!current) {
+    return -1;
+  }
+
   if(current == node) {
     // need to delete head item
     *list = node->next;
-    free(node);
+    Pool_release(&list_pool, node);
     return 0;
   }
 
@@ -36,14 +104,14 @@ int List_remove(List **list, List *node){
     current = current->next;
   }
 
-  if(!current) {
+  if(!current->next) {
     // not found e.g. reached end of list
     return -1;
   }
 
   // deleting other item
   current->next = node->next;
-  free(node);
+  Pool_release(&list_pool, node);
   return 0;
 }
 
@@ -52,7 +120,6 @@ int List_length(List *node) {
   for ( ; node; node = node->next) {
     i++;
   }
-  fprintf(stdout, "list length %d.\n", i);
   return i;
 }
 
@@ -61,7 +128,11 @@ void List_free(List *list) {
 
   for( ; list; list = next) {
     next = list->next;
-    free(list);
+    Pool_release(&list_pool, list);
+  }
+  // once no list holds a node, hand the blocks back to the heap in one go
+  if(list_pool.live == 0) {
+    Pool_free(&list_pool);
   }
 }
 
@@ -1,9 +1,36 @@
+#include <stddef.h>
 
 typedef struct List_T {
   struct List_T *next;
   void *data;
 } List;
 
+// Fixed-size allocator: items are handed out from contiguous blocks and
+// recycled through a free list, so churn stays off the global heap.
+typedef struct Pool_Block_T {
+  struct Pool_Block_T *next;
+} PoolBlock;
+
+typedef struct {
+  // size of one item (rounded up so a free item can hold a pointer)
+  size_t size;
+  // items per block
+  unsigned int per_block;
+  // number of items currently handed out
+  unsigned int live;
+  PoolBlock *blocks;
+  void *free_items;
+} Pool;
+
+#define POOL_INITIALIZER(item_size, items_per_block) \
+  { (item_size), (items_per_block), 0, NULL, NULL }
+
+extern void Pool_init(Pool *pool, size_t size, unsigned int per_block);
+extern void* Pool_alloc(Pool *pool);
+extern void Pool_release(Pool *pool, void *item);
+// releases every block at once, invalidating all items from this pool
+extern void Pool_free(Pool *pool);
+
 extern List* List_push(List **list, void *data);
 extern int List_remove(List **list, List *node);
 
@@ -18,4 +45,3 @@ extern void List_free(List *list);
  List_for_each(pos, list) {           \
    if((pos)->data == (value)) break;  \
  }
-
@@ -0,0 +1,115 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include "log.h"
+
+#define LOG_ENTRIES 256
+#define LOG_LINE 160
+
+typedef struct {
+  // position + 1 once the entry at position has been written
+  unsigned int seq;
+  char text[LOG_LINE];
+} LogEntry;
+
+// Multiple producers reserve entries by advancing head; the single consumer
+// (serialized by flushing) advances tail once an entry has been written out.
+static LogEntry entries[LOG_ENTRIES];
+static unsigned int head = 0;
+static unsigned int tail = 0;
+static unsigned int dropped = 0;
+static int flushing = 0;
+
+int nwm_log_level = NWM_LOG_INFO;
+
+static const char *level_names[NWM_LOG_LAST] = {
+  [NWM_LOG_ERROR] = "error",
+  [NWM_LOG_WARN] = "warn",
+  [NWM_LOG_INFO] = "info",
+  [NWM_LOG_DEBUG] = "debug",
+  [NWM_LOG_TRACE] = "trace"
+};
+
+void nwm_log_write(int level, const char *format, ...) {
+  unsigned int pos;
+  LogEntry *entry;
+  va_list args;
+
+  // reserve an entry, or drop the message if the consumer is a full buffer behind
+  do {
+    pos = __atomic_load_n(&head, __ATOMIC_RELAXED);
+    if(pos - __atomic_load_n(&tail, __ATOMIC_ACQUIRE) >= LOG_ENTRIES) {
+      __atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+      return;
+    }
+  } while(!__atomic_compare_exchange_n(&head, &pos, pos + 1, 0,
+            __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+
+  entry = &entries[pos % LOG_ENTRIES];
+  va_start(args, format);
+  vsnprintf(entry->text, LOG_LINE, format, args);
+  va_end(args);
+  __atomic_store_n(&entry->seq, pos + 1, __ATOMIC_RELEASE);
+}
+
+unsigned int nwm_log_flush() {
+  char buffer[4096];
+  size_t used = 0;
+  unsigned int pos, written = 0, lost;
+
+  if(__atomic_exchange_n(&flushing, 1, __ATOMIC_ACQUIRE)) {
+    return 0;
+  }
+  lost = __atomic_exchange_n(&dropped, 0, __ATOMIC_RELAXED);
+  if(lost) {
+    used = snprintf(buffer, sizeof buffer, "nwm: dropped %u log messages\n", lost);
+  }
+  pos = __atomic_load_n(&tail, __ATOMIC_RELAXED);
+  while(pos != __atomic_load_n(&head, __ATOMIC_ACQUIRE)) {
+    LogEntry *entry = &entries[pos % LOG_ENTRIES];
+    size_t len;
+    // reserved but not yet written
+    if(__atomic_load_n(&entry->seq, __ATOMIC_ACQUIRE) != pos + 1) {
+      break;
+    }
+    len = strlen(entry->text);
+    if(used + len + 1 > sizeof buffer) {
+      fwrite(buffer, 1, used, stderr);
+      used = 0;
+    }
+    memcpy(buffer + used, entry->text, len);
+    used += len;
+    // messages keep their own newlines, add one if missing
+    if(len == 0 || entry->text[len - 1] != '\n') {
+      buffer[used++] = '\n';
+    }
+    pos++;
+    written++;
+    __atomic_store_n(&tail, pos, __ATOMIC_RELEASE);
+  }
+  if(used) {
+    fwrite(buffer, 1, used, stderr);
+  }
+  __atomic_store_n(&flushing, 0, __ATOMIC_RELEASE);
+  return written;
+}
+
+void nwm_set_log_level(int level) {
+  if(level < NWM_LOG_ERROR) {
+    level = NWM_LOG_ERROR;
+  }
+  if(level > NWM_LOG_TRACE) {
+    level = NWM_LOG_TRACE;
+  }
+  nwm_log_level = level;
+}
+
+int nwm_log_level_lookup(const char *name) {
+  int i;
+  for(i = 0; i < NWM_LOG_LAST; i++) {
+    if(strcmp(name, level_names[i]) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
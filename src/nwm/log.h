@@ -0,0 +1,37 @@
+// Level-gated logging into an in-memory ring buffer.
+//
+// Log sites above NWM_LOG_MAX_LEVEL compile to nothing; the others cost one
+// compare against the runtime level when disabled. Enabled messages are
+// formatted into a lock-free ring buffer and written out by nwm_log_flush(),
+// which nwm_loop() calls once per batch of events rather than per message.
+
+enum log_level {
+  NWM_LOG_ERROR,
+  NWM_LOG_WARN,
+  NWM_LOG_INFO,
+  NWM_LOG_DEBUG,
+  NWM_LOG_TRACE,
+  NWM_LOG_LAST
+};
+
+// compile-time ceiling, e.g. -DNWM_LOG_MAX_LEVEL=NWM_LOG_TRACE
+#ifndef NWM_LOG_MAX_LEVEL
+#define NWM_LOG_MAX_LEVEL NWM_LOG_DEBUG
+#endif
+
+extern int nwm_log_level;
+
+#define nwm_log(level, ...) \
+  do { \
+    if((level) <= NWM_LOG_MAX_LEVEL && (level) <= nwm_log_level) \
+      nwm_log_write((level), __VA_ARGS__); \
+  } while(0)
+
+extern void nwm_log_write(int level, const char *format, ...);
+
+// write out all buffered messages to stderr; returns the number written
+extern unsigned int nwm_log_flush();
+
+extern void nwm_set_log_level(int level);
+// returns the level with the given name (e.g. "debug"), or -1
+extern int nwm_log_level_lookup(const char *name);
@@ -1,3 +1,4 @@
+#define _POSIX_C_SOURCE 200112L
 #include <errno.h>
 #include <locale.h>
 #include <stdarg.h>
@@ -5,6 +6,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/wait.h>
@@ -15,46 +17,107 @@
 #include <X11/Xproto.h>
 #include <X11/Xutil.h>
 #include <X11/extensions/Xinerama.h>
+#include <X11/extensions/Xrandr.h>
+#include <pthread.h>
 
 #include "list.h"
+#include "ring.h"
+#include "winset.h"
+#include "winstack.h"
+#include "track.h"
+#include "log.h"
+#include "fetch.h"
 #include "nwm.h"
+#include "stats.h"
+#include "session.h"
 
 // INTERNAL API
-static void nwm_scan_windows();
-static void nwm_add_window(Window win, XWindowAttributes *wa);
-static void nwm_update_window(Window win);
-static void nwm_remove_window(Window win, Bool destroyed);
+static void nwm_scan_windows(NodeWinMan *nwm);
+static void nwm_add_window(NodeWinMan *nwm, nwm_window_info *info);
+static void nwm_stack_window(NodeWinMan *nwm, Window win);
+static void nwm_raise_window(NodeWinMan *nwm, Window win);
+static void nwm_focus_next(NodeWinMan *nwm);
+static void nwm_adopt_window(NodeWinMan *nwm, nwm_window_info *info, Bool hidden, nwm_window *event_data, nwm_window_title *title_data);
+static void nwm_load_session(NodeWinMan *nwm);
+static void nwm_update_window(NodeWinMan *nwm, Window win, unsigned int flags);
+static void nwm_make_title(nwm_window_info *info, nwm_window_title *event_data);
+static void nwm_remove_window(NodeWinMan *nwm, Window win, Bool destroyed);
+static void nwm_track_begin(NodeWinMan *nwm, Window win);
+static void nwm_track_end(NodeWinMan *nwm);
+static void nwm_set_strut(NodeWinMan *nwm, Window win, const long *strut);
+static void nwm_update_strut(NodeWinMan *nwm, Window win);
+static void nwm_ewmh_changed(NodeWinMan *nwm, unsigned int flags);
+static void nwm_publish_ewmh(NodeWinMan *nwm);
+static int nwm_handle_error(Display *dpy, XErrorEvent *ee);
+
+static void nwm_scan_monitors(NodeWinMan *nwm);
+static void nwm_init_randr(NodeWinMan *nwm);
+void nwm_update_selected_monitor(NodeWinMan *nwm);
+
+static unsigned int nwm_fetch_flags_for(NodeWinMan *nwm, XEvent *e, Window *win);
+static nwm_window_info* nwm_prefetched(NodeWinMan *nwm, Window win, unsigned int flags);
+static void nwm_handle(NodeWinMan *nwm, XEvent *event, unsigned long read_time);
+
+static void nwm_emit(NodeWinMan *nwm, callback_map event, void *ev);
+static void nwm_emit_rearrange(NodeWinMan *nwm);
+static unsigned int nwm_coalesce(NodeWinMan *nwm, XEvent *events, unsigned int count);
+
+void nwm_grab_keys(NodeWinMan *nwm);
 
-static void nwm_scan_monitors();
-void nwm_add_monitor();
-void nwm_remove_monitor();
-void nwm_update_selected_monitor();
+// these go into a function dispach table indexed by the Xevent type
+static void event_buttonpress(NodeWinMan *nwm, XEvent *e);
+static void event_buttonrelease(NodeWinMan *nwm, XEvent *e);
+static void event_clientmessage(NodeWinMan *nwm, XEvent *e);
+static void event_configurerequest(NodeWinMan *nwm, XEvent *e);
+static void event_configurenotify(NodeWinMan *nwm, XEvent *e);
+static void event_destroynotify(NodeWinMan *nwm, XEvent *e);
+static void event_enternotify(NodeWinMan *nwm, XEvent *e);
+static void event_focusin(NodeWinMan *nwm, XEvent *e);
+static void event_focusout(NodeWinMan *nwm, XEvent *e);
+static void event_keypress(NodeWinMan *nwm, XEvent *e);
+static void event_mappingnotify(NodeWinMan *nwm, XEvent *e);
+static void event_mapnotify(NodeWinMan *nwm, XEvent *e);
+static void event_motionnotify(NodeWinMan *nwm, XEvent *e);
+static void event_maprequest(NodeWinMan *nwm, XEvent *e);
+static void event_propertynotify(NodeWinMan *nwm, XEvent *e);
+static void event_unmapnotify(NodeWinMan *nwm, XEvent *e);
+// RandR events have a type assigned at runtime, so they are dispatched separately
+static void event_randr(NodeWinMan *nwm, XEvent *e);
+
+static void nwm_drag_start(NodeWinMan *nwm, Window win, unsigned int button, int x_root, int y_root);
+static unsigned int nwm_clean_mask(NodeWinMan *nwm, unsigned int mask);
+void setclientstate(NodeWinMan *nwm, Window win, long state);
 
-static void nwm_emit(callback_map event, void *ev);
+static const char broken[] = "broken";
 
-void nwm_grab_keys();
+// cached text properties of a managed window (WinRecord.meta)
+struct WinMeta {
+  char title[NWM_TEXT_LEN];
+  char instance[NWM_TEXT_LEN];
+  char klass[NWM_TEXT_LEN];
+};
 
-// these go into a function dispach table indexed by the Xevent type
-static void event_buttonpress(XEvent *e);
-static void event_clientmessage(XEvent *e);
-static void event_configurerequest(XEvent *e);
-static void event_configurenotify(XEvent *e);
-static void event_destroynotify(XEvent *e);
-static void event_enternotify(XEvent *e);
-static void event_focusin(XEvent *e);
-static void event_focusout(XEvent *e);
-static void event_keypress(XEvent *e);
-static void event_maprequest(XEvent *e);
-static void event_propertynotify(XEvent *e);
-static void event_unmapnotify(XEvent *e);
-
-void GrabMouseRelease(Window id);
-void setclientstate(Window win, long state);
 
-static const char broken[] = "broken";
+// indexed by atom_map
+static char *atom_names[atomLast] = {
+  [WMProtocols] = "WM_PROTOCOLS",
+  [WMDelete] = "WM_DELETE_WINDOW",
+  [WMTakeFocus] = "WM_TAKE_FOCUS",
+  [NetWMName] = "_NET_WM_NAME",
+  [NetWMState] = "_NET_WM_STATE",
+  [NetWMFullscreen] = "_NET_WM_STATE_FULLSCREEN",
+  [WMState] = "WM_STATE",
+  [NetSupported] = "_NET_SUPPORTED",
+  [NetClientList] = "_NET_CLIENT_LIST",
+  [NetActiveWindow] = "_NET_ACTIVE_WINDOW",
+  [NetWorkarea] = "_NET_WORKAREA",
+  [NetWMStrutPartial] = "_NET_WM_STRUT_PARTIAL",
+  [NetWMStrut] = "_NET_WM_STRUT"
+};
 
-static void (*handler[LASTEvent]) (XEvent *) = {
+static void (*handler[LASTEvent]) (NodeWinMan *, XEvent *) = {
   [ButtonPress] = event_buttonpress,
+  [ButtonRelease] = event_buttonrelease,
   [ClientMessage] = event_clientmessage,
   [ConfigureRequest] = event_configurerequest,
   [ConfigureNotify] = event_configurenotify,
@@ -63,714 +126,2673 @@ static void (*handler[LASTEvent]) (XEvent *) = {
   [FocusIn] = event_focusin,
   [FocusOut] = event_focusout,
   [KeyPress] = event_keypress,
+  [MapNotify] = event_mapnotify,
   [MapRequest] = event_maprequest,
+  [MappingNotify] = event_mappingnotify,
+  [MotionNotify] = event_motionnotify,
   [PropertyNotify] = event_propertynotify,
   [UnmapNotify] = event_unmapnotify
 };
 
 // NWM DATA
+#define EVENT_BATCH_SIZE 256
+// events the reader thread can get ahead of the main thread
+#define EVENT_RING_SIZE 1024
+// what a MapRequest handler reads about the window
+#define FETCH_MAP (FetchAttributes|FetchTransient|FetchTitle|FetchClass|FetchProtocols|FetchStrut)
+#define CONFIGURE_RULES_MAX 16
+#define MONITORS_MAX 16
+// time between two steps of an interactive drag, in usec, when the refresh
+// rate is not known (see nwm_frame_usec)
+#define DRAG_INTERVAL 16667
+#define COLOR_NAME_LEN 32
+#define COLOR_CACHE_SIZE 16
+// windows reserving space at the screen edges (panels, docks)
+#define STRUTS_MAX 16
+
+typedef struct {
+  char name[COLOR_NAME_LEN];
+  unsigned long pixel;
+} ColorCacheEntry;
+
+// a monitor, as reported to Node
+typedef struct {
+  // the RandR output shown on it, or the Xinerama screen number without RandR
+  XID key;
+  // the RandR CRTC showing the output, None without RandR
+  XID crtc;
+  // the id Node knows the monitor by: kept while the monitor exists,
+  // and the lowest free one for a new monitor
+  int id;
+  int x, y, width, height;
+  // the geometry minus the struts on the monitor's edges
+  int wa_x, wa_y, wa_width, wa_height;
+  // needs a new layout, reported by the next rearrange
+  Bool dirty;
+} MonitorRecord;
+
+static void nwm_rearrange(NodeWinMan *nwm, MonitorRecord *record);
+static MonitorRecord* nwm_monitor_at(NodeWinMan *nwm, int x, int y);
+
+// an event read by the reader thread, with what it fetched for the handler
 typedef struct {
+  XEvent event;
+  unsigned long time;
+  // fetch_flags of info, 0 if nothing was fetched
+  unsigned int fetched;
+  nwm_window_info info;
+} EventRecord;
+
+// per-class configure request policy
+typedef struct {
+  char klass[NWM_TEXT_LEN];
+  configure_policy policy;
+} ConfigureRule;
+
+// an interactive drag in progress, see nwm_drag_start; win is 0 if none
+typedef struct {
+  Window win;
+  unsigned int button;
+  Cursor cursor;
+  // where the pointer and the window started
+  int x_root, y_root;
+  int start_x, start_y, start_width, start_height;
+  // where the window is dragged to; pending if not applied yet
+  int x, y, width, height;
+  Bool pending;
+  // when the last step was applied (usec, nwm_stats_now)
+  unsigned long last;
+} DragState;
+
+// the _NET_WM_STRUT_PARTIAL of a window, managed or not
+typedef struct {
+  Window id;
+  long strut[StrutLast];
+} StrutRecord;
+
+// root window properties that are behind, see nwm_ewmh_changed
+enum ewmh_property {
+  EwmhClientList = 1,
+  EwmhActiveWindow = 2,
+  EwmhWorkarea = 4
+};
+
+struct NodeWinMan {
   Display *dpy;
   int screen;
   GC gc;
   Window root;
   Window selected;
   Window last_entered;
-  // The number of monitors is sufficient to tell if a monitor has been removed or added.
+  // the pointer as of the last EnterNotify reported to Node, which picks the
+  // monitor new windows go on from it
+  int pointer_x, pointer_y;
+  // known monitors, so that only the ones that changed are reported
+  MonitorRecord monitors[MONITORS_MAX];
   unsigned int total_monitors;
-  // The only thing we care about is whether we have seen a monitor or not
-  List *windows;
+  // RandR 1.3 or later is available; its events start at randr_event_base
+  Bool randr;
+  int randr_event_base;
+  // managed windows, keyed by window id
+  WinSet windows;
+  // and their stacking order, bottom to top
+  WinStack stacking;
+  // managed windows in the order they were focused, the latest on top
+  WinStack focus_history;
+  // and in the order they were mapped, for _NET_CLIENT_LIST
+  WinStack clients;
+  // the windows that set a strut
+  StrutRecord struts[STRUTS_MAX];
+  unsigned int total_struts;
+  // ewmh_property flags of the root window properties to rewrite; they are
+  // written at the end of the batch, and only once nwm_init has adopted the
+  // existing windows
+  unsigned int ewmh_dirty;
+  Bool ewmh_ready;
   // grabbed keys
   List *keys;
+  // storage for the Key records in keys
+  Pool key_pool;
+  // keys by keycode, chained through Key.next
+  Key *key_table[256];
+  // storage for the WinMeta records of managed windows
+  Pool meta_pool;
   // colors
-  char normal_bg[8];
-  char active_bg[8];
+  char normal_bg[COLOR_NAME_LEN];
+  char active_bg[COLOR_NAME_LEN];
+  // border pixels, resolved from the color names at init
+  unsigned long normal_pixel;
+  unsigned long active_pixel;
+  // allocated colors, so that each color name costs one round trip at most
+  ColorCacheEntry colors[COLOR_CACHE_SIZE];
+  unsigned int total_colors;
+  unsigned int next_color;
   // border width
   int border_width;
   // screen dimensions
   int screen_width, screen_height;
   // num lock mask
   unsigned int numlockmask;
-  // callback
-  void (*emit_func)(callback_map event, void *ev);
-} NodeWinMan;
+  // modifier for moving and resizing windows with the mouse, 0 if disabled
+  unsigned int drag_modifier;
+  DragState drag;
+  // the frame time of the fastest monitor (usec), which a drag steps at; 0
+  // until nwm_frame_usec has found it since the last RandR change
+  unsigned long frame_usec;
+  // configure request policy, by kind of window and by class
+  configure_policy configure_unmanaged, configure_floating, configure_tiled;
+  ConfigureRule configure_rules[CONFIGURE_RULES_MAX];
+  unsigned int total_configure_rules;
+  // interned atoms, indexed by atom_map
+  Atom atoms[atomLast];
+  nwm_fetch_atoms fetch_atoms;
+  // focus managed windows natively when the pointer enters them
+  Bool focus_follows_mouse;
+  // callback, and what the embedder keeps with the instance
+  void (*emit_func)(NodeWinMan *nwm, callback_map event, void *ev);
+  void *data;
+  // events drained from the queue in one nwm_loop pass, and when each was read
+  XEvent batch[EVENT_BATCH_SIZE];
+  unsigned long batch_time[EVENT_BATCH_SIZE];
+  // threaded mode: a reader thread runs XNextEvent and the fetches the handlers
+  // need, and passes the results through ring; wake tells the main thread
+  Bool threaded;
+  Ring ring;
+  pthread_t reader;
+  // reader is running; reader_stop tells it to exit, see nwm_stop_reader
+  Bool reader_running;
+  Bool reader_stop;
+  // requests sent by the main thread that waited for their reply, i.e. the
+  // round trips the handlers (and the JS they call) made; see nwm_stats
+  unsigned long round_trips;
+  // what this instance records, in local_stats unless shared (nwm_share_stats)
+  nwm_stats *stats;
+  nwm_stats local_stats;
+  void (*wake)(NodeWinMan *nwm);
+  // signalled by the main thread when it has taken events off the ring, for
+  // the reader thread to wait on while the ring is full
+  pthread_mutex_t ring_lock;
+  pthread_cond_t ring_space;
+  // what was fetched for each event of the batch (threaded mode only)
+  unsigned int batch_fetched[EVENT_BATCH_SIZE];
+  nwm_window_info batch_info[EVENT_BATCH_SIZE];
+  // the fetched info for the event being handled, if any
+  unsigned int prefetch_flags;
+  nwm_window_info *prefetch;
+  // while dispatching a batch, rearranges are deferred to the end of it
+  Bool in_batch;
+  Bool rearrange_pending;
+  // the focused window was removed in the batch; the next one is focused at the end of it
+  Bool refocus_pending;
+  // a RandR change in the batch needs a full monitor scan at the end of it
+  Bool monitors_pending;
+  // hot restart: the snapshot the managed windows are saved in, whether it is
+  // behind, and the JS state the previous instance saved (or NULL)
+  nwm_session *session;
+  Bool session_dirty;
+  char *session_state;
+  nwm_counters counters;
+  // requests about client windows whose errors may still arrive, see nwm_track_begin
+  RequestTrack track;
+  // next in instances
+  NodeWinMan *next;
+};
 
-static NodeWinMan nwm;
+// XInitThreads was called, before any display was opened
+static Bool threads_ready = False;
+
+// every initialized instance, so that the process-wide error handler can
+// find the one an error belongs to
+static NodeWinMan *instances = NULL;
 
 #include "x11_misc.c"
 
-int nwm_init() {
+int nwm_init_threads() {
+  if(!threads_ready && instances) {
+    return -1; // too late, a display is already open
+  }
+  if(!threads_ready && !XInitThreads()) {
+    return -1;
+  }
+  threads_ready = True;
+  return 0;
+}
+
+NodeWinMan* nwm_new() {
+  // everything not set in nwm_init starts out zeroed
+  NodeWinMan *nwm = calloc(1, sizeof(NodeWinMan));
+  if(nwm) {
+    nwm->stats = &nwm->local_stats;
+    nwm_stats_reset(nwm->stats);
+  }
+  return nwm;
+}
+
+void nwm_free(NodeWinMan *nwm) {
+  NodeWinMan **p;
+  // the reader thread is blocked on the connection, and its errors still
+  // need to find the instance
+  nwm_stop_reader(nwm);
+  for(p = &instances; *p; p = &(*p)->next) {
+    if(*p == nwm) {
+      *p = nwm->next;
+      break;
+    }
+  }
+  if(nwm->dpy) {
+    XCloseDisplay(nwm->dpy);
+  }
+  if(nwm->session) {
+    nwm_session_close(nwm->session);
+  }
+  WinSet_free(&nwm->windows);
+  WinStack_free(&nwm->stacking);
+  WinStack_free(&nwm->focus_history);
+  WinStack_free(&nwm->clients);
+  RequestTrack_free(&nwm->track);
+  free(nwm->session_state);
+  if(nwm->stats != &nwm->local_stats) {
+    nwm_stats_unshare(nwm->stats);
+  }
+  free(nwm);
+}
+
+nwm_stats* nwm_get_stats(NodeWinMan *nwm) {
+  return nwm->stats;
+}
+
+int nwm_share_stats(NodeWinMan *nwm, const char *path) {
+  nwm_stats *shared = nwm_stats_share(nwm->stats, path);
+  if(!shared) {
+    return -1;
+  }
+  if(nwm->stats != &nwm->local_stats) {
+    nwm_stats_unshare(nwm->stats);
+  }
+  nwm->stats = shared;
+  return 0;
+}
+
+void nwm_set_data(NodeWinMan *nwm, void *data) {
+  nwm->data = data;
+}
+
+void* nwm_get_data(NodeWinMan *nwm) {
+  return nwm->data;
+}
+
+int nwm_init(NodeWinMan *nwm, const char *display) {
   XSetWindowAttributes wa;
+  Atom supported[8];
 
   // defaults
-  nwm.border_width = 1;
-  strcpy(nwm.active_bg, "#7DAA1C");
-  strcpy(nwm.normal_bg, "#666666");
-  nwm.total_monitors = 0;
-  nwm.windows = NULL;
-  // note: keys are not initialized here, since they are set before init()
-  nwm.numlockmask = 0;
-
-  // open the display
-  if ( ( nwm.dpy = XOpenDisplay(NULL) ) == NULL ) {
-    fprintf( stderr, "cannot connect to X server %s\n", XDisplayName(NULL));
+  nwm->border_width = 1;
+  // note: colors may have been set before init()
+  if(!nwm->active_bg[0]) {
+    strcpy(nwm->active_bg, "#7DAA1C");
+  }
+  if(!nwm->normal_bg[0]) {
+    strcpy(nwm->normal_bg, "#666666");
+  }
+  nwm->total_colors = 0;
+  nwm->next_color = 0;
+  nwm->total_monitors = 0;
+  // the reader thread and the main thread share the connection
+  if(nwm->threaded && !threads_ready) {
+    nwm_log(NWM_LOG_WARN, "nwm_init_threads was not called, not using a reader thread\n");
+    nwm->threaded = False;
+  }
+  // open the display; other displays of this process keep running without it
+  if ( ( nwm->dpy = XOpenDisplay(display) ) == NULL ) {
+    nwm_log(NWM_LOG_ERROR, "Cannot connect to X server %s\n", XDisplayName(display));
+    nwm_log_flush();
+    return -1;
+  }
+  if(WinSet_init(&nwm->windows, 64) != 0 || WinStack_init(&nwm->stacking, 64) != 0
+  || WinStack_init(&nwm->focus_history, 64) != 0 || WinStack_init(&nwm->clients, 64) != 0
+  || RequestTrack_init(&nwm->track, 64) != 0) {
+    fprintf( stderr, "fatal: could not allocate the window set\n");
     exit( -1 );
   }
+  // note: keys are not initialized here, since they are set before init()
+  nwm->numlockmask = 0;
+
+  nwm->next = instances;
+  instances = nwm;
   // set error handler
   XSetErrorHandler(xerror);
-  XSync(nwm.dpy, False);
+  XSync(nwm->dpy, False);
+
+  // intern all the atoms we use in a single round trip
+  XInternAtoms(nwm->dpy, atom_names, atomLast, False, nwm->atoms);
+  nwm->fetch_atoms.net_wm_name = nwm->atoms[NetWMName];
+  nwm->fetch_atoms.wm_protocols = nwm->atoms[WMProtocols];
+  nwm->fetch_atoms.wm_delete_window = nwm->atoms[WMDelete];
+  nwm->fetch_atoms.wm_take_focus = nwm->atoms[WMTakeFocus];
+  nwm->fetch_atoms.wm_state = nwm->atoms[WMState];
+  nwm->fetch_atoms.net_wm_strut_partial = nwm->atoms[NetWMStrutPartial];
+  nwm->fetch_atoms.net_wm_strut = nwm->atoms[NetWMStrut];
+
+  // resolve the border colors once, rather than on every focus change
+  nwm->normal_pixel = getcolor(nwm, nwm->normal_bg);
+  nwm->active_pixel = getcolor(nwm, nwm->active_bg);
 
   // take the default screen
-  nwm.screen = DefaultScreen(nwm.dpy);
+  nwm->screen = DefaultScreen(nwm->dpy);
   // get the root window and screen geometry
-  nwm.root = RootWindow(nwm.dpy, nwm.screen);
-  nwm.screen_width = DisplayWidth(nwm.dpy, nwm.screen);
-  nwm.screen_height = DisplayHeight(nwm.dpy, nwm.screen);
-  // update monitor geometry (and create nwm.monitor)
-  nwm_scan_monitors();
+  nwm->root = RootWindow(nwm->dpy, nwm->screen);
+  nwm->screen_width = DisplayWidth(nwm->dpy, nwm->screen);
+  nwm->screen_height = DisplayHeight(nwm->dpy, nwm->screen);
+  // find the monitors, and watch for changes through RandR where available
+  nwm_init_randr(nwm);
+  nwm_scan_monitors(nwm);
 
   // subscribe to root window events e.g. SubstructureRedirectMask
   wa.event_mask = SubstructureRedirectMask|SubstructureNotifyMask|ButtonPressMask
                   |EnterWindowMask|LeaveWindowMask|StructureNotifyMask
                   |PropertyChangeMask;
-  XSelectInput(nwm.dpy, nwm.root, wa.event_mask);
-  nwm_grab_keys();
+  XSelectInput(nwm->dpy, nwm->root, wa.event_mask);
+  nwm_grab_keys(nwm);
+
+  nwm_load_session(nwm);
+  nwm_scan_windows(nwm);
+
+  // what nwm maintains on the root window, written once for all the adopted windows
+  supported[0] = nwm->atoms[NetWMName];
+  supported[1] = nwm->atoms[NetWMState];
+  supported[2] = nwm->atoms[NetWMFullscreen];
+  supported[3] = nwm->atoms[NetClientList];
+  supported[4] = nwm->atoms[NetActiveWindow];
+  supported[5] = nwm->atoms[NetWorkarea];
+  supported[6] = nwm->atoms[NetWMStrutPartial];
+  supported[7] = nwm->atoms[NetWMStrut];
+  XChangeProperty(nwm->dpy, nwm->root, nwm->atoms[NetSupported], XA_ATOM, 32, PropModeReplace,
+      (unsigned char *) supported, 8);
+  nwm->ewmh_ready = True;
+  nwm_ewmh_changed(nwm, EwmhClientList|EwmhActiveWindow|EwmhWorkarea);
+
+  // emit a rearrange of every monitor
+  nwm_rearrange(nwm, NULL);
+  XSync(nwm->dpy, False);
+  nwm->stats->adopt_done = 1;
+  // from here on the snapshot describes this instance
+  nwm->session_dirty = True;
+  nwm_flush_session(nwm);
+  nwm_log_flush();
+  // return the connection number so the node binding can use it with libev.
+  return XConnectionNumber(nwm->dpy);
+}
 
-  nwm_scan_windows();
+// fills in what the FetchAll probe would have read from a saved window record
+static void nwm_restore_info(NodeWinMan *nwm, nwm_window_info *info, nwm_session_window *saved) {
+  info->transient_for = saved->transient_for;
+  strcpy(info->title, saved->title);
+  strcpy(info->instance, saved->instance);
+  strcpy(info->klass, saved->klass);
+  info->protocols = saved->protocols;
+  info->state = (saved->hidden ? IconicState : NormalState);
+  // put it back where it was laid out; adopting applies this for all windows at once
+  info->wa.x = saved->x;
+  info->wa.y = saved->y;
+  info->wa.width = saved->width - nwm->border_width * 2;
+  info->wa.height = saved->height - nwm->border_width * 2;
+}
 
-  // emit a rearrange
-  nwm_emit(onRearrange, NULL);
-  XSync(nwm.dpy, False);
-  // return the connection number so the node binding can use it with libev.
-  return XConnectionNumber(nwm.dpy);
+// adopts a window found by the startup scan into the adoptWindows payload
+static void nwm_adopt_scanned(NodeWinMan *nwm, nwm_window_info *info, nwm_session *session, nwm_adopt *adopt) {
+  nwm_session_window *saved = (session ? nwm_session_find(session, info->id) : NULL);
+  // without a snapshot, hidden windows are shown again and JS lays them out anew
+  Bool hidden = (saved && saved->hidden && info->wa.map_state != IsViewable);
+  nwm_adopt_window(nwm, info, hidden, &adopt->windows[adopt->count], &adopt->titles[adopt->count]);
+  adopt->count++;
+  if(saved && saved->fullscreen) {
+    WinSet_get(&nwm->windows, info->id)->fullscreen = True;
+  }
 }
 
-static void nwm_scan_windows() {
-  unsigned int i, num;
-  Window d1, d2, *wins = NULL;
-  XWindowAttributes watt;
+// Adopts the windows that already exist when nwm starts (e.g. after a restart)
+// in a single pass: one pipelined fetch for every child, buffered configure
+// requests and one adoptWindows event instead of an add/update pair per window.
+// Windows in a valid session snapshot only have their attributes read; the
+// rest, including their geometry and whether they were hidden, comes from it.
+static void nwm_scan_windows(NodeWinMan *nwm) {
+  unsigned int i, j, num, restored = 0, normal = 0, transient = 0;
+  unsigned long start = nwm_stats_now();
+  Window d1, d2, *wins = NULL, *ids;
+  nwm_window_info *infos, **order;
+  nwm_session *session = (nwm->session && nwm_session_valid(nwm->session, nwm->root) ? nwm->session : NULL);
+  nwm_adopt adopt;
   // XQueryTree() function returns the root ID, the parent window ID, a pointer to
   // the list of children windows (NULL when there are no children), and
   // the number of children in the list for the specified window.
-  if(XQueryTree(nwm.dpy, nwm.root, &d1, &d2, &wins, &num)) {
-    for(i = 0; i < num; i++) {
-      // if we can't read the window attributes,
-      // or the window is a popup (transient or override_redirect), skip it
-      if(!XGetWindowAttributes(nwm.dpy, wins[i], &watt)
-      || watt.override_redirect || XGetTransientForHint(nwm.dpy, wins[i], &d1)) {
-        continue;
-      }
-      // visible or minimized window ("Iconic state")
-      if(watt.map_state == IsViewable )//|| getstate(wins[i]) == IconicState)
-        nwm_add_window(wins[i], &watt);
-    }
-    for(i = 0; i < num; i++) { /* now the transients */
-      if(!XGetWindowAttributes(nwm.dpy, wins[i], &watt))
-        continue;
-      if(XGetTransientForHint(nwm.dpy, wins[i], &d1)
-      && (watt.map_state == IsViewable )) //|| getstate(wins[i]) == IconicState))
-        nwm_add_window(wins[i], &watt);
-    }
+  if(!XQueryTree(nwm->dpy, nwm->root, &d1, &d2, &wins, &num)) {
+    return;
+  }
+  if(!num) {
     if(wins) {
       XFree(wins);
     }
+    return;
+  }
+  ids = malloc(num * sizeof(Window));
+  infos = malloc(num * sizeof(nwm_window_info));
+  order = malloc(num * sizeof(nwm_window_info *));
+  adopt.windows = malloc(num * sizeof(nwm_window));
+  adopt.titles = malloc(num * sizeof(nwm_window_title));
+  if(!ids || !infos || !order || !adopt.windows || !adopt.titles) {
+    fprintf( stderr, "fatal: could not malloc() the window scan for %u windows\n", num);
+    exit( -1 );
+  }
+  // children that are in the snapshot go first, the ones that need probing after them
+  for(i = 0; i < num; i++) {
+    if(session && nwm_session_find(session, wins[i])) {
+      ids[restored++] = wins[i];
+    }
+  }
+  for(i = 0, j = restored; i < num; i++) {
+    if(!session || !nwm_session_find(session, wins[i])) {
+      ids[j++] = wins[i];
+    }
+  }
+  // fetch everything needed about every child up front (pipelined with NWM_XCB)
+  nwm->round_trips += nwm_fetch_windows(nwm->dpy, &nwm->fetch_atoms, ids, restored, FetchAttributes|FetchStrut, infos);
+  nwm->round_trips += nwm_fetch_windows(nwm->dpy, &nwm->fetch_atoms, ids + restored, num - restored,
+      FetchAll, infos + restored);
+  for(i = 0; i < restored; i++) {
+    if(infos[i].ok) {
+      nwm_restore_info(nwm, &infos[i], nwm_session_find(session, ids[i]));
+    }
+  }
+  // normal windows fill order from the front, transients from the back, so
+  // transients are adopted after the windows they belong to
+  for(i = 0; i < num; i++) {
+    // panels are usually override_redirect, but their struts still count
+    if(infos[i].ok && infos[i].wa.map_state == IsViewable) {
+      nwm_set_strut(nwm, infos[i].id, infos[i].strut);
+    }
+    // skip windows we can't read, override_redirect popups and hidden windows,
+    // but not the ones hidden by nwm_switch_workspace before a restart
+    if(!infos[i].ok || infos[i].wa.override_redirect
+    || (infos[i].wa.map_state != IsViewable && infos[i].state != IconicState)) {
+      continue;
+    }
+    if(infos[i].transient_for == None) {
+      order[normal++] = &infos[i];
+    } else {
+      order[num - ++transient] = &infos[i];
+    }
   }
+  adopt.count = 0;
+  for(i = 0; i < normal; i++) {
+    nwm_adopt_scanned(nwm, order[i], session, &adopt);
+  }
+  for(i = num - 1; transient > 0; i--, transient--) {
+    nwm_adopt_scanned(nwm, order[i], session, &adopt);
+  }
+  // XQueryTree lists the children bottom to top, so this is the stacking order
+  WinStack_clear(&nwm->stacking);
+  for(i = 0; i < num; i++) {
+    if(WinSet_get(&nwm->windows, wins[i])) {
+      nwm_stack_window(nwm, wins[i]);
+    }
+  }
+  if(adopt.count > 0) {
+    nwm_emit(nwm, onAdoptWindows, (void *)&adopt);
+  }
+  XFlush(nwm->dpy);
+
+  nwm->counters.adopted = adopt.count;
+  nwm->counters.adopt_usec = nwm_stats_now() - start;
+  nwm->stats->adopted = nwm->counters.adopted;
+  nwm->stats->adopt_usec = nwm->counters.adopt_usec;
+  nwm_log(NWM_LOG_INFO, "Adopted %u of %u windows in %lu us (%u from the session snapshot)\n",
+      adopt.count, num, nwm->counters.adopt_usec, restored);
+  free(adopt.titles);
+  free(adopt.windows);
+  free(order);
+  free(infos);
+  free(ids);
+  XFree(wins);
 }
 
-void nwm_empty_keys() {
-  List *item = NULL;
-  // free the key structs
-  List_for_each(item, nwm.keys) {
-    free(item->data);
-  }
-  List_free(nwm.keys);
-  nwm.keys = NULL;
+void nwm_empty_keys(NodeWinMan *nwm) {
+  // free the list nodes and all the key structs at once
+  List_free(nwm->keys);
+  Pool_free(&nwm->key_pool);
+  nwm->keys = NULL;
+  memset(nwm->key_table, 0, sizeof(nwm->key_table));
 }
 
-void nwm_add_key(KeySym keysym, unsigned int mod) {
+void nwm_add_key(NodeWinMan *nwm, KeySym keysym, unsigned int mod, unsigned int id) {
   Key* curr;
-  if(!(curr = (Key*)calloc(1, sizeof(Key)))) {
+  // keys can be added before nwm_init()
+  if(!nwm->key_pool.size) {
+    Pool_init(&nwm->key_pool, sizeof(Key), 32);
+  }
+  if(!(curr = (Key*)Pool_alloc(&nwm->key_pool))) {
     fprintf( stderr, "fatal: could not malloc() %lu bytes\n", sizeof(Key));
     exit( -1 );
   }
+  memset(curr, 0, sizeof(Key));
   curr->keysym = keysym;
   curr->mod = mod;
-  List_push(&nwm.keys, (void*) curr);
-}
-
-void nwm_grab_keys() {
-  nwm.numlockmask = updatenumlockmask(nwm.dpy);
-  { // update numlockmask first!
-    unsigned int i;
-    unsigned int modifiers[] = { 0, LockMask, nwm.numlockmask, nwm.numlockmask|LockMask };
-    XUngrabKey(nwm.dpy, AnyKey, AnyModifier, nwm.root);
-
-    List *item = NULL;
-    List_for_each(item, nwm.keys) {
-      Key* curr = (Key *)item->data;
-      fprintf( stderr, "grab key -- key: %li modifier %d \n", curr->keysym, curr->mod);
-      // also grab the combinations of screen lock and num lock (as those should not matter)
-      for(i = 0; i < 4; i++) {
-        XGrabKey(nwm.dpy, XKeysymToKeycode(nwm.dpy, curr->keysym), curr->mod | modifiers[i], nwm.root, True, GrabModeAsync, GrabModeAsync);
+  curr->id = id;
+  if(!List_push(&nwm->keys, (void*) curr)) {
+    fprintf( stderr, "fatal: could not malloc() %lu bytes\n", sizeof(List));
+    exit( -1 );
+  }
+}
+
+// the modifiers a binding is matched on; lock and num lock should not matter
+static unsigned int nwm_clean_mask(NodeWinMan *nwm, unsigned int mask) {
+  return mask & ~(nwm->numlockmask|LockMask)
+      & (ShiftMask|ControlMask|Mod1Mask|Mod2Mask|Mod3Mask|Mod4Mask|Mod5Mask);
+}
+
+static void nwm_grab_key(NodeWinMan *nwm, KeyCode keycode, unsigned int mod, Bool grab) {
+  unsigned int i;
+  unsigned int modifiers[] = { 0, LockMask, nwm->numlockmask, nwm->numlockmask|LockMask };
+  // also grab the combinations of screen lock and num lock (as those should not matter)
+  for(i = 0; i < 4; i++) {
+    if(grab) {
+      XGrabKey(nwm->dpy, keycode, mod | modifiers[i], nwm->root, True, GrabModeAsync, GrabModeAsync);
+    } else {
+      XUngrabKey(nwm->dpy, keycode, mod | modifiers[i], nwm->root);
+    }
+  }
+}
+
+// resolves the keycode of key, adds it to the dispatch table and grabs it
+static void nwm_bind_key(NodeWinMan *nwm, Key *key) {
+  key->keycode = XKeysymToKeycode(nwm->dpy, key->keysym);
+  key->next = NULL;
+  if(!key->keycode) {
+    nwm_log(NWM_LOG_WARN, "No keycode for keysym %li\n", key->keysym);
+    return;
+  }
+  nwm_log(NWM_LOG_DEBUG, "grab key -- key: %li keycode %d modifier %d \n", key->keysym, key->keycode, key->mod);
+  key->next = nwm->key_table[key->keycode];
+  nwm->key_table[key->keycode] = key;
+  nwm_grab_key(nwm, key->keycode, key->mod, True);
+}
+
+// removes key from the dispatch table and releases its grab
+static void nwm_unbind_key(NodeWinMan *nwm, Key *key) {
+  Key **link, *other;
+  if(!key->keycode) {
+    return;
+  }
+  for(link = &nwm->key_table[key->keycode]; *link; link = &(*link)->next) {
+    if(*link == key) {
+      *link = key->next;
+      break;
+    }
+  }
+  nwm_grab_key(nwm, key->keycode, key->mod, False);
+  // another binding may share the grab
+  for(other = nwm->key_table[key->keycode]; other; other = other->next) {
+    if(other->mod == key->mod) {
+      nwm_grab_key(nwm, other->keycode, other->mod, True);
+    }
+  }
+  key->keycode = 0;
+  key->next = NULL;
+}
+
+// returns the binding for a keycode and modifier state, or NULL; if several
+// bindings match, the one added first (lowest id) wins
+static Key* nwm_find_key(NodeWinMan *nwm, unsigned int keycode, unsigned int state) {
+  Key *key, *found = NULL;
+  unsigned int mod = nwm_clean_mask(nwm, state);
+  if(keycode > 255) {
+    return NULL;
+  }
+  for(key = nwm->key_table[keycode]; key; key = key->next) {
+    if(nwm_clean_mask(nwm, key->mod) == mod && (!found || key->id < found->id)) {
+      found = key;
+    }
+  }
+  return found;
+}
+
+void nwm_grab_keys(NodeWinMan *nwm) {
+  List *item = NULL;
+  if(!nwm->dpy) {
+    return; // grabbed by nwm_init()
+  }
+  // update numlockmask first!
+  nwm->round_trips++;
+  nwm->numlockmask = updatenumlockmask(nwm->dpy);
+  XUngrabKey(nwm->dpy, AnyKey, AnyModifier, nwm->root);
+  memset(nwm->key_table, 0, sizeof(nwm->key_table));
+  List_for_each(item, nwm->keys) {
+    nwm_bind_key(nwm, (Key *)item->data);
+  }
+}
+
+Atom nwm_get_atom(NodeWinMan *nwm, atom_map atom) {
+  return nwm->atoms[atom];
+}
+
+const char* nwm_get_atom_name(atom_map atom) {
+  return atom_names[atom];
+}
+
+void nwm_set_emit_function(NodeWinMan *nwm, void (*callback)(NodeWinMan *nwm, callback_map event, void *ev)) {
+  nwm->emit_func = callback;
+}
+
+static void nwm_emit(NodeWinMan *nwm, callback_map event, void *ev) {
+  unsigned long start, elapsed;
+  nwm_log(NWM_LOG_TRACE, "nwm_emit called with payload %d.\n", event);
+  if(nwm->emit_func) {
+    start = nwm_stats_now();
+    nwm->emit_func(nwm, event, ev);
+    elapsed = nwm_stats_now() - start;
+    nwm_histogram_add(&nwm->stats->callback[event], elapsed);
+    if(event == onRearrange) {
+      nwm_histogram_add(&nwm->stats->rearrange, elapsed);
+    }
+  }
+}
+
+const char* nwm_get_event_name(int type) {
+  return (type >= 0 && type < LASTEvent ? event_names[type] : "");
+}
+
+// suggest a rearrange of the monitor (all monitors if NULL) to Node; inside
+// a batch, only one is emitted at the end, for every monitor marked in it
+static void nwm_rearrange(NodeWinMan *nwm, MonitorRecord *record) {
+  unsigned int i;
+  if(record) {
+    record->dirty = True;
+  } else {
+    for(i = 0; i < nwm->total_monitors; i++) {
+      nwm->monitors[i].dirty = True;
+    }
+  }
+  if(!nwm->in_batch) {
+    nwm_emit_rearrange(nwm);
+  } else if(nwm->rearrange_pending) {
+    nwm->counters.merged++;
+  } else {
+    nwm->rearrange_pending = True;
+  }
+}
+
+static void nwm_emit_rearrange(NodeWinMan *nwm) {
+  int ids[MONITORS_MAX];
+  nwm_rearrange_monitors event_data;
+  unsigned int i;
+
+  event_data.count = 0;
+  event_data.monitors = ids;
+  for(i = 0; i < nwm->total_monitors; i++) {
+    if(nwm->monitors[i].dirty) {
+      nwm->monitors[i].dirty = False;
+      ids[event_data.count++] = nwm->monitors[i].id;
+    }
+  }
+  if(event_data.count > 0) {
+    nwm_log(NWM_LOG_DEBUG, "* emit onRearrange of %u monitors\n", event_data.count);
+    nwm_emit(nwm, onRearrange, (void *)&event_data);
+  }
+}
+
+// marks root window properties (ewmh_property flags) as behind; inside a
+// batch, each is written once at the end of it
+static void nwm_ewmh_changed(NodeWinMan *nwm, unsigned int flags) {
+  nwm->ewmh_dirty |= flags;
+  if(!nwm->in_batch) {
+    nwm_publish_ewmh(nwm);
+  }
+}
+
+// writes the root window properties that are behind, one request each
+static void nwm_publish_ewmh(NodeWinMan *nwm) {
+  long workarea[4], x0, y0, x1, y1;
+  Window active;
+  unsigned int i;
+
+  if(!nwm->ewmh_ready || !nwm->ewmh_dirty) {
+    return;
+  }
+  if(nwm->ewmh_dirty & EwmhClientList) {
+    XChangeProperty(nwm->dpy, nwm->root, nwm->atoms[NetClientList], XA_WINDOW, 32, PropModeReplace,
+        (unsigned char *) nwm->clients.ids, nwm->clients.count);
+  }
+  if(nwm->ewmh_dirty & EwmhActiveWindow) {
+    active = (WinSet_get(&nwm->windows, nwm->selected) ? nwm->selected : None);
+    XChangeProperty(nwm->dpy, nwm->root, nwm->atoms[NetActiveWindow], XA_WINDOW, 32, PropModeReplace,
+        (unsigned char *) &active, 1);
+  }
+  if(nwm->ewmh_dirty & EwmhWorkarea) {
+    // there is a single desktop; its workarea is the bounding box of the
+    // monitors' workareas, as x, y, width, height
+    x0 = y0 = 0;
+    x1 = nwm->screen_width;
+    y1 = nwm->screen_height;
+    for(i = 0; i < nwm->total_monitors; i++) {
+      MonitorRecord *m = &nwm->monitors[i];
+      if(i == 0 || m->wa_x < x0)
+        x0 = m->wa_x;
+      if(i == 0 || m->wa_y < y0)
+        y0 = m->wa_y;
+      if(i == 0 || m->wa_x + m->wa_width > x1)
+        x1 = m->wa_x + m->wa_width;
+      if(i == 0 || m->wa_y + m->wa_height > y1)
+        y1 = m->wa_y + m->wa_height;
+    }
+    workarea[0] = x0;
+    workarea[1] = y0;
+    workarea[2] = x1 - x0;
+    workarea[3] = y1 - y0;
+    XChangeProperty(nwm->dpy, nwm->root, nwm->atoms[NetWorkarea], XA_CARDINAL, 32, PropModeReplace,
+        (unsigned char *) workarea, 4);
+  }
+  nwm->ewmh_dirty = 0;
+}
+
+// the monitor containing the point, or NULL
+static MonitorRecord* nwm_monitor_at(NodeWinMan *nwm, int x, int y) {
+  unsigned int i;
+  for(i = 0; i < nwm->total_monitors; i++) {
+    MonitorRecord *m = &nwm->monitors[i];
+    if(x >= m->x && x < m->x + m->width && y >= m->y && y < m->y + m->height) {
+      return m;
+    }
+  }
+  return NULL;
+}
+
+// Drops events that are superseded by a later event in the same batch:
+// only the last PropertyNotify per (window, atom) and the last EnterNotify
+// are kept, and ConfigureRequests for the same window are merged into the
+// last one. Dropped events get type 0. Returns the number of events dropped.
+static unsigned int nwm_coalesce(NodeWinMan *nwm, XEvent *events, unsigned int count) {
+  XPropertyEvent *properties[EVENT_BATCH_SIZE];
+  XConfigureRequestEvent *requests[EVENT_BATCH_SIZE];
+  unsigned int i, j, total_properties = 0, total_requests = 0, dropped = 0;
+  Bool seen_enter = False, seen_motion = False;
+
+  // walk backwards so that the first occurrence seen is the one to keep
+  for(i = count; i-- > 0; ) {
+    XEvent *e = &events[i];
+    switch(e->type) {
+      case EnterNotify:
+        if(seen_enter) {
+          e->type = 0;
+          dropped++;
+        }
+        seen_enter = True;
+        break;
+      case MotionNotify:
+        // a drag only needs the latest position
+        if(seen_motion) {
+          e->type = 0;
+          dropped++;
+        }
+        seen_motion = True;
+        break;
+      case PropertyNotify:
+        for(j = 0; j < total_properties; j++) {
+          if(properties[j]->window == e->xproperty.window && properties[j]->atom == e->xproperty.atom) {
+            break;
+          }
+        }
+        if(j < total_properties) {
+          e->type = 0;
+          dropped++;
+        } else {
+          properties[total_properties++] = &e->xproperty;
+        }
+        break;
+      case ConfigureRequest:
+        for(j = 0; j < total_requests; j++) {
+          if(requests[j]->window == e->xconfigurerequest.window) {
+            break;
+          }
+        }
+        if(j < total_requests) {
+          // the later request wins, but keeps the fields only this one set
+          XConfigureRequestEvent *later = requests[j], *ev = &e->xconfigurerequest;
+          unsigned long mask = ev->value_mask & ~later->value_mask;
+          if(mask & CWX)
+            later->x = ev->x;
+          if(mask & CWY)
+            later->y = ev->y;
+          if(mask & CWWidth)
+            later->width = ev->width;
+          if(mask & CWHeight)
+            later->height = ev->height;
+          if(mask & CWBorderWidth)
+            later->border_width = ev->border_width;
+          if(mask & CWSibling)
+            later->above = ev->above;
+          if(mask & CWStackMode)
+            later->detail = ev->detail;
+          later->value_mask |= mask;
+          e->type = 0;
+          nwm->counters.merged++;
+        } else {
+          requests[total_requests++] = &e->xconfigurerequest;
+        }
+        break;
+    }
+  }
+  return dropped;
+}
+
+// calls the handler of one event; read_time is when it was read off the connection
+static void nwm_handle(NodeWinMan *nwm, XEvent *event, unsigned long read_time) {
+  nwm_stats *stats = nwm->stats;
+  int type = event->type;
+  // extension events are recorded as GenericEvent
+  int slot = (type < LASTEvent ? type : GenericEvent);
+  void (*handle)(NodeWinMan *, XEvent *) = (type < LASTEvent ? handler[type] : NULL);
+  unsigned long request, trips;
+
+  if(nwm->randr && (type == nwm->randr_event_base + RRScreenChangeNotify
+  || type == nwm->randr_event_base + RRNotify)) {
+    handle = event_randr;
+  }
+  if(handle) {
+    request = NextRequest(nwm->dpy);
+    trips = nwm->round_trips;
+    handle(nwm, event); /* call handler */
+    stats->requests[slot] += NextRequest(nwm->dpy) - request;
+    stats->round_trips[slot] += nwm->round_trips - trips;
+  } else {
+    nwm_log(NWM_LOG_TRACE, "Did nothing with %s (%d)\n", nwm_get_event_name(type), type);
+  }
+  // from XNextEvent to the end of the handler
+  nwm_histogram_add(&stats->handler[slot], nwm_stats_now() - read_time);
+}
+
+// coalesces and handles the count events in nwm->batch
+static void nwm_dispatch(NodeWinMan *nwm, unsigned int count) {
+  unsigned int i;
+  nwm_stats *stats = nwm->stats;
+
+  nwm->counters.events += count;
+  nwm->counters.batches++;
+  nwm->counters.dropped += nwm_coalesce(nwm, nwm->batch, count);
+  stats->sequence++;
+  nwm_histogram_add(&stats->batch_size, count);
+
+  nwm->in_batch = True;
+  for(i = 0; i < count; i++) {
+    if(nwm->batch[i].type == 0) {
+      continue; // coalesced
+    }
+    if(nwm->threaded) {
+      nwm->prefetch_flags = nwm->batch_fetched[i];
+      nwm->prefetch = &nwm->batch_info[i];
+    }
+    nwm_handle(nwm, &nwm->batch[i], nwm->batch_time[i]);
+    nwm->prefetch_flags = 0;
+  }
+  nwm->in_batch = False;
+  if(nwm->monitors_pending) {
+    nwm->monitors_pending = False;
+    nwm_scan_monitors(nwm);
+  }
+  // unless something else was focused meanwhile
+  if(nwm->refocus_pending) {
+    nwm->refocus_pending = False;
+    if(!WinSet_get(&nwm->windows, nwm->selected)) {
+      nwm_focus_next(nwm);
+    }
+  }
+  if(nwm->rearrange_pending) {
+    nwm->rearrange_pending = False;
+    nwm_emit_rearrange(nwm);
+  }
+  nwm_publish_ewmh(nwm);
+  stats->sequence++;
+}
+
+void nwm_loop(NodeWinMan *nwm) {
+  unsigned int count;
+
+  // main event loop
+  while(XPending(nwm->dpy)) {
+    // drain everything that has already been read from the connection
+    count = 0;
+    do {
+      XNextEvent(nwm->dpy, &nwm->batch[count]);
+      nwm->batch_time[count++] = nwm_stats_now();
+    } while(count < EVENT_BATCH_SIZE && XQLength(nwm->dpy) > 0);
+    nwm_dispatch(nwm, count);
+  }
+  // write out whatever was logged while handling this batch
+  nwm_log_flush();
+}
+
+// the fetches the handler of e will make, and for which window; the reader
+// thread makes them ahead of time
+static unsigned int nwm_fetch_flags_for(NodeWinMan *nwm, XEvent *e, Window *win) {
+  XPropertyEvent *ev = &e->xproperty;
+  if(e->type == MapRequest) {
+    *win = e->xmaprequest.window;
+    return FETCH_MAP;
+  }
+  if(e->type == MapNotify && e->xmap.override_redirect) {
+    *win = e->xmap.window;
+    return FetchStrut; // panels that are not managed
+  }
+  if(e->type != PropertyNotify || ev->window == nwm->root) {
+    return 0;
+  }
+  *win = ev->window;
+  if(ev->atom == nwm->atoms[WMProtocols]) {
+    return FetchProtocols; // also when deleted
+  } else if(ev->atom == nwm->atoms[NetWMStrutPartial] || ev->atom == nwm->atoms[NetWMStrut]) {
+    return FetchStrut; // likewise
+  } else if(ev->state == PropertyDelete) {
+    return 0; // ignore property deletes
+  } else if(ev->atom == XA_WM_NAME || ev->atom == nwm->atoms[NetWMName]) {
+    return FetchTitle; // class and instance are cached
+  } else if(ev->atom == XA_WM_CLASS) {
+    return FetchClass;
+  }
+  return 0;
+}
+
+// what the reader thread fetched for the event being handled, if it covers flags for win
+static nwm_window_info* nwm_prefetched(NodeWinMan *nwm, Window win, unsigned int flags) {
+  if((nwm->prefetch_flags & flags) == flags && nwm->prefetch->id == win) {
+    return nwm->prefetch;
+  }
+  return NULL;
+}
+
+static void* nwm_reader(void *arg) {
+  NodeWinMan *nwm = arg;
+  EventRecord *record;
+  Window win = None;
+
+  while(1) {
+    if(!(record = Ring_reserve(&nwm->ring))) {
+      // the main thread is behind; the X server buffers the events meanwhile
+      pthread_mutex_lock(&nwm->ring_lock);
+      while(!(record = Ring_reserve(&nwm->ring)) && !__atomic_load_n(&nwm->reader_stop, __ATOMIC_ACQUIRE)) {
+        nwm->wake(nwm);
+        pthread_cond_wait(&nwm->ring_space, &nwm->ring_lock);
       }
+      pthread_mutex_unlock(&nwm->ring_lock);
+      if(!record) {
+        break;
+      }
+    }
+    XNextEvent(nwm->dpy, &record->event);
+    if(__atomic_load_n(&nwm->reader_stop, __ATOMIC_ACQUIRE)) {
+      break;
+    }
+    record->time = nwm_stats_now();
+    record->fetched = nwm_fetch_flags_for(nwm, &record->event, &win);
+    if(record->fetched) {
+      nwm_fetch_windows(nwm->dpy, &nwm->fetch_atoms, &win, 1, record->fetched, &record->info);
+    }
+    Ring_push(&nwm->ring);
+    // wake the main thread once everything read so far is in the ring
+    if(!XEventsQueued(nwm->dpy, QueuedAlready) || Ring_length(&nwm->ring) >= EVENT_BATCH_SIZE) {
+      nwm->wake(nwm);
     }
   }
+  return NULL;
+}
+
+void nwm_set_threaded(NodeWinMan *nwm, int enabled) {
+  nwm->threaded = enabled;
+}
+
+int nwm_start_reader(NodeWinMan *nwm, void (*wake)(NodeWinMan *nwm)) {
+  if(!nwm->threaded) {
+    return -1;
+  }
+  if(Ring_init(&nwm->ring, sizeof(EventRecord), EVENT_RING_SIZE) != 0) {
+    fprintf( stderr, "fatal: could not malloc() %lu bytes\n", EVENT_RING_SIZE * sizeof(EventRecord));
+    exit( -1 );
+  }
+  nwm->wake = wake;
+  pthread_mutex_init(&nwm->ring_lock, NULL);
+  pthread_cond_init(&nwm->ring_space, NULL);
+  // whatever is queued now is read by the reader thread from here on
+  XFlush(nwm->dpy);
+  if(pthread_create(&nwm->reader, NULL, nwm_reader, nwm) != 0) {
+    nwm_log(NWM_LOG_WARN, "Could not start the reader thread\n");
+    Ring_free(&nwm->ring);
+    nwm->threaded = False;
+    return -1;
+  }
+  nwm->reader_running = True;
+  nwm_log(NWM_LOG_INFO, "Reading X events on a separate thread\n");
+  return 0;
+}
+
+void nwm_stop_reader(NodeWinMan *nwm) {
+  XClientMessageEvent cm;
+  Window win;
+
+  if(!nwm->reader_running) {
+    return;
+  }
+  __atomic_store_n(&nwm->reader_stop, True, __ATOMIC_RELEASE);
+  // the reader either waits for room in the ring...
+  pthread_mutex_lock(&nwm->ring_lock);
+  pthread_cond_signal(&nwm->ring_space);
+  pthread_mutex_unlock(&nwm->ring_lock);
+  // ...or for an event, so send it one. An event sent with no mask goes to
+  // the client that created the window, hence a window of our own.
+  win = XCreateWindow(nwm->dpy, nwm->root, -1, -1, 1, 1, 0, CopyFromParent, InputOnly,
+      CopyFromParent, 0, NULL);
+  memset(&cm, 0, sizeof(cm));
+  cm.type = ClientMessage;
+  cm.window = win;
+  cm.format = 32;
+  XSendEvent(nwm->dpy, win, False, NoEventMask, (XEvent *) &cm);
+  XFlush(nwm->dpy);
+  pthread_join(nwm->reader, NULL);
+  XDestroyWindow(nwm->dpy, win);
+  XFlush(nwm->dpy);
+  Ring_free(&nwm->ring);
+  pthread_cond_destroy(&nwm->ring_space);
+  pthread_mutex_destroy(&nwm->ring_lock);
+  nwm->reader_running = False;
+  nwm->reader_stop = False;
+}
+
+// threaded mode: takes the oldest event off the ring, with what was fetched
+// for it; returns False if the ring is empty
+static Bool nwm_take_event(NodeWinMan *nwm, XEvent *event, unsigned long *time, unsigned int *fetched, nwm_window_info *info) {
+  EventRecord *record = Ring_peek(&nwm->ring);
+  if(!record) {
+    return False;
+  }
+  *event = record->event;
+  *time = record->time;
+  *fetched = record->fetched;
+  if(record->fetched) {
+    *info = record->info;
+  }
+  Ring_pop(&nwm->ring);
+  return True;
+}
+
+void nwm_drain(NodeWinMan *nwm) {
+  unsigned int count;
+
+  do {
+    count = 0;
+    while(count < EVENT_BATCH_SIZE && nwm_take_event(nwm, &nwm->batch[count], &nwm->batch_time[count],
+        &nwm->batch_fetched[count], &nwm->batch_info[count])) {
+      count++;
+    }
+    if(count > 0) {
+      // the reader may be waiting for the room just made
+      pthread_mutex_lock(&nwm->ring_lock);
+      pthread_cond_signal(&nwm->ring_space);
+      pthread_mutex_unlock(&nwm->ring_lock);
+      nwm_dispatch(nwm, count);
+    }
+  } while(count > 0);
+  // XNextEvent on the reader thread does not flush what the handlers sent
+  XFlush(nwm->dpy);
+  nwm_log_flush();
+}
+
+int nwm_set_session_file(NodeWinMan *nwm, const char *path) {
+  nwm_session *session = nwm_session_open(path);
+  if(!session) {
+    return -1;
+  }
+  if(nwm->session) {
+    nwm_session_close(nwm->session);
+  }
+  nwm->session = session;
+  return 0;
+}
+
+// keeps the JS state of the previous instance, before this one overwrites it
+static void nwm_load_session(NodeWinMan *nwm) {
+  unsigned long length;
+  if(!nwm->session || !nwm_session_valid(nwm->session, nwm->root) || !nwm->session->state_length) {
+    return;
+  }
+  length = nwm->session->state_length;
+  if(!(nwm->session_state = malloc(length + 1))) {
+    fprintf( stderr, "fatal: could not malloc() %lu bytes\n", length + 1);
+    exit( -1 );
+  }
+  memcpy(nwm->session_state, nwm->session->state, length);
+  nwm->session_state[length] = '\0';
+  nwm_log(NWM_LOG_INFO, "Restoring the session of %lu windows\n", nwm->session->count);
+}
+
+const char* nwm_get_session_state(NodeWinMan *nwm) {
+  return nwm->session_state;
+}
+
+void nwm_flush_session(NodeWinMan *nwm) {
+  unsigned int i;
+  WinRecord *record;
+  nwm_session_window *saved;
+
+  if(!nwm->session || !nwm->session_dirty || !nwm->dpy) {
+    return;
+  }
+  nwm->session_dirty = False;
+  nwm_session_begin(nwm->session, nwm->root);
+  nwm->session->count = 0;
+  WinSet_for_each(&nwm->windows, i) {
+    record = &nwm->windows.slots[i];
+    // the windows that do not fit are probed as usual after a restart
+    if(!record->meta || !(saved = nwm_session_append(nwm->session))) {
+      continue;
+    }
+    saved->id = record->id;
+    saved->transient_for = record->transient_for;
+    saved->x = record->x;
+    saved->y = record->y;
+    saved->width = record->width;
+    saved->height = record->height;
+    saved->isfloating = record->isfloating;
+    saved->fullscreen = record->fullscreen;
+    saved->hidden = record->hidden;
+    saved->protocols = record->protocols;
+    strcpy(saved->title, record->meta->title);
+    strcpy(saved->instance, record->meta->instance);
+    strcpy(saved->klass, record->meta->klass);
+  }
+  nwm_session_end(nwm->session);
+}
+
+int nwm_save_session(NodeWinMan *nwm, const char *state, unsigned long length) {
+  int result;
+  if(!nwm->session || !nwm->dpy) {
+    return -1;
+  }
+  nwm_session_begin(nwm->session, nwm->root);
+  result = nwm_session_set_state(nwm->session, state, length);
+  nwm_session_end(nwm->session);
+  nwm_flush_session(nwm);
+  return result;
+}
+
+void nwm_get_counters(NodeWinMan *nwm, nwm_counters *counters) {
+  *counters = nwm->counters;
+}
+
+void nwm_move_window(NodeWinMan *nwm, Window win, int x, int y) {
+//  fprintf( stderr, "MoveWindow: id=%li x=%d y=%d \n", win, x, y);
+  WinRecord *record = WinSet_get(&nwm->windows, win);
+  if(record) {
+    record->x = x;
+    record->y = y;
+    nwm->session_dirty = True;
+  }
+  XMoveWindow(nwm->dpy, win, x, y);
+  XFlush(nwm->dpy);
+}
+
+void nwm_resize_window(NodeWinMan *nwm, Window win, int width, int height) {
+//  fprintf( stderr, "ResizeWindow: id=%li width=%d height=%d \n", win, width, height);
+  WinRecord *record = WinSet_get(&nwm->windows, win);
+  if(record) {
+    record->width = width;
+    record->height = height;
+    record->border_width = nwm->border_width;
+    nwm->session_dirty = True;
+  }
+  XResizeWindow(nwm->dpy, win, width - nwm->border_width * 2, height - nwm->border_width * 2);
+  XFlush(nwm->dpy);
+}
+
+// the requests of nwm_apply_layout, without the flush
+static void nwm_configure_layout(NodeWinMan *nwm, nwm_geometry *geometry, unsigned int count) {
+  unsigned int i, mask;
+  XWindowChanges wc;
+
+  // also covers the visibility changes of nwm_switch_workspace
+  nwm->session_dirty = True;
+  for(i = 0; i < count; i++) {
+    nwm_geometry *g = &geometry[i];
+    WinRecord *record = WinSet_get(&nwm->windows, g->id);
+    int border = (g->border_width < 0 ? nwm->border_width : g->border_width);
+
+    if(record) {
+      // fill in unset fields, then only send what changed since the last apply
+      if(!(g->value_mask & CWX))
+        g->x = record->x;
+      if(!(g->value_mask & CWY))
+        g->y = record->y;
+      if(!(g->value_mask & CWWidth))
+        g->width = record->width;
+      if(!(g->value_mask & CWHeight))
+        g->height = record->height;
+      mask = (record->x != g->x ? CWX : 0)
+        | (record->y != g->y ? CWY : 0)
+        | (record->width != g->width || record->border_width != border ? CWWidth : 0)
+        | (record->height != g->height || record->border_width != border ? CWHeight : 0)
+        | (record->border_width != border ? CWBorderWidth : 0);
+      record->x = g->x;
+      record->y = g->y;
+      record->width = g->width;
+      record->height = g->height;
+      record->border_width = border;
+    } else {
+      mask = (g->value_mask & (CWX|CWY|CWWidth|CWHeight)) | CWBorderWidth;
+    }
+    wc.x = g->x;
+    wc.y = g->y;
+    wc.width = g->width - border * 2;
+    wc.height = g->height - border * 2;
+    wc.border_width = border;
+    if(((mask & CWWidth) && wc.width < 1) || ((mask & CWHeight) && wc.height < 1)) {
+      // X rejects empty windows
+      mask &= ~(CWWidth|CWHeight);
+    }
+    // restacking to where the window already is would only cause exposes
+    if(g->stack >= 0 && (!record || (g->stack != Above && g->stack != Below)
+    || WinStack_place(&nwm->stacking, g->id, None, g->stack))) {
+      wc.stack_mode = g->stack;
+      mask |= CWStackMode;
+    }
+    if(mask) {
+      nwm_track_begin(nwm, g->id);
+      XConfigureWindow(nwm->dpy, g->id, mask, &wc);
+      nwm_track_end(nwm);
+    }
+  }
+}
+
+void nwm_apply_layout(NodeWinMan *nwm, nwm_geometry *geometry, unsigned int count) {
+  unsigned long start = nwm_stats_now();
+  nwm_configure_layout(nwm, geometry, count);
+  XFlush(nwm->dpy);
+  nwm_histogram_add(&nwm->stats->apply_layout, nwm_stats_now() - start);
+}
+
+void nwm_switch_workspace(NodeWinMan *nwm, Window *hide, unsigned int hide_count,
+    Window *show, unsigned int show_count, nwm_geometry *geometry, unsigned int count) {
+  unsigned int i;
+  WinRecord *record;
+
+  // nothing is drawn until the whole switch has been processed
+  XGrabServer(nwm->dpy);
+  // the incoming windows are still unmapped, so this is not visible yet
+  nwm_configure_layout(nwm, geometry, count);
+  // map before unmapping, so the root window is not exposed in between
+  for(i = 0; i < show_count; i++) {
+    if((record = WinSet_get(&nwm->windows, show[i])) && record->hidden) {
+      record->hidden = False;
+      setclientstate(nwm, show[i], NormalState);
+      XMapWindow(nwm->dpy, show[i]);
+    }
+  }
+  for(i = 0; i < hide_count; i++) {
+    if((record = WinSet_get(&nwm->windows, hide[i])) && !record->hidden) {
+      record->hidden = True;
+      record->unmap_serial = NextRequest(nwm->dpy);
+      XUnmapWindow(nwm->dpy, hide[i]);
+      setclientstate(nwm, hide[i], IconicState);
+    }
+  }
+  XUngrabServer(nwm->dpy);
+  XFlush(nwm->dpy);
+  nwm_log(NWM_LOG_DEBUG, "Switched workspace: %u hidden, %u shown\n", hide_count, show_count);
+}
+
+// Repaints both borders and sets the input focus without waiting for any reply:
+// WM_TAKE_FOCUS support comes from the protocols cached in the window record.
+void nwm_focus_window(NodeWinMan *nwm, Window win){
+  WinRecord *record = WinSet_get(&nwm->windows, win);
+  nwm_log(NWM_LOG_DEBUG, "FocusWindow: id=%li\n", win);
+  // the previous window's border is reset here rather than on its FocusOut
+  if(nwm->selected != win && WinSet_get(&nwm->windows, nwm->selected)) {
+    XSetWindowBorder(nwm->dpy, nwm->selected, nwm->normal_pixel);
+  }
+  nwm_track_begin(nwm, win);
+  if(record) {
+    XSetWindowBorder(nwm->dpy, win, nwm->active_pixel);
+    // the history only picks the next window to focus; if it cannot grow, older entries are just missing
+    WinStack_push(&nwm->focus_history, win);
+  }
+  XSetInputFocus(nwm->dpy, win, RevertToPointerRoot, CurrentTime);
+  if(record && (record->protocols & ProtocolTakeFocus)) {
+    sendprotocol(nwm, nwm->dpy, win, nwm->atoms[WMTakeFocus]);
+  }
+  nwm_track_end(nwm);
+  // also, raise the window so that the bg is shown
+//  XRaiseWindow(nwm->dpy, win);
+  if(nwm->selected != win) {
+    nwm->selected = win;
+    nwm_ewmh_changed(nwm, EwmhActiveWindow);
+  }
+  XFlush(nwm->dpy);
+}
+
+// adds a managed window on top of the stacking list
+static void nwm_stack_window(NodeWinMan *nwm, Window win) {
+  if(WinStack_push(&nwm->stacking, win) != 0) {
+    fprintf( stderr, "fatal: could not grow the stacking list\n");
+    exit( -1 );
+  }
+}
+
+// raises a managed window unless it already is the topmost one
+static void nwm_raise_window(NodeWinMan *nwm, Window win) {
+  if(WinStack_place(&nwm->stacking, win, None, Above)) {
+    XRaiseWindow(nwm->dpy, win);
+  }
+}
+
+// Stacks the managed windows in ids (bottom to top) in that order relative
+// to each other, moving as few of them as possible. Other windows keep their place.
+void nwm_restack(NodeWinMan *nwm, Window *ids, unsigned int count) {
+  XWindowChanges wc;
+  WinStackChange *changes = malloc((count ? count : 1) * sizeof(WinStackChange));
+  int i, total;
+
+  if(!changes || (total = WinStack_restack(&nwm->stacking, ids, count, changes)) < 0) {
+    fprintf( stderr, "fatal: could not malloc() the restack of %u windows\n", count);
+    exit( -1 );
+  }
+  for(i = 0; i < total; i++) {
+    wc.sibling = changes[i].sibling;
+    wc.stack_mode = changes[i].stack_mode;
+    XConfigureWindow(nwm->dpy, changes[i].id, CWSibling|CWStackMode, &wc);
+  }
+  if(total > 0) {
+    XFlush(nwm->dpy);
+  }
+  nwm_log(NWM_LOG_DEBUG, "Restacked %u windows with %d changes\n", count, total);
+  free(changes);
 }
 
-void nwm_set_emit_function(void (*callback)(callback_map event, void *ev)) {
-  nwm.emit_func = callback;
+const Window* nwm_get_stacking(NodeWinMan *nwm, unsigned int *count) {
+  *count = nwm->stacking.count;
+  return nwm->stacking.ids;
 }
 
-static void nwm_emit(callback_map event, void *ev) {
-  fprintf(stderr, "nwm_emit called with payload %d.\n", event);
-  if(nwm.emit_func) {
-    nwm.emit_func(event, ev);
+// focuses the most recently focused window that is still shown, or the root window
+static void nwm_focus_next(NodeWinMan *nwm) {
+  WinRecord *record;
+  unsigned int i;
+
+  for(i = nwm->focus_history.count; i > 0; i--) {
+    record = WinSet_get(&nwm->windows, nwm->focus_history.ids[i - 1]);
+    if(record && !record->hidden) {
+      nwm_log(NWM_LOG_DEBUG, "Focusing the previous window %li\n", record->id);
+      nwm_focus_window(nwm, record->id);
+      return;
+    }
   }
+  nwm_log(NWM_LOG_DEBUG, "Focusing to root window\n");
+  nwm_focus_window(nwm, nwm->root);
 }
 
-void nwm_loop() {
-  XEvent event;
+void nwm_set_focus_follows_mouse(NodeWinMan *nwm, int enabled) {
+  nwm->focus_follows_mouse = enabled;
+}
 
-  // main event loop
-  while(XPending(nwm.dpy)) {
-    XNextEvent(nwm.dpy, &event);
-    if(handler[event.type]) {
-      handler[event.type](&event); /* call handler */
-    } else {
-      fprintf(stderr, "Did nothing with %s (%d)\n", event_names[event.type], event.type);
-    }
+int nwm_set_border_colors(NodeWinMan *nwm, const char *normal, const char *active) {
+  unsigned long normal_pixel, active_pixel;
+  unsigned int i;
+
+  if(strlen(normal) >= COLOR_NAME_LEN || strlen(active) >= COLOR_NAME_LEN) {
+    return -1;
+  }
+  // before init, just remember the names
+  if(!nwm->dpy) {
+    strcpy(nwm->normal_bg, normal);
+    strcpy(nwm->active_bg, active);
+    return 0;
   }
+  if(!lookupcolor(nwm, normal, &normal_pixel) || !lookupcolor(nwm, active, &active_pixel)) {
+    nwm_log(NWM_LOG_WARN, "cannot allocate border colors '%s', '%s'\n", normal, active);
+    return -1;
+  }
+  strcpy(nwm->normal_bg, normal);
+  strcpy(nwm->active_bg, active);
+  nwm->normal_pixel = normal_pixel;
+  nwm->active_pixel = active_pixel;
+  // repaint the existing borders
+  WinSet_for_each(&nwm->windows, i) {
+    Window win = nwm->windows.slots[i].id;
+    XSetWindowBorder(nwm->dpy, win, (win == nwm->selected ? active_pixel : normal_pixel));
+  }
+  XFlush(nwm->dpy);
+  return 0;
 }
 
-void nwm_move_window(Window win, int x, int y) {
-//  fprintf( stderr, "MoveWindow: id=%li x=%d y=%d \n", win, x, y);
-  XMoveWindow(nwm.dpy, win, x, y);
-  XFlush(nwm.dpy);
+void nwm_kill_window(NodeWinMan *nwm, Window win) {
+  WinRecord *record = WinSet_get(&nwm->windows, win);
+  // check whether the client supports "graceful" termination
+  if(record ? (record->protocols & ProtocolDelete) : isprotodel(nwm, nwm->dpy, win)) {
+    nwm_track_begin(nwm, win);
+    sendprotocol(nwm, nwm->dpy, win, nwm->atoms[WMDelete]);
+    nwm_track_end(nwm);
+    XFlush(nwm->dpy);
+  } else {
+    // nothing to wait for: if the client is already gone, the BadValue is counted
+    nwm_track_begin(nwm, win);
+    XKillClient(nwm->dpy, win);
+    nwm_track_end(nwm);
+    XFlush(nwm->dpy);
+  }
 }
 
-void nwm_resize_window(Window win, int width, int height) {
-//  fprintf( stderr, "ResizeWindow: id=%li width=%d height=%d \n", win, width, height);
-  XResizeWindow(nwm.dpy, win, width - nwm.border_width * 2, height - nwm.border_width * 2);
-  XFlush(nwm.dpy);
+// Requests about a client window, which may be destroyed at any time, are
+// sent between these two without a sync: their errors are matched by serial
+// in nwm_handle_error and counted instead of being fatal. The display stays
+// locked in between, so no request of the reader thread lands in the range;
+// the error handler runs with it locked too, wherever the error is read.
+static void nwm_track_begin(NodeWinMan *nwm, Window win) {
+  XLockDisplay(nwm->dpy);
+  RequestTrack_retire(&nwm->track, LastKnownRequestProcessed(nwm->dpy));
+  if(RequestTrack_begin(&nwm->track, win, NextRequest(nwm->dpy)) != 0) {
+    // out of memory: wait for the errors of the ranges kept, so that they can
+    // all go; with none left, there is room again
+    nwm->round_trips++;
+    XSync(nwm->dpy, False);
+    RequestTrack_retire(&nwm->track, LastKnownRequestProcessed(nwm->dpy));
+    RequestTrack_begin(&nwm->track, win, NextRequest(nwm->dpy));
+  }
 }
 
-void nwm_focus_window(Window win){
-  fprintf( stderr, "FocusWindow: id=%li\n", win);
-  grabButtons(win, True);
-  XSetWindowBorder(nwm.dpy, win, getcolor(nwm.active_bg));
-  XSetInputFocus(nwm.dpy, win, RevertToPointerRoot, CurrentTime);
-  Atom atom = XInternAtom(nwm.dpy, "WM_TAKE_FOCUS", False);
-  SendEvent(nwm.dpy, win, atom);
-  // also, raise the window so that the bg is shown
-//  XRaiseWindow(nwm.dpy, win);
-  XFlush(nwm.dpy);
-  nwm.selected = win;
+static void nwm_track_end(NodeWinMan *nwm) {
+  RequestTrack_end(&nwm->track, NextRequest(nwm->dpy) - 1);
+  XUnlockDisplay(nwm->dpy);
 }
 
-void nwm_kill_window(Window win) {
-  XEvent ev;
-  // check whether the client supports "graceful" termination
-  if(isprotodel(nwm.dpy, win)) {
-    ev.type = ClientMessage;
-    ev.xclient.window = win;
-    ev.xclient.message_type = XInternAtom(nwm.dpy, "WM_PROTOCOLS", False);
-    ev.xclient.format = 32;
-    ev.xclient.data.l[0] = XInternAtom(nwm.dpy, "WM_DELETE_WINDOW", False);
-    ev.xclient.data.l[1] = CurrentTime;
-    XSendEvent(nwm.dpy, win, False, NoEventMask, &ev);
-  } else {
-    XGrabServer(nwm.dpy);
-    XSetErrorHandler(xerrordummy);
-    XSetCloseDownMode(nwm.dpy, DestroyAll);
-    XKillClient(nwm.dpy, win);
-    XSync(nwm.dpy, False);
-    XSetErrorHandler(xerror);
-    XUngrabServer(nwm.dpy);
+// Called by xerror: counts errors from tracked requests and benign errors,
+// and returns 1 for those; 0 means the error was not expected at all.
+static int nwm_handle_error(Display *dpy, XErrorEvent *ee) {
+  NodeWinMan *nwm;
+  TrackedRange *t = NULL;
+
+  for(nwm = instances; nwm && nwm->dpy != dpy; nwm = nwm->next);
+  if(nwm) {
+    t = RequestTrack_find(&nwm->track, ee->serial);
+  }
+  if(t) {
+    __atomic_add_fetch(&nwm->stats->errors_tracked, 1, __ATOMIC_RELAXED);
+  }
+  if(xerror_benign(ee) || (t && ee->resourceid == t->window)) {
+    if(nwm) {
+      __atomic_add_fetch(&nwm->stats->errors_benign, 1, __ATOMIC_RELAXED);
+      __atomic_add_fetch(&nwm->stats->errors_by_request[ee->request_code], 1, __ATOMIC_RELAXED);
+    }
+    return 1;
+  }
+  if(t) {
+    __atomic_add_fetch(&nwm->stats->errors_unexpected, 1, __ATOMIC_RELAXED);
+    nwm_log(NWM_LOG_WARN, "Error for window %li: request code=%d, error code=%d\n",
+        t->window, ee->request_code, ee->error_code);
+    return 1;
   }
+  return 0;
 }
 
-void nwm_configure_window(Window win, int x, int y, int width, int height,
+void nwm_configure_window(NodeWinMan *nwm, Window win, int x, int y, int width, int height,
   int border_width, int above, int detail, int value_mask) {
   XWindowChanges wc;
   wc.x = x;
   wc.y = y;
   wc.width = width;
   wc.height = height;
-  wc.border_width = nwm.border_width; // border_width;
+  wc.border_width = nwm->border_width; // border_width;
   wc.sibling = above;
   wc.stack_mode = detail;
-  XConfigureWindow(nwm.dpy, win, value_mask, &wc);
+  // keep the last known geometry in sync for nwm_apply_layout
+  WinRecord *record = WinSet_get(&nwm->windows, win);
+  if(record && (value_mask & CWStackMode)) {
+    WinStack_place(&nwm->stacking, win, ((value_mask & CWSibling) ? (Window) above : None), detail);
+  }
+  if(record) {
+    if(value_mask & CWX)
+      record->x = x;
+    if(value_mask & CWY)
+      record->y = y;
+    if(value_mask & CWWidth)
+      record->width = width + nwm->border_width * 2;
+    if(value_mask & CWHeight)
+      record->height = height + nwm->border_width * 2;
+    if(value_mask & CWBorderWidth)
+      record->border_width = nwm->border_width;
+    nwm->session_dirty = True;
+  }
+  nwm_track_begin(nwm, win);
+  XConfigureWindow(nwm->dpy, win, value_mask, &wc);
+  nwm_track_end(nwm);
 }
 
-void nwm_notify_window(Window win, int x, int y, int width, int height,
+void nwm_notify_window(NodeWinMan *nwm, Window win, int x, int y, int width, int height,
     int border_width, int above, int detail, int value_mask) {
   XConfigureEvent ce;
 
   ce.type = ConfigureNotify;
-  ce.display = nwm.dpy;
+  ce.display = nwm->dpy;
   ce.event = win;
   ce.window = win;
   ce.x = x;
   ce.y = y;
   ce.width = width;
   ce.height = height;
-  ce.border_width = nwm.border_width;//border_width;
+  ce.border_width = nwm->border_width;//border_width;
   ce.above = None;
   ce.override_redirect = False;
-  XSendEvent(nwm.dpy, win, False, StructureNotifyMask, (XEvent *)&ce);
+  nwm_track_begin(nwm, win);
+  XSendEvent(nwm->dpy, win, False, StructureNotifyMask, (XEvent *)&ce);
+  nwm_track_end(nwm);
 }
 
-void nwm_add_window(Window win, XWindowAttributes *wa) {
-  Window trans = None;
-  Bool isfloating = False;
-  XConfigureEvent ce;
-  nwm_window event_data;
-  XWindowChanges wc;
+static const char *configure_policy_names[configureLast] = {
+  [ConfigureForward] = "forward",
+  [ConfigureAllow] = "allow",
+  [ConfigureDeny] = "deny"
+};
+
+int nwm_configure_policy_lookup(const char *name) {
+  unsigned int i;
+  for(i = 0; i < configureLast; i++) {
+    if(strcmp(name, configure_policy_names[i]) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
 
-  // check whether the window is transient
-  XGetTransientForHint(nwm.dpy, win, &trans);
-  isfloating = (trans != None);
+void nwm_set_configure_policy(NodeWinMan *nwm, configure_policy unmanaged, configure_policy floating, configure_policy tiled) {
+  nwm->configure_unmanaged = unmanaged;
+  nwm->configure_floating = floating;
+  nwm->configure_tiled = tiled;
+}
 
-  fprintf( stderr, "Create client %li (x %d, y %d, w %d, h %d, float %d)\n", win, wa->x, wa->y, wa->width, wa->height, isfloating);
-  // emit onAddWindow in Node.js
-  event_data.id = win;
-  event_data.x = wa->x;
-  event_data.y = wa->y;
-  event_data.height = wa->height;
-  event_data.width = wa->width;
-  event_data.isfloating = isfloating;
-  nwm_emit(onAddWindow, (void *)&event_data);
+int nwm_add_configure_rule(NodeWinMan *nwm, const char *klass, configure_policy policy) {
+  ConfigureRule *rule;
+  if(nwm->total_configure_rules >= CONFIGURE_RULES_MAX) {
+    return -1;
+  }
+  rule = &nwm->configure_rules[nwm->total_configure_rules++];
+  strncpy(rule->klass, klass, NWM_TEXT_LEN - 1);
+  rule->klass[NWM_TEXT_LEN - 1] = '\0';
+  rule->policy = policy;
+  return 0;
+}
+
+void nwm_clear_configure_rules(NodeWinMan *nwm) {
+  nwm->total_configure_rules = 0;
+}
+
+// the policy for a configure request from the window with this record (NULL if unmanaged)
+static configure_policy nwm_configure_policy_for(NodeWinMan *nwm, WinRecord *record) {
+  unsigned int i;
+  if(!record) {
+    return nwm->configure_unmanaged;
+  }
+  if(record->meta) {
+    for(i = 0; i < nwm->total_configure_rules; i++) {
+      if(strcmp(nwm->configure_rules[i].klass, record->meta->klass) == 0) {
+        return nwm->configure_rules[i].policy;
+      }
+    }
+  }
+  return (record->isfloating ? nwm->configure_floating : nwm->configure_tiled);
+}
+
+// info holds everything in FETCH_MAP
+void nwm_add_window(NodeWinMan *nwm, nwm_window_info *info) {
+  nwm_window event_data;
+  nwm_window_title title_data;
 
-  // push the window id so we know what windows we've seen
-  List_push(&nwm.windows, (void *)win);
+  nwm_adopt_window(nwm, info, False, &event_data, &title_data);
+  // emit onAddWindow and onUpdateWindow in Node.js
+  nwm_emit(nwm, onAddWindow, (void *)&event_data);
+  nwm_emit(nwm, onUpdateWindow, (void *)&title_data);
+}
+
+// manages a window whose attributes, transient hint, title, class and protocols are in info,
+// and fills in the onAddWindow and onUpdateWindow payloads without emitting them.
+// A hidden window (restored from a session snapshot) is left unmapped, in IconicState.
+// The requests are only buffered; the caller decides when to flush.
+static void nwm_adopt_window(NodeWinMan *nwm, nwm_window_info *info, Bool hidden, nwm_window *event_data, nwm_window_title *title_data) {
+  Window win = info->id;
+  XWindowAttributes *wa = &info->wa;
+  Bool isfloating = (info->transient_for != None);
+  XConfigureEvent ce;
+  XWindowChanges wc;
 
-  nwm_update_window(win); // update title and class, emit onUpdateWindow
+  nwm_log(NWM_LOG_INFO, "Create client %li (x %d, y %d, w %d, h %d, float %d)\n", win, wa->x, wa->y, wa->width, wa->height, isfloating);
+  event_data->id = win;
+  event_data->x = wa->x;
+  event_data->y = wa->y;
+  event_data->height = wa->height;
+  event_data->width = wa->width;
+  event_data->isfloating = isfloating;
+  event_data->hidden = hidden;
+  nwm_make_title(info, title_data);
+
+  // store the window id so we know what windows we've seen
+  WinRecord *record = WinSet_add(&nwm->windows, win);
+  if(!record) {
+    fprintf( stderr, "fatal: could not grow the window set\n");
+    exit( -1 );
+  }
+  record->isfloating = isfloating;
+  record->fullscreen = False;
+  record->transient_for = info->transient_for;
+  record->protocols = info->protocols;
+  record->hidden = hidden;
+  record->unmap_serial = 0;
+  nwm->session_dirty = True;
+  if(!record->meta) {
+    if(!nwm->meta_pool.size) {
+      Pool_init(&nwm->meta_pool, sizeof(struct WinMeta), 32);
+    }
+    if(!(record->meta = Pool_alloc(&nwm->meta_pool))) {
+      fprintf( stderr, "fatal: could not malloc() %lu bytes\n", sizeof(struct WinMeta));
+      exit( -1 );
+    }
+  }
+  strcpy(record->meta->title, title_data->title);
+  strcpy(record->meta->instance, title_data->instance);
+  strcpy(record->meta->klass, title_data->klass);
+  record->x = wa->x;
+  record->y = wa->y;
+  record->width = wa->width + nwm->border_width * 2;
+  record->height = wa->height + nwm->border_width * 2;
+  record->border_width = nwm->border_width;
+  if(WinStack_push(&nwm->clients, win) != 0) {
+    fprintf( stderr, "fatal: could not grow the client list\n");
+    exit( -1 );
+  }
+  nwm_ewmh_changed(nwm, EwmhClientList);
+  nwm_set_strut(nwm, win, info->strut);
 
   // configure the window
   ce.type = ConfigureNotify;
-  ce.display = nwm.dpy;
+  ce.display = nwm->dpy;
   ce.event = win;
   ce.window = win;
   ce.x = wa->x;
   ce.y = wa->y;
   ce.width = wa->width;
   ce.height = wa->height;
-  ce.border_width = nwm.border_width;// wa->border_width;
+  ce.border_width = nwm->border_width;// wa->border_width;
   ce.above = None;
   ce.override_redirect = False;
 
-  fprintf( stderr, "manage: x=%d y=%d width=%d height=%d \n", ce.x, ce.y, ce.width, ce.height);
+  nwm_log(NWM_LOG_DEBUG, "manage: x=%d y=%d width=%d height=%d \n", ce.x, ce.y, ce.width, ce.height);
 
-  wc.border_width = nwm.border_width;
-  XConfigureWindow(nwm.dpy, win, CWBorderWidth, &wc);
+  // border and geometry in one request
+  wc.x = ce.x;
+  wc.y = ce.y;
+  wc.width = ce.width;
+  wc.height = ce.height;
+  wc.border_width = nwm->border_width;
+  XConfigureWindow(nwm->dpy, win, CWX|CWY|CWWidth|CWHeight|CWBorderWidth, &wc);
 
-  XSetWindowBorder(nwm.dpy, win, getcolor(nwm.normal_bg));
+  XSetWindowBorder(nwm->dpy, win, nwm->normal_pixel);
 
-  XSendEvent(nwm.dpy, win, False, StructureNotifyMask, (XEvent *)&ce);
+  XSendEvent(nwm->dpy, win, False, StructureNotifyMask, (XEvent *)&ce);
   // subscribe to window events
-  XSelectInput(nwm.dpy, win, EnterWindowMask|FocusChangeMask|PropertyChangeMask|StructureNotifyMask);
-  grabButtons(win, False);
-
-  if(isfloating) {
-    XRaiseWindow(nwm.dpy, win);
-  }
-
-  // move and (finally) map the window
-  XMoveResizeWindow(nwm.dpy, win, ce.x, ce.y, ce.width, ce.height);
-  XMapWindow(nwm.dpy, win);
-}
-
-void nwm_update_window(Window win) {
-  char name[256];
-  char klass[256];
-  char instance[256];
-  // update title
-  Atom NetWMName = XInternAtom(nwm.dpy, "_NET_WM_NAME", False);
-  if(!gettextprop(nwm.dpy, win, NetWMName, name, sizeof name))
-    gettextprop(nwm.dpy, win, XA_WM_NAME, name, sizeof name);
-  if(name[0] == '\0') /* hack to mark broken clients */
-    strcpy(name, broken);
-  // update class
-  XClassHint ch = { 0 };
-  if(XGetClassHint(nwm.dpy, win, &ch)) {
-    if(ch.res_class) {
-      strncpy(klass, ch.res_class, 256-1 );
-    } else {
-      strncpy(klass, broken, 256-1 );
-    }
-    klass[256-1] = 0;
-    if(ch.res_name) {
-      strncpy(instance, ch.res_name, 256-1 );
-    } else {
-      strncpy(instance, broken, 256-1 );
-    }
-    instance[256-1] = 0;
-    if(ch.res_class)
-      XFree(ch.res_class);
-    if(ch.res_name)
-      XFree(ch.res_name);
+  XSelectInput(nwm->dpy, win, EnterWindowMask|FocusChangeMask|PropertyChangeMask|StructureNotifyMask);
+  grabButtons(nwm, win, False);
+
+  if(hidden) {
+    setclientstate(nwm, win, IconicState);
+    return;
+  }
+  // windows adopted at startup are already mapped (and stacked by nwm_scan_windows);
+  // new windows go on top, which costs no exposes while they are still unmapped
+  if(wa->map_state != IsViewable) {
+    nwm_stack_window(nwm, win);
+    XMapRaised(nwm->dpy, win);
   }
+  setclientstate(nwm, win, NormalState);
+}
 
+// re-reads the title (FetchTitle) or class and instance (FetchClass) of a managed
+// window and emits onUpdateWindow only if they differ from the cached values;
+// FetchProtocols just refreshes the cached protocols
+void nwm_update_window(NodeWinMan *nwm, Window win, unsigned int flags) {
+  nwm_window_info fetched, *info;
   nwm_window_title event_data;
+  WinRecord *record = WinSet_get(&nwm->windows, win);
+  struct WinMeta *meta;
+  Bool changed = False;
 
-  event_data.id = win;
-  event_data.title = name;
-  event_data.instance = instance;
-  event_data.klass = klass;
-
+  if(!record || !record->meta) {
+    return;
+  }
+  meta = record->meta;
+  if(!(info = nwm_prefetched(nwm, win, flags))) {
+    info = &fetched;
+    nwm->round_trips += nwm_fetch_windows(nwm->dpy, &nwm->fetch_atoms, &win, 1, flags, info);
+  }
+  if(flags & FetchProtocols) {
+    record->protocols = info->protocols;
+    nwm->session_dirty = True;
+  }
+  if(!(flags & (FetchTitle|FetchClass))) {
+    return;
+  }
+  // fields that were not fetched keep their cached values
+  if(!(flags & FetchTitle))
+    strcpy(info->title, meta->title);
+  if(!(flags & FetchClass)) {
+    strcpy(info->instance, meta->instance);
+    strcpy(info->klass, meta->klass);
+  }
+  nwm_make_title(info, &event_data);
+  if(strcmp(meta->title, info->title)) {
+    strcpy(meta->title, info->title);
+    changed = True;
+  }
+  if(strcmp(meta->instance, info->instance) || strcmp(meta->klass, info->klass)) {
+    strcpy(meta->instance, info->instance);
+    strcpy(meta->klass, info->klass);
+    changed = True;
+  }
+  if(!changed) {
+    nwm_log(NWM_LOG_TRACE, "Window %li properties unchanged\n", win);
+    return;
+  }
+  nwm->session_dirty = True;
   // emit onUpdateWindow
-  nwm_emit(onUpdateWindow, (void *)&event_data);
+  nwm_emit(nwm, onUpdateWindow, (void *)&event_data);
 }
 
-void nwm_remove_window(Window win, Bool destroyed) {
-  fprintf( stderr, "** Remove Window\n");
+// fills in the onUpdateWindow payload; the strings point into info
+static void nwm_make_title(nwm_window_info *info, nwm_window_title *event_data) {
+  /* hack to mark broken clients */
+  if(info->title[0] == '\0')
+    strcpy(info->title, broken);
+  if(info->klass[0] == '\0')
+    strcpy(info->klass, broken);
+  if(info->instance[0] == '\0')
+    strcpy(info->instance, broken);
+
+  event_data->id = info->id;
+  event_data->title = info->title;
+  event_data->instance = info->instance;
+  event_data->klass = info->klass;
+}
+
+void nwm_remove_window(NodeWinMan *nwm, Window win, Bool destroyed) {
+  nwm_log(NWM_LOG_DEBUG, "** Remove Window\n");
   nwm_window event_data;
+  WinRecord *record;
+  MonitorRecord *rearrange;
   event_data.id = win;
 
   // remove from seen list of windows
-  List *item = NULL;
-  List_search(nwm.windows, item, (void*) win);
-  if(item) {
-    fprintf( stderr, "* emit onRemoveWindow, %li\n", win);
+  if(WinSet_get(&nwm->windows, win)) {
+    nwm_log(NWM_LOG_DEBUG, "* emit onRemoveWindow, %li\n", win);
     // emit a remove
-    nwm_emit(onRemoveWindow, (void *)&event_data);
+    nwm_emit(nwm, onRemoveWindow, (void *)&event_data);
 
+    // buffered with the rest of the batch; if the window is gone by the time
+    // it arrives, the BadWindow is counted
     if(!destroyed) {
-      XGrabServer(nwm.dpy);
-      XUngrabButton(nwm.dpy, AnyButton, AnyModifier, win);
-      XSync(nwm.dpy, False);
-      XUngrabServer(nwm.dpy);
+      nwm_track_begin(nwm, win);
+      XUngrabButton(nwm->dpy, AnyButton, AnyModifier, win);
+      nwm_track_end(nwm);
+    }
+
+    record = WinSet_get(&nwm->windows, win);
+    if(record->meta) {
+      Pool_release(&nwm->meta_pool, record->meta);
+    }
+    // only a tiled window that was shown leaves a gap in a layout
+    if(!record->hidden && !record->isfloating) {
+      rearrange = nwm_monitor_at(nwm, record->x + record->width / 2, record->y + record->height / 2);
+      nwm_rearrange(nwm, rearrange ? rearrange : nwm_monitor_at(nwm, nwm->pointer_x, nwm->pointer_y));
+    }
+    WinSet_remove(&nwm->windows, win);
+    WinStack_remove(&nwm->stacking, win);
+    WinStack_remove(&nwm->focus_history, win);
+    WinStack_remove(&nwm->clients, win);
+    nwm_ewmh_changed(nwm, EwmhClientList);
+    nwm_set_strut(nwm, win, NULL);
+    nwm->session_dirty = True;
+    // only refocus if the removed window had the focus; when several windows
+    // go away in one batch, this happens once at the end of it
+    if(nwm->selected == win) {
+      if(nwm->in_batch) {
+        nwm->refocus_pending = True;
+      } else {
+        nwm_focus_next(nwm);
+      }
     }
+  }
+}
+
+
+static void nwm_emit_monitor(NodeWinMan *nwm, callback_map event, MonitorRecord *record) {
+  nwm_monitor event_data;
+
+  event_data.id = record->id;
+  event_data.x = record->x;
+  event_data.y = record->y;
+  event_data.width = record->width;
+  event_data.height = record->height;
+  event_data.workarea_x = record->wa_x;
+  event_data.workarea_y = record->wa_y;
+  event_data.workarea_width = record->wa_width;
+  event_data.workarea_height = record->wa_height;
+
+  nwm_emit(nwm, event, (void *)&event_data);
+}
 
-    List_remove(&nwm.windows, item);
-    // only refocus if the removed window was managed in the first place
-    fprintf( stderr, "Focusing to root window\n");
-    nwm_focus_window(nwm.root);
+// Recomputes the workarea of a monitor: each strut whose range covers part
+// of the monitor's edge moves that edge inwards. Struts are relative to the
+// root window, so only those reaching into the monitor count. Returns True
+// if the workarea changed.
+static Bool nwm_compute_workarea(NodeWinMan *nwm, MonitorRecord *record) {
+  long left = record->x, right = record->x + record->width;
+  long top = record->y, bottom = record->y + record->height;
+  long x0 = left, x1 = right, y0 = top, y1 = bottom;
+  unsigned int i;
+
+  for(i = 0; i < nwm->total_struts; i++) {
+    const long *s = nwm->struts[i].strut;
+    if(s[StrutLeft] > left && s[StrutLeftStartY] < bottom && s[StrutLeftEndY] >= top) {
+      x0 = (s[StrutLeft] > x0 ? s[StrutLeft] : x0);
+    }
+    if(nwm->screen_width - s[StrutRight] < right && s[StrutRightStartY] < bottom && s[StrutRightEndY] >= top) {
+      x1 = (nwm->screen_width - s[StrutRight] < x1 ? nwm->screen_width - s[StrutRight] : x1);
+    }
+    if(s[StrutTop] > top && s[StrutTopStartX] < right && s[StrutTopEndX] >= left) {
+      y0 = (s[StrutTop] > y0 ? s[StrutTop] : y0);
+    }
+    if(nwm->screen_height - s[StrutBottom] < bottom && s[StrutBottomStartX] < right && s[StrutBottomEndX] >= left) {
+      y1 = (nwm->screen_height - s[StrutBottom] < y1 ? nwm->screen_height - s[StrutBottom] : y1);
+    }
   }
-//  fprintf( stderr, "Emitting rearrange\n");
-//  nwm_emit(onRearrange, NULL);
+  // struts that leave nothing usable are ignored
+  if(x1 <= x0 || y1 <= y0) {
+    x0 = left;
+    x1 = right;
+    y0 = top;
+    y1 = bottom;
+  }
+  if(record->wa_x == x0 && record->wa_y == y0 && record->wa_width == x1 - x0 && record->wa_height == y1 - y0) {
+    return False;
+  }
+  record->wa_x = x0;
+  record->wa_y = y0;
+  record->wa_width = x1 - x0;
+  record->wa_height = y1 - y0;
+  nwm_ewmh_changed(nwm, EwmhWorkarea);
+  return True;
 }
 
+// after a strut changed: reports the monitors whose workarea changed
+static void nwm_update_workareas(NodeWinMan *nwm) {
+  unsigned int i;
+  for(i = 0; i < nwm->total_monitors; i++) {
+    if(nwm_compute_workarea(nwm, &nwm->monitors[i])) {
+      nwm_log(NWM_LOG_DEBUG, "* emit onUpdateMonitor %d (workarea)\n", nwm->monitors[i].id);
+      nwm_emit_monitor(nwm, onUpdateMonitor, &nwm->monitors[i]);
+      nwm_rearrange(nwm, &nwm->monitors[i]);
+    }
+  }
+}
 
-static void nwm_scan_monitors() {
-  int i, nn;
-  unsigned int j;
-  XineramaScreenInfo *info = NULL;
-  XineramaScreenInfo *unique = NULL;
-  // no Xinerama
-  if(!XineramaIsActive(nwm.dpy) && nwm.total_monitors == 0) {
-    nwm.total_monitors++;
-    // emit ADD MONITOR
-    nwm_monitor event_data;
+static StrutRecord* nwm_find_strut(NodeWinMan *nwm, Window win) {
+  unsigned int i;
+  for(i = 0; i < nwm->total_struts; i++) {
+    if(nwm->struts[i].id == win) {
+      return &nwm->struts[i];
+    }
+  }
+  return NULL;
+}
 
-    event_data.id = 0;
-    event_data.x = 0;
-    event_data.y = 0;
-    event_data.width = nwm.screen_width;
-    event_data.height = nwm.screen_height;
+// Records the strut of a window; NULL, or a strut that reserves nothing,
+// forgets it. The workareas are only recomputed if it changed.
+static void nwm_set_strut(NodeWinMan *nwm, Window win, const long *strut) {
+  StrutRecord *found = nwm_find_strut(nwm, win);
+  unsigned int i = (found ? found - nwm->struts : nwm->total_struts);
+  Bool reserves = (strut && (strut[StrutLeft] > 0 || strut[StrutRight] > 0
+      || strut[StrutTop] > 0 || strut[StrutBottom] > 0));
 
-    nwm_emit(onAddMonitor, (void *)&event_data);
-    nwm_update_selected_monitor();
+  if(!found) {
+    if(!reserves) {
+      return;
+    }
+    if(nwm->total_struts == STRUTS_MAX) {
+      nwm_log(NWM_LOG_WARN, "Too many struts, ignoring the one of window %li\n", win);
+      return;
+    }
+    nwm->total_struts++;
+  } else if(reserves && !memcmp(nwm->struts[i].strut, strut, sizeof(nwm->struts[i].strut))) {
     return;
   }
+  if(reserves) {
+    nwm->struts[i].id = win;
+    memcpy(nwm->struts[i].strut, strut, sizeof(nwm->struts[i].strut));
+  } else {
+    nwm->struts[i] = nwm->struts[--nwm->total_struts];
+  }
+  nwm_log(NWM_LOG_DEBUG, "Strut of window %li %s\n", win, (reserves ? "set" : "removed"));
+  nwm_update_workareas(nwm);
+}
 
-  // with Xinerama
-  fprintf( stderr, "Xinerama active\n");
-  info = XineramaQueryScreens(nwm.dpy, &nn);
+// re-reads the strut of a window (unless the reader thread already did)
+static void nwm_update_strut(NodeWinMan *nwm, Window win) {
+  nwm_window_info fetched, *info;
+  if(!(info = nwm_prefetched(nwm, win, FetchStrut))) {
+    info = &fetched;
+    nwm->round_trips += nwm_fetch_windows(nwm->dpy, &nwm->fetch_atoms, &win, 1, FetchStrut, info);
+  }
+  nwm_set_strut(nwm, win, info->strut);
+}
 
-  fprintf( stderr, "Monitors known %d, monitors found %d\n", nwm.total_monitors, nn);
-  /* only consider unique geometries as separate screens */
-  if(!(unique = (XineramaScreenInfo *)malloc(sizeof(XineramaScreenInfo) * nn))) {
-    fprintf( stderr, "fatal: could not malloc() %lu bytes\n", sizeof(XineramaScreenInfo) * nn);
-    exit( -1 );
+// updates a known monitor, and reports it only if its geometry changed
+static Bool nwm_set_monitor_geometry(NodeWinMan *nwm, MonitorRecord *record, int x, int y, int width, int height) {
+  if(record->x == x && record->y == y && record->width == width && record->height == height) {
+    return False;
   }
-  for(i = 0, j = 0; i < nn; i++)
-    if(isuniquegeom(unique, j, &info[i]))
-      memcpy(&unique[j++], &info[i], sizeof(XineramaScreenInfo));
-  XFree(info);
-  nn = j;
-  if(nwm.total_monitors <= nn) {
-    // update monitor dimensions
-    //  We just emit the monitors and don't track the dimensions in the binding at all.
-    for(i = 0; i < nn; i++) {
-      nwm_monitor event_data;
-
-      event_data.id = i;
-      event_data.x = unique[i].x_org;
-      event_data.y = unique[i].y_org;
-      event_data.width = unique[i].width;
-      event_data.height = unique[i].height;
-
-      if(i >= nwm.total_monitors) {
-        fprintf( stderr, "* emit onAddMonitor %d\n", i);
-        nwm_emit(onAddMonitor, (void *)&event_data);
-        nwm.total_monitors++;
-      } else {
-        fprintf( stderr, "* emit onUpdateMonitor %d\n", i);
-        nwm_emit(onUpdateMonitor, (void *)&event_data);
+  record->x = x;
+  record->y = y;
+  record->width = width;
+  record->height = height;
+  nwm_compute_workarea(nwm, record);
+  nwm_log(NWM_LOG_DEBUG, "* emit onUpdateMonitor %d\n", record->id);
+  nwm_emit_monitor(nwm, onUpdateMonitor, record);
+  nwm_rearrange(nwm, record);
+  return True;
+}
+
+static MonitorRecord* nwm_find_monitor(NodeWinMan *nwm, XID key, XID crtc) {
+  unsigned int i;
+  for(i = 0; i < nwm->total_monitors; i++) {
+    if((key && nwm->monitors[i].key == key) || (crtc && nwm->monitors[i].crtc == crtc)) {
+      return &nwm->monitors[i];
+    }
+  }
+  return NULL;
+}
+
+static Bool nwm_find_id(NodeWinMan *nwm, int id) {
+  unsigned int i;
+  for(i = 0; i < nwm->total_monitors; i++) {
+    if(nwm->monitors[i].id == id) {
+      return True;
+    }
+  }
+  return False;
+}
+
+// adds found to the list unless a monitor with the same geometry is already in
+// it (e.g. outputs cloned onto separate CRTCs)
+static void nwm_add_found(MonitorRecord *found, unsigned int *count, XID key, XID crtc,
+    int x, int y, int width, int height) {
+  unsigned int i;
+  if(*count >= MONITORS_MAX) {
+    return;
+  }
+  for(i = 0; i < *count; i++) {
+    if(found[i].x == x && found[i].y == y && found[i].width == width && found[i].height == height) {
+      return;
+    }
+  }
+  found[*count].key = key;
+  found[*count].crtc = crtc;
+  found[*count].x = x;
+  found[*count].y = y;
+  found[*count].width = width;
+  found[*count].height = height;
+  (*count)++;
+}
+
+static void nwm_init_randr(NodeWinMan *nwm) {
+  int error_base, major, minor;
+  nwm->randr = False;
+  // XRRGetScreenResourcesCurrent needs 1.3, which does not probe the outputs
+  if(XRRQueryExtension(nwm->dpy, &nwm->randr_event_base, &error_base)
+  && XRRQueryVersion(nwm->dpy, &major, &minor) && (major > 1 || (major == 1 && minor >= 3))) {
+    nwm->randr = True;
+    XRRSelectInput(nwm->dpy, nwm->root, RRScreenChangeNotifyMask|RRCrtcChangeNotifyMask|RROutputChangeNotifyMask);
+  }
+  nwm_log(NWM_LOG_INFO, "RandR %s\n", (nwm->randr ? "active" : "not available"));
+}
+
+// the active CRTCs, keyed by their first output
+static unsigned int nwm_query_randr(NodeWinMan *nwm, MonitorRecord *found) {
+  XRRScreenResources *resources = XRRGetScreenResourcesCurrent(nwm->dpy, nwm->root);
+  unsigned int count = 0;
+  int i;
+  nwm->round_trips++;
+  if(!resources) {
+    return 0;
+  }
+  nwm->round_trips += resources->ncrtc;
+  for(i = 0; i < resources->ncrtc; i++) {
+    XRRCrtcInfo *crtc = XRRGetCrtcInfo(nwm->dpy, resources, resources->crtcs[i]);
+    if(crtc && crtc->mode != None && crtc->noutput > 0) {
+      nwm_add_found(found, &count, crtc->outputs[0], resources->crtcs[i],
+          crtc->x, crtc->y, crtc->width, crtc->height);
+    }
+    if(crtc) {
+      XRRFreeCrtcInfo(crtc);
+    }
+  }
+  XRRFreeScreenResources(resources);
+  return count;
+}
+
+static Bool nwm_xinerama_active(NodeWinMan *nwm) {
+  nwm->round_trips++;
+  return XineramaIsActive(nwm->dpy);
+}
+
+// Finds the current monitors, and reports the monitors that were added, moved
+// or resized, or that disappeared. Without RandR, Xinerama screens are keyed by
+// their number; without either, the whole screen is one monitor.
+static void nwm_scan_monitors(NodeWinMan *nwm) {
+  MonitorRecord found[MONITORS_MAX];
+  Bool seen[MONITORS_MAX] = { False };
+  unsigned int i, j, count = 0, changed = 0;
+
+  if(nwm->randr) {
+    count = nwm_query_randr(nwm, found);
+  }
+  if(count == 0 && nwm_xinerama_active(nwm)) {
+    int nn;
+    XineramaScreenInfo *info = XineramaQueryScreens(nwm->dpy, &nn);
+    nwm->round_trips++;
+    for(i = 0; info && i < (unsigned int) nn; i++) {
+      nwm_add_found(found, &count, info[i].screen_number + 1, None,
+          info[i].x_org, info[i].y_org, info[i].width, info[i].height);
+    }
+    if(info) {
+      XFree(info);
+    }
+  }
+  if(count == 0) {
+    nwm_add_found(found, &count, 1, None, 0, 0, nwm->screen_width, nwm->screen_height);
+  }
+  nwm_log(NWM_LOG_INFO, "Monitors known %d, monitors found %d\n", nwm->total_monitors, count);
+
+  // updates and additions first, so that the windows of a removed monitor
+  // can be moved to a monitor that is already known to Node
+  for(i = 0; i < count; i++) {
+    MonitorRecord *record = nwm_find_monitor(nwm, found[i].key, None);
+    if(record) {
+      seen[record - nwm->monitors] = True;
+      record->crtc = found[i].crtc;
+      changed += nwm_set_monitor_geometry(nwm, record, found[i].x, found[i].y, found[i].width, found[i].height);
+    } else if(nwm->total_monitors < MONITORS_MAX) {
+      // the lowest id that is not in use
+      found[i].id = 0;
+      while(nwm_find_id(nwm, found[i].id)) {
+        found[i].id++;
       }
+      seen[nwm->total_monitors] = True;
+      found[i].dirty = False;
+      found[i].wa_width = 0;
+      nwm_compute_workarea(nwm, &found[i]);
+      nwm->monitors[nwm->total_monitors++] = found[i];
+      nwm_log(NWM_LOG_DEBUG, "* emit onAddMonitor %d\n", found[i].id);
+      nwm_emit_monitor(nwm, onAddMonitor, &found[i]);
+      changed++;
+    }
+  }
+  for(i = 0, j = 0; i < nwm->total_monitors; i++) {
+    if(seen[i]) {
+      nwm->monitors[j++] = nwm->monitors[i];
+    } else {
+      nwm_log(NWM_LOG_DEBUG, "* emit onRemoveMonitor %d\n", nwm->monitors[i].id);
+      nwm_emit_monitor(nwm, onRemoveMonitor, &nwm->monitors[i]);
+      changed++;
     }
-  } else { // fewer monitors available nn < n
-    fprintf( stderr, "Fewer monitors available %d %d\n", nwm.total_monitors, nn);
-    for(i = nn; i < nwm.total_monitors; i++) {
-      // emit REMOVE MONITOR (i)
-      nwm_monitor event_data;
+  }
+  nwm->total_monitors = j;
+  // the windows of a removed monitor go to the remaining ones
+  if(j < i) {
+    nwm_rearrange(nwm, NULL);
+    nwm_ewmh_changed(nwm, EwmhWorkarea);
+  }
+  if(changed) {
+    nwm_update_selected_monitor(nwm);
+  }
+}
 
-      event_data.id = i;
-      nwm_emit(onRemoveMonitor, (void *)&event_data);
-      // remove monitor
-      nwm.total_monitors--;
+// A CRTC that changed geometry is applied straight from the event. Anything
+// else (outputs connected or disconnected, CRTCs enabled or disabled) is
+// resolved by one scan at the end of the batch, however many events it took.
+static void event_randr(NodeWinMan *nwm, XEvent *e) {
+  XRRUpdateConfiguration(e);
+  // the refresh rates may have changed
+  nwm->frame_usec = 0;
+  if(e->type == nwm->randr_event_base + RRScreenChangeNotify) {
+    nwm->screen_width = DisplayWidth(nwm->dpy, nwm->screen);
+    nwm->screen_height = DisplayHeight(nwm->dpy, nwm->screen);
+    return;
+  }
+  if(((XRRNotifyEvent *) e)->subtype == RRNotify_CrtcChange) {
+    XRRCrtcChangeNotifyEvent *ev = (XRRCrtcChangeNotifyEvent *) e;
+    MonitorRecord *record = nwm_find_monitor(nwm, None, ev->crtc);
+    if(record && ev->mode != None) {
+      // the event has the mode size, before rotation
+      if(ev->rotation & (RR_Rotate_90|RR_Rotate_270)) {
+        nwm_set_monitor_geometry(nwm, record, ev->x, ev->y, ev->height, ev->width);
+      } else {
+        nwm_set_monitor_geometry(nwm, record, ev->x, ev->y, ev->width, ev->height);
+      }
+      return;
     }
+    if(!record && ev->mode == None) {
+      return; // an unused CRTC
+    }
+  } else if(((XRRNotifyEvent *) e)->subtype != RRNotify_OutputChange) {
+    return;
+  }
+  if(nwm->in_batch) {
+    nwm->monitors_pending = True;
+  } else {
+    nwm_scan_monitors(nwm);
   }
-  free(unique);
-  nwm_update_selected_monitor();
 }
 
 
 // update the selected monitor on Node.js side
 // NOTE: We can probably get rid of this altogether, since it isn't essential.
 // Node will keep the focused monitor as the first one, but that should be OK.
-void nwm_update_selected_monitor() {
+void nwm_update_selected_monitor(NodeWinMan *nwm) {
   int x, y;
-  if(getrootptr(nwm.dpy, nwm.root, &x, &y)) {
-    fprintf(stderr, "* emit onEnterNotify wid = %li \n", nwm.root);
-    nwm_monitor event_data;
+  nwm->round_trips++;
+  if(getrootptr(nwm->dpy, nwm->root, &x, &y)) {
+    nwm_log(NWM_LOG_DEBUG, "* emit onEnterNotify wid = %li \n", nwm->root);
+    XCrossingEvent event_data;
+
+    // same payload as a real EnterNotify on the root window
+    memset(&event_data, 0, sizeof(XCrossingEvent));
+    event_data.window = nwm->root;
+    event_data.x = event_data.x_root = x;
+    event_data.y = event_data.y_root = y;
+    nwm->pointer_x = x;
+    nwm->pointer_y = y;
+
+    nwm_emit(nwm, onEnterNotify, (void *)&event_data);
+  }
+}
 
-    event_data.id = nwm.root;
-    event_data.x = x;
-    event_data.y = y;
+static void event_buttonpress(NodeWinMan *nwm, XEvent *e) {
+  XButtonEvent *ev = &e->xbutton;
+  nwm_log(NWM_LOG_DEBUG, "** (mouse)ButtonPress\n");
+  if(nwm->drag.win) {
+    return; // the other buttons are ignored until the drag is done
+  }
+  nwm_emit(nwm, onMouseDown, e);
+  // drag modifier + button 1 moves, + button 3 resizes
+  if(nwm->drag_modifier && (ev->button == Button1 || ev->button == Button3)
+  && nwm_clean_mask(nwm, ev->state) == nwm_clean_mask(nwm, nwm->drag_modifier)
+  && WinSet_get(&nwm->windows, ev->window)) {
+    nwm_drag_start(nwm, ev->window, ev->button, ev->x_root, ev->y_root);
+  }
+}
+
+// the frame time of the fastest active CRTC, in usec
+static unsigned long nwm_frame_usec(NodeWinMan *nwm) {
+  XRRScreenResources *resources = NULL;
+  unsigned long frame, fastest = 0;
+  int i, j;
+
+  if(nwm->frame_usec) {
+    return nwm->frame_usec;
+  }
+  if(nwm->randr) {
+    nwm->round_trips++;
+    resources = XRRGetScreenResourcesCurrent(nwm->dpy, nwm->root);
+  }
+  if(resources) {
+    nwm->round_trips += resources->ncrtc;
+    for(i = 0; i < resources->ncrtc; i++) {
+      XRRCrtcInfo *crtc = XRRGetCrtcInfo(nwm->dpy, resources, resources->crtcs[i]);
+      for(j = 0; crtc && crtc->mode != None && j < resources->nmode; j++) {
+        XRRModeInfo *mode = &resources->modes[j];
+        double lines = mode->vTotal;
+        if(mode->id != crtc->mode || !mode->dotClock || !mode->hTotal || !mode->vTotal) {
+          continue;
+        }
+        if(mode->modeFlags & RR_DoubleScan)
+          lines *= 2;
+        if(mode->modeFlags & RR_Interlace)
+          lines /= 2;
+        frame = (unsigned long) (1000000.0 * mode->hTotal * lines / mode->dotClock);
+        fastest = (!fastest || frame < fastest ? frame : fastest);
+      }
+      if(crtc) {
+        XRRFreeCrtcInfo(crtc);
+      }
+    }
+    XRRFreeScreenResources(resources);
+  }
+  nwm->frame_usec = (fastest ? fastest : DRAG_INTERVAL);
+  nwm_log(NWM_LOG_DEBUG, "Dragging at one step per %lu usec\n", nwm->frame_usec);
+  return nwm->frame_usec;
+}
 
-    nwm_emit(onEnterNotify, (void *)&event_data);
+// Interactive move (Button1) or resize (Button3) of a managed window. The
+// pointer is grabbed until the button is released, and the drag is advanced
+// by the MotionNotify and ButtonRelease handlers, so every other event is
+// handled as usual meanwhile. Motion is applied at most once per frame of the
+// fastest monitor; a step held back is applied by nwm_drag_flush once it is
+// due. JS only sees the result: one onMouseDrag on release.
+static void nwm_drag_start(NodeWinMan *nwm, Window win, unsigned int button, int x_root, int y_root) {
+  WinRecord *record = WinSet_get(&nwm->windows, win);
+  DragState *drag = &nwm->drag;
+  Cursor cursor = XCreateFontCursor(nwm->dpy, (button == Button1 ? XC_fleur : XC_sizing));
+
+  nwm->round_trips++;
+  if(XGrabPointer(nwm->dpy, nwm->root, False, ButtonPressMask|ButtonReleaseMask|PointerMotionMask,
+      GrabModeAsync, GrabModeAsync, None, cursor, CurrentTime) != GrabSuccess) {
+    XFreeCursor(nwm->dpy, cursor);
+    return;
   }
+  nwm_log(NWM_LOG_DEBUG, "Drag %li (button %d)\n", win, button);
+  nwm_frame_usec(nwm);
+  drag->win = win;
+  drag->button = button;
+  drag->cursor = cursor;
+  drag->x_root = x_root;
+  drag->y_root = y_root;
+  drag->start_x = drag->x = record->x;
+  drag->start_y = drag->y = record->y;
+  drag->start_width = drag->width = record->width;
+  drag->start_height = drag->height = record->height;
+  drag->pending = False;
+  drag->last = 0;
 }
 
-static void event_buttonpress(XEvent *e) {
-  fprintf(stderr, "** (mouse)ButtonPress\n");
-  nwm_emit(onMouseDown, e);
-  GrabMouseRelease(e->xbutton.window);
+static void nwm_drag_apply(NodeWinMan *nwm) {
+  DragState *drag = &nwm->drag;
+  XMoveResizeWindow(nwm->dpy, drag->win, drag->x, drag->y,
+      drag->width - nwm->border_width * 2, drag->height - nwm->border_width * 2);
+  drag->pending = False;
+  drag->last = nwm_stats_now();
 }
 
-void GrabMouseRelease(Window id) {
-  // disabled for now
-  return;
-/*
-  XEvent ev;
-  int x, y;
-  Local<Value> argv[1];
+// ends the drag; the window is left where it was dragged to, if it is still managed
+static void nwm_drag_end(NodeWinMan *nwm) {
+  DragState *drag = &nwm->drag;
+  WinRecord *record = WinSet_get(&nwm->windows, drag->win);
+  nwm_mousedrag event_data;
 
-  if(XGrabPointer(nwm.dpy, nwm.root, False,
-    ButtonPressMask|ButtonReleaseMask|PointerMotionMask, GrabModeAsync,
-    GrabModeAsync, None, XCreateFontCursor(nwm.dpy, XC_fleur), CurrentTime) != GrabSuccess) {
+  if(record && drag->pending) {
+    nwm_drag_apply(nwm);
+  }
+  XUngrabPointer(nwm->dpy, CurrentTime);
+  XFreeCursor(nwm->dpy, drag->cursor);
+  XFlush(nwm->dpy);
+  drag->win = 0;
+  if(!record) {
     return;
   }
-  if(!nwm.getrootptr(&x, &y)) {
+  record->x = drag->x;
+  record->y = drag->y;
+  record->width = drag->width;
+  record->height = drag->height;
+  nwm->session_dirty = True;
+
+  event_data.id = record->id;
+  event_data.x = drag->start_x;
+  event_data.y = drag->start_y;
+  event_data.move_x = drag->x;
+  event_data.move_y = drag->y;
+  event_data.width = drag->width;
+  event_data.height = drag->height;
+  nwm_emit(nwm, onMouseDrag, (void *)&event_data);
+}
+
+int nwm_drag_timeout(NodeWinMan *nwm) {
+  DragState *drag = &nwm->drag;
+  unsigned long elapsed;
+  if(!drag->win || !drag->pending) {
+    return -1;
+  }
+  elapsed = nwm_stats_now() - drag->last;
+  if(elapsed >= nwm->frame_usec) {
+    return 0;
+  }
+  // rounded up, so that the step is due when the timer fires
+  return (nwm->frame_usec - elapsed + 999) / 1000;
+}
+
+void nwm_drag_flush(NodeWinMan *nwm) {
+  if(nwm_drag_timeout(nwm) != 0) {
     return;
   }
-  do{
-    XMaskEvent(nwm.dpy, ButtonPressMask|ButtonReleaseMask|PointerMotionMask|ExposureMask|SubstructureRedirectMask, &ev);
-    switch(ev.type) {
-      case ConfigureRequest:
-        // handle normally
-        break;
-      case Expose:
-        // handle normally
-        break;
-      case MapRequest:
-        // handle normally
-        break;
-      case MotionNotify:
-        {
-          argv[0] = NodeWM::makeMouseDrag(id, x, y, ev.xmotion.x, ev.xmotion.y); // , ev.state);
-          nwm.Emit(onMouseDrag, 1, argv);
-        }
-        break;
-    }
-  } while(ev.type != ButtonRelease);
+  if(!WinSet_get(&nwm->windows, nwm->drag.win)) {
+    nwm_drag_end(nwm); // the window went away meanwhile
+    return;
+  }
+  nwm_drag_apply(nwm);
+  XFlush(nwm->dpy);
+}
+
+// pointer motion is only selected while a drag has the pointer grabbed;
+// nwm_coalesce keeps the latest of a batch
+static void event_motionnotify(NodeWinMan *nwm, XEvent *e) {
+  XMotionEvent *ev = &e->xmotion;
+  DragState *drag = &nwm->drag;
+  int min_size = nwm->border_width * 2 + 1;
+
+  if(!drag->win) {
+    return;
+  }
+  if(!WinSet_get(&nwm->windows, drag->win)) {
+    nwm_drag_end(nwm); // the window went away meanwhile
+    return;
+  }
+  if(drag->button == Button1) {
+    drag->x = drag->start_x + ev->x_root - drag->x_root;
+    drag->y = drag->start_y + ev->y_root - drag->y_root;
+  } else {
+    drag->width = drag->start_width + ev->x_root - drag->x_root;
+    drag->height = drag->start_height + ev->y_root - drag->y_root;
+    drag->width = (drag->width < min_size ? min_size : drag->width);
+    drag->height = (drag->height < min_size ? min_size : drag->height);
+  }
+  drag->pending = True;
+  nwm_drag_flush(nwm);
+}
+
+static void event_buttonrelease(NodeWinMan *nwm, XEvent *e) {
+  if(nwm->drag.win && e->xbutton.button == nwm->drag.button) {
+    nwm_drag_end(nwm);
+  }
+}
 
-  XUngrabPointer(nwm.dpy, CurrentTime); */
+void nwm_set_drag_modifier(NodeWinMan *nwm, unsigned int mod) {
+  unsigned int i;
+  nwm->drag_modifier = mod;
+  if(!nwm->dpy) {
+    return; // grabbed when the windows are managed
+  }
+  WinSet_for_each(&nwm->windows, i) {
+    grabButtons(nwm, nwm->windows.slots[i].id, False);
+  }
+  XFlush(nwm->dpy);
 }
 
-static void event_clientmessage(XEvent *e) {
+static void event_clientmessage(NodeWinMan *nwm, XEvent *e) {
   XClientMessageEvent *cme = &e->xclient;
-  Atom NetWMState = XInternAtom(nwm.dpy, "_NET_WM_STATE", False);
-  Atom NetWMFullscreen = XInternAtom(nwm.dpy, "_NET_WM_STATE_FULLSCREEN", False);
+  Atom net_wm_state = nwm->atoms[NetWMState];
+  Atom net_wm_fullscreen = nwm->atoms[NetWMFullscreen];
   nwm_window_fullscreen event_data;
-
-  if(cme->message_type == NetWMState && cme->data.l[1] == NetWMFullscreen) {
+  WinRecord *record;
+  Bool fullscreen;
+
+  if(cme->message_type == net_wm_state
+  && ((Atom) cme->data.l[1] == net_wm_fullscreen || (Atom) cme->data.l[2] == net_wm_fullscreen)) {
+    record = WinSet_get(&nwm->windows, cme->window);
+    // _NET_WM_STATE_REMOVE (0), _NET_WM_STATE_ADD (1) or _NET_WM_STATE_TOGGLE (2)
+    fullscreen = (cme->data.l[0] == 1 || (cme->data.l[0] == 2 && !(record && record->fullscreen)));
+    if(record) {
+      if(record->fullscreen == fullscreen) {
+        return;
+      }
+      record->fullscreen = fullscreen;
+      nwm->session_dirty = True;
+    }
     event_data.id = cme->window;
-    if(cme->data.l[0]) {
-      XChangeProperty(nwm.dpy, cme->window, NetWMState, XA_ATOM, 32,
-                      PropModeReplace, (unsigned char*)&NetWMFullscreen, 1);
-      XRaiseWindow(nwm.dpy, cme->window);
+    if(fullscreen) {
+      XChangeProperty(nwm->dpy, cme->window, net_wm_state, XA_ATOM, 32,
+                      PropModeReplace, (unsigned char*)&net_wm_fullscreen, 1);
+      nwm_raise_window(nwm, cme->window);
       event_data.fullscreen = 1;
     }
     else {
-      XChangeProperty(nwm.dpy, cme->window, NetWMState, XA_ATOM, 32,
+      XChangeProperty(nwm->dpy, cme->window, net_wm_state, XA_ATOM, 32,
                       PropModeReplace, (unsigned char*)0, 0);
       event_data.fullscreen = 0;
     }
-    nwm_emit(onFullscreen, (void *)&event_data);
+    nwm_emit(nwm, onFullscreen, (void *)&event_data);
   }
 }
 
-static void event_configurerequest(XEvent *e) {
-  // only unknown windows are allowed to configure themselves.
-  // Node should call AllowReconfigure()or ConfigureNotify() + Move/Resize etc.
-  nwm_emit(onConfigureRequest, e);
+static void event_configurerequest(NodeWinMan *nwm, XEvent *e) {
+  XConfigureRequestEvent *ev = &e->xconfigurerequest;
+  WinRecord *record = WinSet_get(&nwm->windows, ev->window);
+  configure_policy policy = nwm_configure_policy_for(nwm, record);
+
+  if(policy == ConfigureForward) {
+    // Node should call configureWindow() or notifyWindow()
+    nwm_emit(nwm, onConfigureRequest, e);
+    return;
+  }
+  nwm->counters.configure_answered++;
+  if(policy == ConfigureDeny && record) {
+    nwm_log(NWM_LOG_DEBUG, "Deny configure request from %li\n", ev->window);
+    nwm_notify_window(nwm, ev->window, record->x, record->y,
+        record->width - nwm->border_width * 2, record->height - nwm->border_width * 2,
+        nwm->border_width, None, 0, 0);
+  } else {
+    nwm_log(NWM_LOG_DEBUG, "Allow configure request from %li\n", ev->window);
+    nwm_configure_window(nwm, ev->window, ev->x, ev->y, ev->width, ev->height,
+        ev->border_width, ev->above, ev->detail, ev->value_mask);
+  }
 }
 
-static void event_configurenotify(XEvent *e) {
+static void event_configurenotify(NodeWinMan *nwm, XEvent *e) {
   XConfigureEvent *ev = &e->xconfigure;
 
-  if(ev->window == nwm.root) {
-    nwm.screen_width = ev->width;
-    nwm.screen_height = ev->height;
-    // update monitor structures
-    nwm_scan_monitors();
-    fprintf(stderr, "* emit onRearrange\n");
-    nwm_emit(onRearrange, NULL);
+  if(ev->window == nwm->root) {
+    nwm->screen_width = ev->width;
+    nwm->screen_height = ev->height;
+    // with RandR, the monitors are tracked through its events
+    if(!nwm->randr) {
+      nwm_scan_monitors(nwm);
+    }
   }
 }
 
-static void event_destroynotify(XEvent *e) {
-  fprintf(stderr, "** DestroyNotify wid = %li \n", e->xdestroywindow.window);
-  nwm_remove_window(e->xdestroywindow.window, True);
+static void event_destroynotify(NodeWinMan *nwm, XEvent *e) {
+  nwm_log(NWM_LOG_DEBUG, "** DestroyNotify wid = %li \n", e->xdestroywindow.window);
+  nwm_remove_window(nwm, e->xdestroywindow.window, True);
 }
 
-static void event_enternotify(XEvent *e) {
-  fprintf(stderr, "** EnterNotify wid = %li \n", e->xcrossing.window);
-  if((e->xcrossing.mode != NotifyNormal || e->xcrossing.detail == NotifyInferior) && e->xcrossing.window != nwm.root)
+static void event_enternotify(NodeWinMan *nwm, XEvent *e) {
+  nwm_log(NWM_LOG_TRACE, "** EnterNotify wid = %li \n", e->xcrossing.window);
+  if((e->xcrossing.mode != NotifyNormal || e->xcrossing.detail == NotifyInferior) && e->xcrossing.window != nwm->root)
     return;
 
-  if(e->xcrossing.window == nwm.last_entered) {
+  if(e->xcrossing.window == nwm->last_entered) {
     return;
   }
 
   // there are two cases to handle:
   // 1) switching from a window to the root window (should change monitor, handled here)
   // 2) moving within a root window from empty monitor to empty monitor
-  if(e->xcrossing.window == nwm.root) {
-    nwm.last_entered = e->xcrossing.window;
-    nwm_emit(onEnterNotify, e);
+  if(e->xcrossing.window == nwm->root) {
+    nwm->last_entered = e->xcrossing.window;
+    nwm->pointer_x = e->xcrossing.x_root;
+    nwm->pointer_y = e->xcrossing.y_root;
+    nwm_emit(nwm, onEnterNotify, e);
     return;
   }
 
-  List* found = NULL;
-  List_search(nwm.windows, found, (void*) e->xcrossing.window);
   // don't care about enterNotify if it occurs on a non-managed window
-  if(found) {
-    fprintf(stderr, "* emit onEnterNotify wid = %li\n", e->xcrossing.window);
-    nwm.last_entered = e->xcrossing.window;
-    nwm_emit(onEnterNotify, e);
+  if(WinSet_get(&nwm->windows, e->xcrossing.window)) {
+    nwm_log(NWM_LOG_TRACE, "* emit onEnterNotify wid = %li\n", e->xcrossing.window);
+    nwm->last_entered = e->xcrossing.window;
+    nwm->pointer_x = e->xcrossing.x_root;
+    nwm->pointer_y = e->xcrossing.y_root;
+    // focus first, then let Node update its state
+    if(nwm->focus_follows_mouse) {
+      nwm_focus_window(nwm, e->xcrossing.window);
+    }
+    nwm_emit(nwm, onEnterNotify, e);
   }
 }
 
-static void event_focusin(XEvent *e) {
+static void event_focusin(NodeWinMan *nwm, XEvent *e) {
   XFocusChangeEvent *ev = &e->xfocus;
-  fprintf(stderr, "** FocusIn wid = %li\n", ev->window);
-  if(nwm.selected && ev->window != nwm.selected && nwm.selected != nwm.root){
-    List* found = NULL;
-    List_search(nwm.windows, found, (void*) ev->window);
+  nwm_log(NWM_LOG_TRACE, "** FocusIn wid = %li\n", ev->window);
+  if(nwm->selected && ev->window != nwm->selected && nwm->selected != nwm->root){
     // Preventing focus stealing
     // http://mail.gnome.org/archives/wm-spec-list/2003-May/msg00013.html
     // We will always revert the focus to whatever was last set by Node (e.g. enterNotify).
     // This prevents naughty applications from stealing the focus permanently.
-    if(found) {
+    if(WinSet_get(&nwm->windows, ev->window)) {
       // only revert if the change was to a top-level window that we manage
       // For instance, FF menus would otherwise get reverted..
-      fprintf(stderr, "Reverting focus change by window id %li to %li \n", ev->window, nwm.selected);
-      nwm_focus_window(nwm.selected);
+      nwm_log(NWM_LOG_DEBUG, "Reverting focus change by window id %li to %li \n", ev->window, nwm->selected);
+      nwm_focus_window(nwm, nwm->selected);
     }
   }
 }
 
-static void event_focusout(XEvent *e) {
+static void event_focusout(NodeWinMan *nwm, XEvent *e) {
   XFocusChangeEvent *ev = &e->xfocus;
-  fprintf(stderr, "** FocusOut wid = %li \n", ev->window);
-  if(nwm.selected && ev->window != nwm.selected){
-    List* found = NULL;
-    List_search(nwm.windows, found, (void*) ev->window);
-    if(found) {
-      fprintf(stderr, "changing border color on FocusOut");
-      XSetWindowBorder(nwm.dpy, ev->window, getcolor(nwm.normal_bg));
+  nwm_log(NWM_LOG_TRACE, "** FocusOut wid = %li \n", ev->window);
+  if(nwm->selected && ev->window != nwm->selected){
+    if(WinSet_get(&nwm->windows, ev->window)) {
+      nwm_log(NWM_LOG_TRACE, "changing border color on FocusOut\n");
+      XSetWindowBorder(nwm->dpy, ev->window, nwm->normal_pixel);
     }
   }
 }
 
-static void event_keypress(XEvent *e) {
-  KeySym keysym;
-  XKeyEvent *ev;
-
-  ev = &e->xkey;
-  keysym = XKeycodeToKeysym(nwm.dpy, (KeyCode)ev->keycode, 0);
-
+static void event_keypress(NodeWinMan *nwm, XEvent *e) {
+  XKeyEvent *ev = &e->xkey;
+  Key *key = nwm_find_key(nwm, ev->keycode, ev->state);
   nwm_keypress event_data;
+
+  if(!key) {
+    nwm_log(NWM_LOG_DEBUG, "No binding for keycode %d state %d\n", ev->keycode, ev->state);
+    return;
+  }
   // we always unset numlock and LockMask since those should not matter
+  event_data.id = key->id;
   event_data.x = ev->x;
   event_data.y = ev->y;
   event_data.keycode = ev->keycode;
-  event_data.keysym = keysym;
-  event_data.modifier = (ev->state & ~(nwm.numlockmask|LockMask));
+  event_data.keysym = key->keysym;
+  event_data.modifier = (ev->state & ~(nwm->numlockmask|LockMask));
 
   // call the callback in Node.js, passing the window object...
-  nwm_emit(onKeyPress, (void *)&event_data);
+  nwm_emit(nwm, onKeyPress, (void *)&event_data);
+}
+
+static void event_mappingnotify(NodeWinMan *nwm, XEvent *e) {
+  XMappingEvent *ev = &e->xmapping;
+  List *item = NULL;
+  int first = ev->first_keycode, last = ev->first_keycode + ev->count;
+
+  XRefreshKeyboardMapping(ev);
+  if(ev->request == MappingModifier) {
+    // the num lock mask may have moved, which changes every grab
+    nwm_grab_keys(nwm);
+    return;
+  }
+  if(ev->request != MappingKeyboard) {
+    return;
+  }
+  // only rebind the keys whose keycode is in the changed range, or whose
+  // keysym is now found there
+  List_for_each(item, nwm->keys) {
+    Key *key = (Key *)item->data;
+    KeyCode keycode = XKeysymToKeycode(nwm->dpy, key->keysym);
+    if(keycode == key->keycode) {
+      continue;
+    }
+    if((key->keycode >= first && key->keycode < last) || (keycode >= first && keycode < last)) {
+      nwm_log(NWM_LOG_DEBUG, "Rebind keysym %li: keycode %d -> %d\n", key->keysym, key->keycode, keycode);
+      nwm_unbind_key(nwm, key);
+      nwm_bind_key(nwm, key);
+    }
+  }
 }
 
-static void event_maprequest(XEvent *e) {
-  // read the window attrs, then add it to the managed windows...
-  XWindowAttributes wa;
+static void event_maprequest(NodeWinMan *nwm, XEvent *e) {
+  // read the window attrs, hints, title and class in one go (unless the reader
+  // thread already did), then add it to the managed windows...
+  nwm_window_info fetched, *info;
   XMapRequestEvent *ev = &e->xmaprequest;
-  if(!XGetWindowAttributes(nwm.dpy, ev->window, &wa)) {
-    fprintf(stderr, "XGetWindowAttributes failed\n");
+  if(!(info = nwm_prefetched(nwm, ev->window, FETCH_MAP))) {
+    info = &fetched;
+    nwm->round_trips += nwm_fetch_windows(nwm->dpy, &nwm->fetch_atoms, &ev->window, 1, FETCH_MAP, info);
+  }
+  if(!info->ok) {
+    nwm_log(NWM_LOG_WARN, "XGetWindowAttributes failed\n");
     return;
   }
-  if(wa.override_redirect)
+  if(info->wa.override_redirect)
     return;
-  fprintf(stderr, "** MapRequest\n");
-  List* found = NULL;
-  List_search(nwm.windows, found, (void*) ev->window);
-  if(!found) {
+  nwm_log(NWM_LOG_DEBUG, "** MapRequest\n");
+  if(!WinSet_get(&nwm->windows, ev->window)) {
     // only map new windows
-    nwm_add_window(ev->window, &wa);
-    // emit a rearrange
-    fprintf(stderr, "* emit onRearrange\n");
-    nwm_emit(onRearrange, NULL);
+    nwm_add_window(nwm, info);
+    // suggest a rearrange (once per batch) of the monitor Node puts it on
+    nwm_rearrange(nwm, nwm_monitor_at(nwm, nwm->pointer_x, nwm->pointer_y));
   } else {
-    fprintf(stderr, "Window is known\n");
+    // including hidden windows, which stay hidden until their workspace is shown
+    nwm_log(NWM_LOG_DEBUG, "Window is known\n");
   }
 }
 
-static void event_propertynotify(XEvent *e) {
-  XPropertyEvent *ev = &e->xproperty;
-  // could be used for tracking hints, transient status and window name
-  if((ev->window == nwm.root) && (ev->atom == XA_WM_NAME)) {
-    // the root window name has changed
-  } else if(ev->state == PropertyDelete) {
-    return; // ignore property deletes
-  } else {
-    Atom NetWMName = XInternAtom(nwm.dpy, "_NET_WM_NAME", False);
-    if(ev->atom == XA_WM_NAME || ev->atom == NetWMName) {
-      nwm_update_window(ev->window); // update title and class
-    }
+static void event_propertynotify(NodeWinMan *nwm, XEvent *e) {
+  Window win;
+  // could be used for tracking hints, transient status and window name;
+  // the properties that matter are listed in nwm_fetch_flags_for
+  unsigned int flags = nwm_fetch_flags_for(nwm, e, &win);
+  if(flags == FetchStrut) {
+    nwm_update_strut(nwm, win);
+  } else if(flags) {
+    nwm_update_window(nwm, win, flags);
   }
 }
 
-static void event_unmapnotify(XEvent *e) {
-  fprintf(stderr, "** UnmapNotify wid = %li \n", e->xunmap.window);
-  List *item = NULL;
-  List_search(nwm.windows, item, (void*) e->xunmap.window);
-  if(item) {
-    if(e->xunmap.send_event)
-      setclientstate(e->xunmap.window, WithdrawnState);
-    else
-      nwm_remove_window(e->xunmap.window, False);
+// Managed windows are handled on MapRequest; an override_redirect window
+// only matters if it reserves space, e.g. a panel that is not managed.
+// Its strut changes are followed like those of managed windows.
+static void event_mapnotify(NodeWinMan *nwm, XEvent *e) {
+  XMapEvent *ev = &e->xmap;
+  if(!ev->override_redirect || ev->event != nwm->root) {
+    return;
+  }
+  nwm_update_strut(nwm, ev->window);
+  if(nwm_find_strut(nwm, ev->window)) {
+    nwm_track_begin(nwm, ev->window);
+    XSelectInput(nwm->dpy, ev->window, PropertyChangeMask);
+    nwm_track_end(nwm);
+  }
+}
+
+static void event_unmapnotify(NodeWinMan *nwm, XEvent *e) {
+  WinRecord *record = WinSet_get(&nwm->windows, e->xunmap.window);
+  nwm_log(NWM_LOG_DEBUG, "** UnmapNotify wid = %li \n", e->xunmap.window);
+  if(!record) {
+    // e.g. a panel that is not managed
+    nwm_set_strut(nwm, e->xunmap.window, NULL);
+  } else {
+    if(e->xunmap.send_event) {
+      setclientstate(nwm, e->xunmap.window, WithdrawnState);
+      // a hidden window is already unmapped, so no real UnmapNotify follows
+      if(record->hidden)
+        nwm_remove_window(nwm, e->xunmap.window, False);
+    } else if(e->xunmap.serial == record->unmap_serial) {
+      // caused by nwm_switch_workspace (reported on the root and on the window)
+      nwm_log(NWM_LOG_TRACE, "Ignoring UnmapNotify of hidden window %li\n", e->xunmap.window);
+    } else {
+      nwm_remove_window(nwm, e->xunmap.window, False);
+    }
   }
 }
 
-void setclientstate(Window win, long state) {
+// sets the ICCCM WM_STATE of a managed window
+void setclientstate(NodeWinMan *nwm, Window win, long state) {
   long data[] = { state, None };
-  Atom NetWMState = XInternAtom(nwm.dpy, "_NET_WM_STATE", False);
 
-  XChangeProperty(nwm.dpy, win, NetWMState, NetWMState, 32,
+  XChangeProperty(nwm->dpy, win, nwm->atoms[WMState], nwm->atoms[WMState], 32,
       PropModeReplace, (unsigned char *)data, 2);
 }
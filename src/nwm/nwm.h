@@ -3,19 +3,42 @@
 
 // EXTERNAL API
 
-// this should initialize everything except keys
-extern int nwm_init();
+// All the state of one window manager, i.e. of one display. Every function
+// below takes the instance it acts on, so one process can manage several
+// displays; each runs its own nwm_loop (or reader thread) on its connection.
+typedef struct NodeWinMan NodeWinMan;
+
+// a new instance with the default settings, or NULL if it cannot be allocated;
+// nothing is connected until nwm_init
+extern NodeWinMan* nwm_new();
+// stops the reader thread and closes the connection (if any), then frees the instance
+extern void nwm_free(NodeWinMan *nwm);
+// passed back to the emit and wake functions, e.g. the binding object of the instance
+extern void nwm_set_data(NodeWinMan *nwm, void *data);
+extern void* nwm_get_data(NodeWinMan *nwm);
+
+// this should initialize everything except keys; display is e.g. ":1", NULL
+// for $DISPLAY. Returns the connection number, or -1 if the display cannot be
+// opened (the instance can then be freed, or initialized again).
+extern int nwm_init(NodeWinMan *nwm, const char *display);
 
 typedef struct Key Key;
 struct Key {
   unsigned int mod;
   KeySym keysym;
+  // binding id reported in onKeyPress
+  unsigned int id;
+  // keycode the keysym is currently grabbed on (0 if it has none)
+  KeyCode keycode;
+  // next key with the same keycode in the dispatch table
   Key* next;
 };
 
 // initialize keys
-extern void nwm_empty_keys();
-extern void nwm_add_key(KeySym keysym, unsigned int mod);
+extern void nwm_empty_keys(NodeWinMan *nwm);
+extern void nwm_add_key(NodeWinMan *nwm, KeySym keysym, unsigned int mod, unsigned int id);
+// (re)grab the keys; called by nwm_init(), call again after changing the keys
+extern void nwm_grab_keys(NodeWinMan *nwm);
 
 // known callbacks
 enum callback_map {
@@ -32,30 +55,161 @@ enum callback_map {
   onKeyPress,
   onEnterNotify,
   onFullscreen,
+  onAdoptWindows,
   onLast
 };
 typedef enum callback_map callback_map;
 
+// EWMH/ICCCM atoms, interned once in nwm_init()
+enum atom_map {
+  WMProtocols,
+  WMDelete,
+  WMTakeFocus,
+  NetWMName,
+  NetWMState,
+  NetWMFullscreen,
+  WMState,
+  NetSupported,
+  NetClientList,
+  NetActiveWindow,
+  NetWorkarea,
+  NetWMStrutPartial,
+  NetWMStrut,
+  atomLast
+};
+typedef enum atom_map atom_map;
+
+extern Atom nwm_get_atom(NodeWinMan *nwm, atom_map atom);
+extern const char* nwm_get_atom_name(atom_map atom);
+
 
 // initialize the function that gets called when events are emitted
-extern void nwm_set_emit_function(void (*callback)(callback_map event, void *ev));
+extern void nwm_set_emit_function(NodeWinMan *nwm, void (*callback)(NodeWinMan *nwm, callback_map event, void *ev));
 
 // this should be called each time we want to process events/
 // that might be because of libev or manually
-extern void nwm_loop();
+extern void nwm_loop(NodeWinMan *nwm);
+
+// Threaded mode: a reader thread blocks in XNextEvent, makes the fetches the
+// handlers need and passes both to the main thread through a lock-free ring.
+// nwm_init_threads must be called once per process before any display is
+// opened (Xlib requires XInitThreads to be its first call), and
+// nwm_set_threaded before nwm_init. nwm_start_reader starts the
+// thread, which calls wake whenever there are events; the main thread then
+// calls nwm_drain (instead of nwm_loop). Returns 0 on success, -1 otherwise.
+extern int nwm_init_threads();
+extern void nwm_set_threaded(NodeWinMan *nwm, int enabled);
+extern int nwm_start_reader(NodeWinMan *nwm, void (*wake)(NodeWinMan *nwm));
+extern void nwm_drain(NodeWinMan *nwm);
+// stops and joins the reader thread, if it runs; what it read but the main
+// thread did not drain yet is dropped. Called by nwm_free, and before the
+// wake function stops working.
+extern void nwm_stop_reader(NodeWinMan *nwm);
+
+typedef struct {
+  // events read from the server
+  unsigned long events;
+  // nwm_loop batches dispatched
+  unsigned long batches;
+  // events dropped because a later event in the same batch superseded them
+  unsigned long dropped;
+  // configure requests and rearranges folded into a later one
+  unsigned long merged;
+  // windows adopted when nwm started, and how long adopting them took
+  unsigned long adopted;
+  unsigned long adopt_usec;
+  // configure requests answered by the configure policy instead of JS
+  unsigned long configure_answered;
+} nwm_counters;
+
+extern void nwm_get_counters(NodeWinMan *nwm, nwm_counters *counters);
 
+// Hot restart: the managed windows are kept in a snapshot file (see session.h)
+// that the next nwm started on the display takes the windows over from.
+// nwm_set_session_file must be called before nwm_init; returns 0 on success,
+// -1 if the file cannot be created or mapped. nwm_get_session_state returns
+// the JS state the previous instance saved, or NULL. nwm_save_session stores
+// the JS state (returns -1 if it does not fit), nwm_flush_session rewrites the
+// window list if it changed.
+extern int nwm_set_session_file(NodeWinMan *nwm, const char *path);
+extern const char* nwm_get_session_state(NodeWinMan *nwm);
+extern int nwm_save_session(NodeWinMan *nwm, const char *state, unsigned long length);
+extern void nwm_flush_session(NodeWinMan *nwm);
+// name of an X event type, e.g. "MapRequest"
+extern const char* nwm_get_event_name(int type);
 
-extern void nwm_move_window(Window win, int x, int y);
-extern void nwm_resize_window(Window win, int width, int height);
-extern void nwm_focus_window(Window win);
-extern void nwm_kill_window(Window win);
-extern void nwm_configure_window(Window win, int x, int y, int width, int height, \
+
+extern void nwm_move_window(NodeWinMan *nwm, Window win, int x, int y);
+extern void nwm_resize_window(NodeWinMan *nwm, Window win, int width, int height);
+extern void nwm_focus_window(NodeWinMan *nwm, Window win);
+// focus managed windows natively on EnterNotify, before onEnterNotify is emitted
+extern void nwm_set_focus_follows_mouse(NodeWinMan *nwm, int enabled);
+// windows can be moved (Button1) and resized (Button3) while mod is held; 0 disables
+extern void nwm_set_drag_modifier(NodeWinMan *nwm, unsigned int mod);
+// A drag steps at most once per frame of the fastest monitor. nwm_drag_timeout
+// returns in how many ms a held back step is due (0: now), -1 if none is;
+// nwm_drag_flush applies it once it is due. Call it from a timer, or the
+// window lags the pointer until the next motion.
+extern int nwm_drag_timeout(NodeWinMan *nwm);
+extern void nwm_drag_flush(NodeWinMan *nwm);
+extern void nwm_kill_window(NodeWinMan *nwm, Window win);
+// stacks the windows in ids in that order (bottom to top), with as few requests as possible
+extern void nwm_restack(NodeWinMan *nwm, Window *ids, unsigned int count);
+// the managed windows, bottom to top; valid until the next call into nwm
+extern const Window* nwm_get_stacking(NodeWinMan *nwm, unsigned int *count);
+// returns 0 on success, -1 if either color cannot be allocated
+extern int nwm_set_border_colors(NodeWinMan *nwm, const char *normal, const char *active);
+// one entry of a batched layout; width and height include the border
+typedef struct {
+  Window id;
+  int x;
+  int y;
+  int width;
+  int height;
+  // which of x, y, width and height are set (CWX|CWY|CWWidth|CWHeight);
+  // unset fields keep their last applied value
+  unsigned int value_mask;
+  // border width, or -1 for the default
+  int border_width;
+  // stack mode (Above, Below, ...), or -1 to leave the stacking order alone
+  int stack;
+} nwm_geometry;
+
+// apply the geometry of many windows, skipping unchanged ones, with a single flush
+extern void nwm_apply_layout(NodeWinMan *nwm, nwm_geometry *geometry, unsigned int count);
+// Swaps the visible window sets, e.g. for a workspace switch: applies geometry,
+// maps the windows in show and unmaps the ones in hide (which stay managed, in
+// IconicState) with the server grabbed, and flushes once.
+extern void nwm_switch_workspace(NodeWinMan *nwm, Window *hide, unsigned int hide_count,
+    Window *show, unsigned int show_count, nwm_geometry *geometry, unsigned int count);
+extern void nwm_configure_window(NodeWinMan *nwm, Window win, int x, int y, int width, int height, \
     int border_width, int above, int detail, int value_mask);
-extern void nwm_notify_window(Window win, int x, int y, int width, int height, \
+extern void nwm_notify_window(NodeWinMan *nwm, Window win, int x, int y, int width, int height, \
     int border_width, int above, int detail, int value_mask);
 
+// How ConfigureRequests are answered without a round trip to JS:
+// allow applies the request, deny sends back the current geometry (managed
+// windows only; unmanaged windows are not tiled, so deny acts as allow there)
+// and forward emits onConfigureRequest as before.
+enum configure_policy {
+  ConfigureForward,
+  ConfigureAllow,
+  ConfigureDeny,
+  configureLast
+};
+typedef enum configure_policy configure_policy;
+
+extern int nwm_configure_policy_lookup(const char *name);
+// policies by kind of window; all forward by default
+extern void nwm_set_configure_policy(NodeWinMan *nwm, configure_policy unmanaged, configure_policy floating, configure_policy tiled);
+// per-class overrides (WM_CLASS class name) take precedence over the kind;
+// returns 0 on success, -1 if there are too many rules
+extern int nwm_add_configure_rule(NodeWinMan *nwm, const char *klass, configure_policy policy);
+extern void nwm_clear_configure_rules(NodeWinMan *nwm);
+
 typedef struct {
-  // keypress
+  // keypress; only emitted for bound keys
+  unsigned int id;
   int x;
   int y;
   unsigned int keycode;
@@ -64,13 +218,16 @@ typedef struct {
 } nwm_keypress;
 
 typedef struct {
-  // mousegdrag
+  // mousedrag: emitted once, when an interactive move or resize ends.
+  // x, y is where the window started, move_x, move_y where it ended;
+  // width and height are the final size including the border
   Window id;
   int x;
   int y;
   int move_x;
   int move_y;
-
+  int width;
+  int height;
 } nwm_mousedrag;
 
 typedef struct {
@@ -80,6 +237,11 @@ typedef struct {
   int y;
   int width;
   int height;
+  // the part of it not reserved by _NET_WM_STRUT(_PARTIAL), e.g. by panels
+  int workarea_x;
+  int workarea_y;
+  int workarea_width;
+  int workarea_height;
 } nwm_monitor;
 
 typedef struct {
@@ -90,6 +252,8 @@ typedef struct {
   int width;
   int height;
   Bool isfloating;
+  // adoptWindows only: restored from a session snapshot as a hidden window
+  Bool hidden;
 } nwm_window;
 
 typedef struct {
@@ -106,6 +270,19 @@ typedef struct {
   char* klass;
 } nwm_window_title;
 
+typedef struct {
+  // adoptWindows: the windows found at startup, in adoption order
+  unsigned int count;
+  nwm_window *windows;
+  nwm_window_title *titles;
+} nwm_adopt;
+
+typedef struct {
+  // rearrange: the ids of the monitors whose current workspace needs a new layout
+  unsigned int count;
+  int *monitors;
+} nwm_rearrange_monitors;
+
 typedef struct {
   // window
   int id;
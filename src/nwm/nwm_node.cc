@@ -4,41 +4,90 @@
 
 extern "C" {
   #include "nwm.h"
+  #include "layout.h"
+  #include "log.h"
+  #include "stats.h"
 }
 
 using namespace node;
 using namespace v8;
 
 static void EIO_Loop(uv_poll_t* handle, int status, int events);
+static void EIO_Drain(uv_async_t* handle, int status);
+static void Wake(NodeWinMan *nwm);
+static void EIO_FlushLog(uv_timer_t* handle, int status);
+static void HandleClosed(uv_handle_t* handle);
+static void EIO_DragStep(uv_timer_t* handle, int status);
 
-// callback storage
-Persistent<Function>* callbacks[onLast];
-ev_io watcher;
+#define RAW_FIELDS 8
+
+// One window manager: the native core plus its callbacks and loop handles.
+// The module itself is bound to a default instance, create() makes more.
+struct Instance {
+  NodeWinMan *nwm;
+  // callback storage
+  Persistent<Function>* callbacks[onLast];
+  // batch mode: events collected during one loop tick, delivered with a single call;
+  // the rearrange goes last, for the monitors of every rearrange in the tick
+  Persistent<Function>* batch_callback;
+  Persistent<v8::Array> batch_events;
+  Persistent<v8::Array> batch_rearrange;
+  // raw mode, see MakeRawEvent
+  bool raw_events;
+  int32_t raw_data[onLast][RAW_FIELDS];
+  Persistent<Object> raw_payloads[onLast];
+  // the connection, or the reader thread's signal in threaded mode
+  uv_poll_t poll;
+  uv_async_t drain;
+  uv_timer_t timer;
+  // applies a held back drag step, see ScheduleDrag
+  uv_timer_t drag_timer;
+  // between start() and stop(); threaded if drain is used instead of poll
+  bool started;
+  bool threaded;
+  // handles stop() closed that libuv has not released yet
+  int closing;
+};
+
+static Instance* NewInstance() {
+  Instance *self = new Instance();
+  self->nwm = nwm_new();
+  nwm_set_data(self->nwm, self);
+  self->batch_events = Persistent<v8::Array>::New(v8::Array::New());
+  return self;
+}
+
+// the instance a function was bound to by Bind()
+static Instance* Self(const Arguments& args) {
+  return static_cast<Instance*>(Local<External>::Cast(args.Data())->Value());
+}
+
+// callback names, indexed by callback_map
+static const char *callback_names[onLast] = {
+  "addMonitor",
+  "updateMonitor",
+  "removeMonitor",
+  "addWindow",
+  "updateWindow",
+  "removeWindow",
+  "rearrange",
+  "mouseDown",
+  "mouseDrag",
+  "configureRequest",
+  "keyPress",
+  "enterNotify",
+  "fullscreen",
+  "adoptWindows"
+};
 
 // EVENTS
 static Handle<Value> OnCallback(const Arguments& args) {
   HandleScope scope;
 
-  v8::Local<v8::String> map[onLast+1] = {
-      v8::String::New("addMonitor"),
-      v8::String::New("updateMonitor"),
-      v8::String::New("removeMonitor"),
-      v8::String::New("addWindow"),
-      v8::String::New("updateWindow"),
-      v8::String::New("removeWindow"),
-      v8::String::New("rearrange"),
-      v8::String::New("mouseDown"),
-      v8::String::New("mouseDrag"),
-      v8::String::New("configureRequest"),
-      v8::String::New("keyPress"),
-      v8::String::New("enterNotify"),
-      v8::String::New("fullscreen")
-    };
-
   v8::Local<v8::String> value = Local<v8::String>::Cast(args[0]);
   int selected = -1;
   for(int i = 0; i < onLast; i++) {
-    if( strcmp(*v8::String::AsciiValue(value),  *v8::String::AsciiValue(map[i])) == 0 ) {
+    if( strcmp(*v8::String::AsciiValue(value), callback_names[i]) == 0 ) {
       selected = i;
       break;
     }
@@ -47,127 +96,390 @@ static Handle<Value> OnCallback(const Arguments& args) {
     return Undefined();
   }
   // store function
-  callbacks[selected] = cb_persist(args[1]);
+  Self(args)->callbacks[selected] = cb_persist(args[1]);
 
   return Undefined();
 }
 
-#define INT_FIELD(name, value) \
-    o->Set(String::NewSymbol(#name), Integer::New(value))
+// Field name symbols, created once at init
+enum field_map {
+  fieldId,
+  fieldX,
+  fieldY,
+  fieldWidth,
+  fieldHeight,
+  fieldIsfloating,
+  fieldFullscreen,
+  fieldTitle,
+  fieldInstance,
+  fieldClass,
+  fieldButton,
+  fieldState,
+  fieldMoveX,
+  fieldMoveY,
+  fieldAbove,
+  fieldDetail,
+  fieldValueMask,
+  fieldKeysym,
+  fieldKeycode,
+  fieldModifier,
+  fieldXRoot,
+  fieldYRoot,
+  fieldType,
+  fieldWindows,
+  fieldHidden,
+  fieldMonitors,
+  fieldWorkarea,
+  fieldBorder,
+  fieldStack,
+  fieldLast
+};
 
-static void Emit(callback_map event, void *ev) {
+static const char *field_names[fieldLast] = {
+  "id", "x", "y", "width", "height", "isfloating", "fullscreen",
+  "title", "instance", "class", "button", "state", "move_x", "move_y",
+  "above", "detail", "value_mask", "keysym", "keycode", "modifier",
+  "x_root", "y_root", "type", "windows",
+  "hidden", "monitors", "workarea", "border", "stack"
+};
 
+static Persistent<String> fields[fieldLast];
+static Persistent<String> callback_symbols[onLast];
 
-  Local<Object> o = Object::New();
+// Payload shapes. Every payload is instantiated from a template with all of
+// its fields predefined, so payloads of one kind share a hidden class.
+enum payload_map {
+  payloadMonitor,
+  payloadWindow,
+  payloadFullscreen,
+  payloadRemove,
+  payloadTitle,
+  payloadMouseDown,
+  payloadMouseDrag,
+  payloadConfigure,
+  payloadKeyPress,
+  payloadCrossing,
+  payloadAdopt,
+  payloadAdopted,
+  payloadRearrange,
+  payloadLast
+};
+
+static Persistent<ObjectTemplate> templates[payloadLast];
+
+static payload_map payload_for[onLast] = {
+  payloadMonitor, // onAddMonitor
+  payloadMonitor, // onUpdateMonitor
+  payloadMonitor, // onRemoveMonitor
+  payloadWindow, // onAddWindow
+  payloadTitle, // onUpdateWindow
+  payloadRemove, // onRemoveWindow
+  payloadRearrange, // onRearrange
+  payloadMouseDown, // onMouseDown
+  payloadMouseDrag, // onMouseDrag
+  payloadConfigure, // onConfigureRequest
+  payloadKeyPress, // onKeyPress
+  payloadCrossing, // onEnterNotify
+  payloadFullscreen, // onFullscreen
+  payloadAdopt // onAdoptWindows
+};
+
+static void MakeTemplate(payload_map payload, const field_map *names, int count) {
+  Local<ObjectTemplate> t = ObjectTemplate::New();
+  for(int i = 0; i < count; i++) {
+    bool is_string = (names[i] == fieldTitle || names[i] == fieldInstance || names[i] == fieldClass);
+    if(names[i] == fieldWorkarea) {
+      // an object, filled in per payload
+      t->Set(fields[names[i]], Null());
+      continue;
+    }
+    t->Set(fields[names[i]], (is_string ? (Handle<Value>) String::Empty() : (Handle<Value>) Integer::New(0)));
+  }
+  templates[payload] = Persistent<ObjectTemplate>::New(t);
+}
+
+static void InitTemplates() {
+  for(int i = 0; i < fieldLast; i++) {
+    fields[i] = Persistent<String>::New(String::NewSymbol(field_names[i]));
+  }
+  for(int i = 0; i < onLast; i++) {
+    callback_symbols[i] = Persistent<String>::New(String::NewSymbol(callback_names[i]));
+  }
+  const field_map monitor[] = { fieldId, fieldX, fieldY, fieldWidth, fieldHeight, fieldWorkarea };
+  const field_map window[] = { fieldId, fieldX, fieldY, fieldWidth, fieldHeight, fieldIsfloating };
+  const field_map fullscreen[] = { fieldId, fieldFullscreen };
+  const field_map remove[] = { fieldId };
+  const field_map title[] = { fieldId, fieldTitle, fieldInstance, fieldClass };
+  const field_map mousedown[] = { fieldId, fieldX, fieldY, fieldButton, fieldState };
+  const field_map mousedrag[] = { fieldId, fieldX, fieldY, fieldMoveX, fieldMoveY, fieldWidth, fieldHeight };
+  const field_map configure[] = { fieldId, fieldX, fieldY, fieldWidth, fieldHeight,
+    fieldAbove, fieldDetail, fieldValueMask };
+  const field_map keypress[] = { fieldId, fieldX, fieldY, fieldKeysym, fieldKeycode, fieldModifier };
+  const field_map crossing[] = { fieldId, fieldX, fieldY, fieldXRoot, fieldYRoot };
+  const field_map adopt[] = { fieldWindows };
+  const field_map rearrange[] = { fieldMonitors };
+  const field_map adopted[] = { fieldId, fieldX, fieldY, fieldWidth, fieldHeight, fieldIsfloating,
+    fieldTitle, fieldInstance, fieldClass, fieldHidden };
+  MakeTemplate(payloadMonitor, monitor, 6);
+  MakeTemplate(payloadWindow, window, 6);
+  MakeTemplate(payloadFullscreen, fullscreen, 2);
+  MakeTemplate(payloadRemove, remove, 1);
+  MakeTemplate(payloadTitle, title, 4);
+  MakeTemplate(payloadMouseDown, mousedown, 5);
+  MakeTemplate(payloadMouseDrag, mousedrag, 7);
+  MakeTemplate(payloadConfigure, configure, 8);
+  MakeTemplate(payloadKeyPress, keypress, 6);
+  MakeTemplate(payloadCrossing, crossing, 5);
+  MakeTemplate(payloadAdopt, adopt, 1);
+  MakeTemplate(payloadAdopted, adopted, 10);
+  MakeTemplate(payloadRearrange, rearrange, 1);
+}
+
+// Raw mode: enterNotify, mouseDrag and configureRequest receive one reused
+// object whose indexed elements are backed by native int32 storage, so the
+// high-rate events allocate nothing. The layouts are
+//   enterNotify:      [id, x, y, x_root, y_root]
+//   mouseDrag:        [id, x, y, move_x, move_y, width, height]
+//   configureRequest: [id, x, y, width, height, above, detail, value_mask]
+
+// returns true if event is delivered as a raw payload in raw mode
+static bool IsRawEvent(callback_map event) {
+  return (event == onEnterNotify || event == onMouseDrag || event == onConfigureRequest);
+}
+
+static Local<Object> MakeRawEvent(Instance *self, callback_map event, void *ev) {
+  int32_t* d = self->raw_data[event];
+  switch(event) {
+    case onEnterNotify:
+      {
+        XCrossingEvent* e = (XCrossingEvent*) ev;
+        d[0] = e->window; d[1] = e->x; d[2] = e->y; d[3] = e->x_root; d[4] = e->y_root;
+      }
+      break;
+    case onMouseDrag:
+      {
+        nwm_mousedrag* e = (nwm_mousedrag*) ev;
+        d[0] = e->id; d[1] = e->x; d[2] = e->y; d[3] = e->move_x; d[4] = e->move_y;
+        d[5] = e->width; d[6] = e->height;
+      }
+      break;
+    case onConfigureRequest:
+      {
+        XConfigureRequestEvent* e = (XConfigureRequestEvent*) ev;
+        d[0] = e->window; d[1] = e->x; d[2] = e->y; d[3] = e->width; d[4] = e->height;
+        d[5] = e->above; d[6] = e->detail; d[7] = e->value_mask;
+      }
+      break;
+    default:
+      break;
+  }
+  if(self->raw_payloads[event].IsEmpty()) {
+    Local<Object> o = Object::New();
+    o->SetIndexedPropertiesToExternalArrayData(d, kExternalIntArray, RAW_FIELDS);
+    self->raw_payloads[event] = Persistent<Object>::New(o);
+  }
+  return Local<Object>::New(self->raw_payloads[event]);
+}
+
+#define INT_FIELD(name, value) \
+    o->Set(fields[name], Integer::New(value))
+
+static Local<Object> MakeEvent(callback_map event, void *ev) {
+  Local<Object> o = templates[payload_for[event]]->NewInstance();
   switch(event) {
     case onAddMonitor:
     case onUpdateMonitor:
     case onRemoveMonitor:
       {
         nwm_monitor* e = (nwm_monitor*) ev;
-        INT_FIELD(id, e->id);
-        INT_FIELD(x, e->x);
-        INT_FIELD(y, e->y);
-        INT_FIELD(width, e->width);
-        INT_FIELD(height, e->height);
+        Local<Object> workarea = Object::New();
+        INT_FIELD(fieldId, e->id);
+        INT_FIELD(fieldX, e->x);
+        INT_FIELD(fieldY, e->y);
+        INT_FIELD(fieldWidth, e->width);
+        INT_FIELD(fieldHeight, e->height);
+        // { x, y, width, height }, which can be passed to layout() as is
+        workarea->Set(fields[fieldX], Integer::New(e->workarea_x));
+        workarea->Set(fields[fieldY], Integer::New(e->workarea_y));
+        workarea->Set(fields[fieldWidth], Integer::New(e->workarea_width));
+        workarea->Set(fields[fieldHeight], Integer::New(e->workarea_height));
+        o->Set(fields[fieldWorkarea], workarea);
       }
       break;
     case onAddWindow:
-    case onFullscreen:
       {
         nwm_window* e = (nwm_window*) ev;
-        INT_FIELD(id, e->id);
-        INT_FIELD(x, e->x);
-        INT_FIELD(y, e->y);
-        INT_FIELD(width, e->width);
-        INT_FIELD(height, e->height);
-        INT_FIELD(isfloating, e->isfloating);
+        INT_FIELD(fieldId, e->id);
+        INT_FIELD(fieldX, e->x);
+        INT_FIELD(fieldY, e->y);
+        INT_FIELD(fieldWidth, e->width);
+        INT_FIELD(fieldHeight, e->height);
+        INT_FIELD(fieldIsfloating, e->isfloating);
+      }
+      break;
+    case onFullscreen:
+      {
+        nwm_window_fullscreen* e = (nwm_window_fullscreen*) ev;
+        INT_FIELD(fieldId, e->id);
+        INT_FIELD(fieldFullscreen, e->fullscreen);
       }
       break;
     case onRemoveWindow:
       {
         nwm_window* e = (nwm_window*) ev;
-        INT_FIELD(id, e->id);
+        INT_FIELD(fieldId, e->id);
       }
       break;
     case onUpdateWindow:
       {
         nwm_window_title* e = (nwm_window_title*) ev;
-        INT_FIELD(id, e->id);
-        o->Set(String::NewSymbol("title"), String::New(e->title));
-        o->Set(String::NewSymbol("instance"), String::New(e->instance));
-        o->Set(String::NewSymbol("class"), String::New(e->klass));
+        INT_FIELD(fieldId, e->id);
+        o->Set(fields[fieldTitle], String::New(e->title));
+        o->Set(fields[fieldInstance], String::New(e->instance));
+        o->Set(fields[fieldClass], String::New(e->klass));
       }
       break;
     case onRearrange:
+      {
+        // { monitors: [id, ...] }
+        nwm_rearrange_monitors* e = (nwm_rearrange_monitors*) ev;
+        Local<v8::Array> monitors = v8::Array::New(e->count);
+        for(unsigned int i = 0; i < e->count; i++) {
+          monitors->Set(i, Integer::New(e->monitors[i]));
+        }
+        o->Set(fields[fieldMonitors], monitors);
+      }
+      break;
     case onLast:
       // no data
       break;
     case onMouseDown:
       {
         XButtonEvent* e = (XButtonEvent *) ev;
-        INT_FIELD(id, e->window);
-        INT_FIELD(x, e->x);
-        INT_FIELD(y, e->y);
-        INT_FIELD(button, e->button);
-        INT_FIELD(state, e->state);
+        INT_FIELD(fieldId, e->window);
+        INT_FIELD(fieldX, e->x);
+        INT_FIELD(fieldY, e->y);
+        INT_FIELD(fieldButton, e->button);
+        INT_FIELD(fieldState, e->state);
       }
       break;
     case onMouseDrag:
       {
         nwm_mousedrag* e = (nwm_mousedrag*) ev;
-        INT_FIELD(id, e->id);
-        INT_FIELD(x, e->x);
-        INT_FIELD(y, e->y);
-        INT_FIELD(move_y, e->move_y);
-        INT_FIELD(move_x, e->move_x);
+        INT_FIELD(fieldId, e->id);
+        INT_FIELD(fieldX, e->x);
+        INT_FIELD(fieldY, e->y);
+        INT_FIELD(fieldMoveX, e->move_x);
+        INT_FIELD(fieldMoveY, e->move_y);
+        INT_FIELD(fieldWidth, e->width);
+        INT_FIELD(fieldHeight, e->height);
       }
       break;
     case onConfigureRequest:
       {
         XConfigureRequestEvent* e = (XConfigureRequestEvent*) ev;
-        o->Set(String::NewSymbol("id"), Integer::New(e->window));
-        o->Set(String::NewSymbol("x"), Integer::New(e->x));
-        o->Set(String::NewSymbol("y"), Integer::New(e->y));
-        o->Set(String::NewSymbol("width"), Integer::New(e->width));
-        o->Set(String::NewSymbol("height"), Integer::New(e->height));
-        o->Set(String::NewSymbol("above"), Integer::New(e->above));
-        o->Set(String::NewSymbol("detail"), Integer::New(e->detail));
-        o->Set(String::NewSymbol("value_mask"), Integer::New(e->value_mask));
+        INT_FIELD(fieldId, e->window);
+        INT_FIELD(fieldX, e->x);
+        INT_FIELD(fieldY, e->y);
+        INT_FIELD(fieldWidth, e->width);
+        INT_FIELD(fieldHeight, e->height);
+        INT_FIELD(fieldAbove, e->above);
+        INT_FIELD(fieldDetail, e->detail);
+        INT_FIELD(fieldValueMask, e->value_mask);
       }
       break;
     case onKeyPress:
       {
         nwm_keypress* e = (nwm_keypress*) ev;
-        INT_FIELD(x, e->x);
-        INT_FIELD(y, e->y);
-        INT_FIELD(keysym, e->keysym);
-        INT_FIELD(keycode, e->keycode);
-        INT_FIELD(modifier, e->modifier);
+        INT_FIELD(fieldId, e->id);
+        INT_FIELD(fieldX, e->x);
+        INT_FIELD(fieldY, e->y);
+        INT_FIELD(fieldKeysym, e->keysym);
+        INT_FIELD(fieldKeycode, e->keycode);
+        INT_FIELD(fieldModifier, e->modifier);
       }
       break;
     case onEnterNotify:
-     // NOTE: the enternotify structure is also used with only x and y when the selected monitor is updated..
-     // that might not be needed, however, since it is not really essential to the Node WM..
       {
         XCrossingEvent* e = (XCrossingEvent*) ev;
-        o->Set(String::NewSymbol("id"), Integer::New(e->window));
-        o->Set(String::NewSymbol("x"), Integer::New(e->x));
-        o->Set(String::NewSymbol("y"), Integer::New(e->y));
-        o->Set(String::NewSymbol("x_root"), Integer::New(e->x_root));
-        o->Set(String::NewSymbol("y_root"), Integer::New(e->y_root));
+        INT_FIELD(fieldId, e->window);
+        INT_FIELD(fieldX, e->x);
+        INT_FIELD(fieldY, e->y);
+        INT_FIELD(fieldXRoot, e->x_root);
+        INT_FIELD(fieldYRoot, e->y_root);
       }
       break;
+    case onAdoptWindows:
+      {
+        // { windows: [ { id, x, y, width, height, isfloating, title, instance, class, hidden }, ... ] }
+        nwm_adopt* e = (nwm_adopt*) ev;
+        Local<v8::Array> windows = v8::Array::New(e->count);
+        for(unsigned int i = 0; i < e->count; i++) {
+          Local<Object> w = templates[payloadAdopted]->NewInstance();
+          w->Set(fields[fieldId], Integer::New(e->windows[i].id));
+          w->Set(fields[fieldX], Integer::New(e->windows[i].x));
+          w->Set(fields[fieldY], Integer::New(e->windows[i].y));
+          w->Set(fields[fieldWidth], Integer::New(e->windows[i].width));
+          w->Set(fields[fieldHeight], Integer::New(e->windows[i].height));
+          w->Set(fields[fieldIsfloating], Integer::New(e->windows[i].isfloating));
+          w->Set(fields[fieldTitle], String::New(e->titles[i].title));
+          w->Set(fields[fieldInstance], String::New(e->titles[i].instance));
+          w->Set(fields[fieldClass], String::New(e->titles[i].klass));
+          w->Set(fields[fieldHidden], Integer::New(e->windows[i].hidden));
+          windows->Set(i, w);
+        }
+        o->Set(fields[fieldWindows], windows);
+      }
+      break;
+  }
+  return o;
+}
+
+static void Emit(NodeWinMan *nwm, callback_map event, void *ev) {
+  Instance *self = static_cast<Instance*>(nwm_get_data(nwm));
+  // listeners that predate adoptWindows get the per-window events instead
+  if(event == onAdoptWindows && self->batch_callback == NULL && self->callbacks[onAdoptWindows] == NULL) {
+    nwm_adopt* e = (nwm_adopt*) ev;
+    for(unsigned int i = 0; i < e->count; i++) {
+      HandleScope scope;
+      Emit(nwm, onAddWindow, (void *) &e->windows[i]);
+      Emit(nwm, onUpdateWindow, (void *) &e->titles[i]);
+    }
+    return;
+  }
+  if(self->batch_callback != NULL) {
+    // rearrange is delivered once, at the end of the batch
+    if(event == onRearrange) {
+      nwm_rearrange_monitors* e = (nwm_rearrange_monitors*) ev;
+      if(self->batch_rearrange.IsEmpty()) {
+        self->batch_rearrange = Persistent<v8::Array>::New(v8::Array::New());
+      }
+      for(unsigned int i = 0; i < e->count; i++) {
+        bool known = false;
+        for(unsigned int j = 0; j < self->batch_rearrange->Length() && !known; j++) {
+          known = (self->batch_rearrange->Get(j)->Int32Value() == e->monitors[i]);
+        }
+        if(!known) {
+          self->batch_rearrange->Set(self->batch_rearrange->Length(), Integer::New(e->monitors[i]));
+        }
+      }
+      return;
+    }
+    Local<Object> o = MakeEvent(event, ev);
+    o->Set(fields[fieldType], callback_symbols[event]);
+    self->batch_events->Set(self->batch_events->Length(), o);
+    return;
   }
+
   Local<Value> argv[1];
-  argv[0] = o;
+  argv[0] = (self->raw_events && IsRawEvent(event) ? MakeRawEvent(self, event, ev) : MakeEvent(event, ev));
 
   // instead of Handle<Value> argument, we will pass a single struct that
   // represents the various event types that nwm generates
 
   TryCatch try_catch;
-  if(callbacks[event] != NULL) {
-    Handle<Function> *callback = cb_unwrap(callbacks[event]);
+  if(self->callbacks[event] != NULL) {
+    Handle<Function> *callback = cb_unwrap(self->callbacks[event]);
     (*callback)->Call(Context::GetCurrent()->Global(), 1, argv);
     if (try_catch.HasCaught()) {
       FatalException(try_catch);
@@ -175,69 +487,624 @@ static void Emit(callback_map event, void *ev) {
   }
 }
 
+// Calls the batch callback with the events collected since the last delivery
+static void DeliverBatch(Instance *self) {
+  HandleScope scope;
+  if(self->batch_callback == NULL) {
+    return;
+  }
+  if(!self->batch_rearrange.IsEmpty()) {
+    Local<Object> o = templates[payloadRearrange]->NewInstance();
+    o->Set(fields[fieldType], callback_symbols[onRearrange]);
+    o->Set(fields[fieldMonitors], Local<v8::Array>::New(self->batch_rearrange));
+    self->batch_events->Set(self->batch_events->Length(), o);
+    self->batch_rearrange.Dispose();
+    self->batch_rearrange.Clear();
+  }
+  if(self->batch_events->Length() == 0) {
+    return;
+  }
+  Local<Value> argv[1];
+  argv[0] = Local<v8::Array>::New(self->batch_events);
+  self->batch_events.Dispose();
+  self->batch_events = Persistent<v8::Array>::New(v8::Array::New());
+
+  TryCatch try_catch;
+  unsigned long start = nwm_stats_now();
+  Handle<Function> *callback = cb_unwrap(self->batch_callback);
+  (*callback)->Call(Context::GetCurrent()->Global(), 1, argv);
+  nwm_histogram_add(&nwm_get_stats(self->nwm)->batch_delivery, nwm_stats_now() - start);
+  if (try_catch.HasCaught()) {
+    FatalException(try_catch);
+  }
+}
+
+// rawEvents(true) delivers enterNotify, mouseDrag and configureRequest as
+// reused int32-backed payloads (see MakeRawEvent). Batch mode always uses objects.
+static Handle<Value> RawEvents(const Arguments& args) {
+  HandleScope scope;
+  Self(args)->raw_events = args[0]->BooleanValue();
+  return Undefined();
+}
+
+// onBatch(function(events) { ... }) switches to batch mode: each loop tick
+// calls fn once with [{ type: 'addWindow', ... }, ..., { type: 'rearrange', monitors: [id, ...] }].
+// onBatch(null) goes back to the per-event callbacks.
+static Handle<Value> OnBatch(const Arguments& args) {
+  HandleScope scope;
+  Instance *self = Self(args);
+  if(self->batch_callback != NULL) {
+    cb_destroy(self->batch_callback);
+    self->batch_callback = NULL;
+  }
+  if(args[0]->IsFunction()) {
+    self->batch_callback = cb_persist(args[0]);
+  }
+  return Undefined();
+}
+
+// keys([{ key: keysym, modifier: mask }, ...]) sets the bound keys; keyPress
+// is only emitted for these, with id set to the index of the matching entry
 static Handle<Value> SetGrabKeys(const Arguments& args) {
   HandleScope scope;
+  NodeWinMan *nwm = Self(args)->nwm;
   unsigned int i;
   v8::Handle<v8::Value> keysym, modifier;
   v8::Local<v8::Array> arr = Local<v8::Array>::Cast(args[0]);
 
-  nwm_empty_keys();
+  nwm_empty_keys(nwm);
   // set keys
   for(i = 0; i < arr->Length(); i++) {
     v8::Local<v8::Object> obj = Local<v8::Object>::Cast(arr->Get(i));
     keysym = obj->Get(String::NewSymbol("key"));
     modifier = obj->Get(String::NewSymbol("modifier"));
-    nwm_add_key(keysym->IntegerValue(), modifier->IntegerValue());
+    nwm_add_key(nwm, keysym->IntegerValue(), modifier->IntegerValue(), i);
   }
+  // no-op until start()
+  nwm_grab_keys(nwm);
   return Undefined();
 }
 
+// Returns { "WM_PROTOCOLS": atom, ... } for the atoms interned by nwm_init()
+static Handle<Value> GetAtoms(const Arguments& args) {
+  HandleScope scope;
+  NodeWinMan *nwm = Self(args)->nwm;
+  Local<Object> o = Object::New();
+  for(int i = 0; i < atomLast; i++) {
+    o->Set(String::NewSymbol(nwm_get_atom_name((atom_map) i)),
+      Integer::NewFromUnsigned(nwm_get_atom(nwm, (atom_map) i)));
+  }
+  return scope.Close(o);
+}
+
+// start(display): connects to display (e.g. ':1'), $DISPLAY when omitted
 static Handle<Value> Start(const Arguments& args) {
   HandleScope scope;
+  Instance *self = Self(args);
+  v8::String::Utf8Value display(args[0]);
+
+  if(self->started || self->closing > 0) {
+    return ThrowException(Exception::Error(String::New("Already started")));
+  }
+  nwm_set_emit_function(self->nwm, Emit);
 
-  nwm_set_emit_function(Emit);
+  int fd = nwm_init(self->nwm, (args[0]->IsString() ? *display : NULL));
+  if(fd < 0) {
+    return ThrowException(Exception::Error(String::New("Cannot connect to the X server")));
+  }
+  // deliver the events from adopting the existing windows
+  DeliverBatch(self);
+
+  self->started = true;
+  self->threaded = true;
+  uv_async_init(uv_default_loop(), &self->drain, EIO_Drain);
+  self->drain.data = self;
+  if(nwm_start_reader(self->nwm, Wake) != 0) {
+    // not threaded: read the connection whenever it is readable
+    self->threaded = false;
+    self->closing++;
+    uv_close((uv_handle_t*) &self->drain, HandleClosed);
+    uv_poll_init(uv_default_loop(), &self->poll, fd);
+    self->poll.data = self;
+    uv_poll_start(&self->poll, UV_READABLE, EIO_Loop);
+  }
 
+  // messages logged outside nwm_loop (e.g. from API calls) are flushed periodically
+  uv_timer_init(uv_default_loop(), &self->timer);
+  self->timer.data = self;
+  uv_timer_start(&self->timer, EIO_FlushLog, 250, 250);
+  uv_unref((uv_handle_t*) &self->timer);
+  uv_timer_init(uv_default_loop(), &self->drag_timer);
+  self->drag_timer.data = self;
 
-  int fd = nwm_init();
+  return Undefined();
+}
+
+static void HandleClosed(uv_handle_t* handle) {
+  static_cast<Instance*>(handle->data)->closing--;
+}
+
+// stop(): disconnects from the display, closes the loop handles and drops the
+// callbacks. The object starts out afresh: set everything up again before the
+// next start().
+static Handle<Value> Stop(const Arguments& args) {
+  HandleScope scope;
+  Instance *self = Self(args);
+  if(!self->started) {
+    return Undefined();
+  }
+  // the reader thread signals drain until it is joined
+  nwm_stop_reader(self->nwm);
+  self->closing += 3;
+  if(self->threaded) {
+    uv_close((uv_handle_t*) &self->drain, HandleClosed);
+  } else {
+    uv_close((uv_handle_t*) &self->poll, HandleClosed);
+  }
+  uv_close((uv_handle_t*) &self->timer, HandleClosed);
+  uv_close((uv_handle_t*) &self->drag_timer, HandleClosed);
+  self->started = false;
 
-  uv_poll_t* handle = new uv_poll_t;
-  uv_poll_init(uv_default_loop(), handle, fd);
-  uv_poll_start(handle, UV_READABLE, EIO_Loop);
+  for(int i = 0; i < onLast; i++) {
+    if(self->callbacks[i] != NULL) {
+      cb_destroy(self->callbacks[i]);
+      self->callbacks[i] = NULL;
+    }
+    if(!self->raw_payloads[i].IsEmpty()) {
+      self->raw_payloads[i].Dispose();
+      self->raw_payloads[i].Clear();
+    }
+  }
+  if(self->batch_callback != NULL) {
+    cb_destroy(self->batch_callback);
+    self->batch_callback = NULL;
+  }
+  if(!self->batch_rearrange.IsEmpty()) {
+    self->batch_rearrange.Dispose();
+    self->batch_rearrange.Clear();
+  }
+  self->batch_events.Dispose();
+  self->batch_events = Persistent<v8::Array>::New(v8::Array::New());
+  self->raw_events = false;
 
+  nwm_flush_session(self->nwm);
+  nwm_free(self->nwm);
+  nwm_log_flush();
+  self->nwm = nwm_new();
+  nwm_set_data(self->nwm, self);
   return Undefined();
 }
 
+// a drag step held back within a frame is applied when it is due, so that the
+// window does not lag the pointer when the pointer stops
+static void ScheduleDrag(Instance *self) {
+  int timeout = nwm_drag_timeout(self->nwm);
+  if(timeout >= 0) {
+    uv_timer_start(&self->drag_timer, EIO_DragStep, timeout, 0);
+  }
+}
+
+static void EIO_DragStep(uv_timer_t* handle, int status) {
+  Instance *self = static_cast<Instance*>(handle->data);
+  nwm_drag_flush(self->nwm);
+  ScheduleDrag(self);
+}
+
 static void EIO_Loop(uv_poll_t* handle, int status, int events) {
-  nwm_loop();
+  HandleScope scope;
+  Instance *self = static_cast<Instance*>(handle->data);
+  nwm_loop(self->nwm);
+  DeliverBatch(self);
+  ScheduleDrag(self);
+}
+
+// runs on the reader thread; uv_async_send coalesces wakeups until EIO_Drain runs
+static void Wake(NodeWinMan *nwm) {
+  uv_async_send(&static_cast<Instance*>(nwm_get_data(nwm))->drain);
+}
+
+static void EIO_Drain(uv_async_t* handle, int status) {
+  HandleScope scope;
+  Instance *self = static_cast<Instance*>(handle->data);
+  nwm_drain(self->nwm);
+  DeliverBatch(self);
+  ScheduleDrag(self);
+}
+
+static void EIO_FlushLog(uv_timer_t* handle, int status) {
+  nwm_log_flush();
+  // window changes reach the session snapshot at most this late
+  nwm_flush_session(static_cast<Instance*>(handle->data)->nwm);
+}
+
+// setLogLevel('debug') or setLogLevel(3); returns the previous level
+static Handle<Value> SetLogLevel(const Arguments& args) {
+  HandleScope scope;
+  int previous = nwm_log_level;
+  int level = (args[0]->IsString()
+    ? nwm_log_level_lookup(*v8::String::AsciiValue(args[0]))
+    : args[0]->IntegerValue());
+  if(level < 0) {
+    return ThrowException(Exception::TypeError(String::New("Unknown log level")));
+  }
+  nwm_set_log_level(level);
+  return scope.Close(Integer::New(previous));
+}
+
+// counters() returns { events, batches, dropped, merged } since start(),
+// plus { adopted, adopt_usec } for the windows adopted at startup and
+// configure_answered for the requests handled by the configure policy
+static Handle<Value> GetCounters(const Arguments& args) {
+  HandleScope scope;
+  nwm_counters counters;
+  nwm_get_counters(Self(args)->nwm, &counters);
+  Local<Object> o = Object::New();
+  o->Set(String::NewSymbol("events"), Number::New(counters.events));
+  o->Set(String::NewSymbol("batches"), Number::New(counters.batches));
+  o->Set(String::NewSymbol("dropped"), Number::New(counters.dropped));
+  o->Set(String::NewSymbol("merged"), Number::New(counters.merged));
+  o->Set(String::NewSymbol("adopted"), Number::New(counters.adopted));
+  o->Set(String::NewSymbol("adopt_usec"), Number::New(counters.adopt_usec));
+  o->Set(String::NewSymbol("configure_answered"), Number::New(counters.configure_answered));
+  return scope.Close(o);
+}
+
+static Local<Object> MakeHistogram(nwm_histogram *h) {
+  Local<Object> o = Object::New();
+  Local<v8::Array> buckets = v8::Array::New(NWM_STATS_BUCKETS);
+  o->Set(String::NewSymbol("count"), Number::New(h->count));
+  o->Set(String::NewSymbol("mean"), Number::New(h->count ? (double) h->total / h->count : 0));
+  o->Set(String::NewSymbol("max"), Number::New(h->max));
+  o->Set(String::NewSymbol("p50"), Number::New(nwm_histogram_percentile(h, 0.5)));
+  o->Set(String::NewSymbol("p90"), Number::New(nwm_histogram_percentile(h, 0.9)));
+  o->Set(String::NewSymbol("p99"), Number::New(nwm_histogram_percentile(h, 0.99)));
+  for(int i = 0; i < NWM_STATS_BUCKETS; i++) {
+    buckets->Set(i, Number::New(h->buckets[i]));
+  }
+  o->Set(String::NewSymbol("buckets"), buckets);
+  return o;
+}
+
+// stats() returns a snapshot of this instance's instrumentation (times in microseconds):
+// { events: { MapRequest: { requests, roundTrips, latency: histogram }, ... },
+//   callbacks: { addWindow: histogram, ... }, batchSize, batchDelivery,
+//   rearrange, applyLayout, errors: { benign, unexpected, tracked, byRequest } },
+// where byRequest maps X request codes to their benign errors and a histogram is
+// { count, mean, max, p50, p90, p99, buckets } (bucket i: values < 2^i).
+// roundTrips counts the requests among them that waited for a reply.
+// Only event types and callbacks that occurred are included.
+static Handle<Value> GetStats(const Arguments& args) {
+  HandleScope scope;
+  nwm_stats *stats = nwm_get_stats(Self(args)->nwm);
+  Local<Object> o = Object::New();
+  Local<Object> events = Object::New();
+  Local<Object> callbacks = Object::New();
+  for(int i = 0; i < LASTEvent; i++) {
+    if(stats->handler[i].count) {
+      Local<Object> e = Object::New();
+      e->Set(String::NewSymbol("requests"), Number::New(stats->requests[i]));
+      e->Set(String::NewSymbol("roundTrips"), Number::New(stats->round_trips[i]));
+      e->Set(String::NewSymbol("latency"), MakeHistogram(&stats->handler[i]));
+      events->Set(String::NewSymbol(nwm_get_event_name(i)), e);
+    }
+  }
+  for(int i = 0; i < onLast; i++) {
+    if(stats->callback[i].count) {
+      callbacks->Set(callback_symbols[i], MakeHistogram(&stats->callback[i]));
+    }
+  }
+  o->Set(String::NewSymbol("events"), events);
+  o->Set(String::NewSymbol("callbacks"), callbacks);
+  o->Set(String::NewSymbol("batchSize"), MakeHistogram(&stats->batch_size));
+  o->Set(String::NewSymbol("batchDelivery"), MakeHistogram(&stats->batch_delivery));
+  o->Set(String::NewSymbol("rearrange"), MakeHistogram(&stats->rearrange));
+  o->Set(String::NewSymbol("applyLayout"), MakeHistogram(&stats->apply_layout));
+  Local<Object> errors = Object::New();
+  Local<Object> by_request = Object::New();
+  errors->Set(String::NewSymbol("benign"), Number::New(stats->errors_benign));
+  errors->Set(String::NewSymbol("unexpected"), Number::New(stats->errors_unexpected));
+  errors->Set(String::NewSymbol("tracked"), Number::New(stats->errors_tracked));
+  for(int i = 0; i < NWM_STATS_REQUESTS; i++) {
+    if(stats->errors_by_request[i]) {
+      by_request->Set(Integer::New(i), Number::New(stats->errors_by_request[i]));
+    }
+  }
+  errors->Set(String::NewSymbol("byRequest"), by_request);
+  o->Set(String::NewSymbol("errors"), errors);
+  return scope.Close(o);
+}
+
+static Handle<Value> ResetStats(const Arguments& args) {
+  HandleScope scope;
+  nwm_stats_reset(nwm_get_stats(Self(args)->nwm));
+  return Undefined();
+}
+
+// shareStats(path) keeps the stats of this instance in a shared file mapping
+// (see stats.h for the layout) so external tools can read them; returns false
+// on failure. Use one file per display.
+static Handle<Value> ShareStats(const Arguments& args) {
+  HandleScope scope;
+  return scope.Close(Boolean::New(nwm_share_stats(Self(args)->nwm, *v8::String::Utf8Value(args[0])) == 0));
+}
+
+// sessionFile(path): keep the managed windows in a snapshot file for hot
+// restarts (see session.h); must be called before start(), false on failure
+static Handle<Value> SetSessionFile(const Arguments& args) {
+  HandleScope scope;
+  return scope.Close(Boolean::New(nwm_set_session_file(Self(args)->nwm, *v8::String::Utf8Value(args[0])) == 0));
+}
+
+// sessionState(): the string the previous instance passed to saveSession, or undefined
+static Handle<Value> GetSessionState(const Arguments& args) {
+  HandleScope scope;
+  const char *state = nwm_get_session_state(Self(args)->nwm);
+  if(!state) {
+    return Undefined();
+  }
+  return scope.Close(String::New(state));
+}
+
+// saveSession(string): store the JS state next to the windows; false if it does not fit
+static Handle<Value> SaveSession(const Arguments& args) {
+  HandleScope scope;
+  v8::String::Utf8Value state(args[0]);
+  return scope.Close(Boolean::New(nwm_save_session(Self(args)->nwm, *state, state.length()) == 0));
+}
+
+static Handle<Value> FlushLog(const Arguments& args) {
+  HandleScope scope;
+  return scope.Close(Integer::NewFromUnsigned(nwm_log_flush()));
 }
 
 static Handle<Value> ResizeWindow(const Arguments& args) {
   HandleScope scope;
-  nwm_resize_window(args[0]->Uint32Value(), args[1]->IntegerValue(), args[2]->IntegerValue());
+  nwm_resize_window(Self(args)->nwm, args[0]->Uint32Value(), args[1]->IntegerValue(), args[2]->IntegerValue());
   return Undefined();
 }
 
 static Handle<Value> MoveWindow(const Arguments& args) {
   HandleScope scope;
-  nwm_move_window(args[0]->Uint32Value(), args[1]->IntegerValue(), args[2]->IntegerValue());
+  nwm_move_window(Self(args)->nwm, args[0]->Uint32Value(), args[1]->IntegerValue(), args[2]->IntegerValue());
+  return Undefined();
+}
+
+// reads an integer property into value with a single lookup; returns false,
+// leaving value alone, if it is not set (undefined or null)
+static bool IntegerField(Local<Object> obj, field_map name, int *value) {
+  Local<Value> field = obj->Get(fields[name]);
+  if(field->IsUndefined() || field->IsNull()) {
+    return false;
+  }
+  *value = field->IntegerValue();
+  return true;
+}
+
+// applyLayout([{ id, x, y, width, height, border, stack }, ...])
+// Omitted x, y, width or height keep their last applied value.
+// Reads the entries as passed to applyLayout; the caller deletes the returned array.
+static nwm_geometry* ReadGeometry(Local<v8::Array> arr) {
+  unsigned int i, count = arr->Length();
+  nwm_geometry* geometry = new nwm_geometry[count > 0 ? count : 1];
+
+  for(i = 0; i < count; i++) {
+    Local<v8::Object> obj = Local<v8::Object>::Cast(arr->Get(i));
+    nwm_geometry* g = &geometry[i];
+    g->id = obj->Get(fields[fieldId])->Uint32Value();
+    g->value_mask = 0;
+    g->x = g->y = g->width = g->height = 0;
+    g->border_width = -1;
+    g->stack = -1;
+    if(IntegerField(obj, fieldX, &g->x))
+      g->value_mask |= CWX;
+    if(IntegerField(obj, fieldY, &g->y))
+      g->value_mask |= CWY;
+    if(IntegerField(obj, fieldWidth, &g->width))
+      g->value_mask |= CWWidth;
+    if(IntegerField(obj, fieldHeight, &g->height))
+      g->value_mask |= CWHeight;
+    IntegerField(obj, fieldBorder, &g->border_width);
+    IntegerField(obj, fieldStack, &g->stack);
+  }
+  return geometry;
+}
+
+static Handle<Value> ApplyLayout(const Arguments& args) {
+  HandleScope scope;
+  Local<v8::Array> arr = Local<v8::Array>::Cast(args[0]);
+  nwm_geometry* geometry = ReadGeometry(arr);
+  nwm_apply_layout(Self(args)->nwm, geometry, arr->Length());
+  delete[] geometry;
+  return Undefined();
+}
+
+static Window* ReadIds(Local<v8::Array> arr) {
+  unsigned int i, count = arr->Length();
+  Window* ids = new Window[count > 0 ? count : 1];
+  for(i = 0; i < count; i++) {
+    ids[i] = arr->Get(i)->Uint32Value();
+  }
+  return ids;
+}
+
+// switchWorkspace([hide id, ...], [show id, ...], [geometry, ...])
+// Hides and shows the two sets of windows in one grouped operation, after
+// applying the geometry (applyLayout entries, e.g. the layout of the shown windows).
+static Handle<Value> SwitchWorkspace(const Arguments& args) {
+  HandleScope scope;
+  Local<v8::Array> hide = Local<v8::Array>::Cast(args[0]);
+  Local<v8::Array> show = Local<v8::Array>::Cast(args[1]);
+  Local<v8::Array> arr = (args[2]->IsArray() ? Local<v8::Array>::Cast(args[2]) : v8::Array::New(0));
+  Window* hide_ids = ReadIds(hide);
+  Window* show_ids = ReadIds(show);
+  nwm_geometry* geometry = ReadGeometry(arr);
+
+  nwm_switch_workspace(Self(args)->nwm, hide_ids, hide->Length(), show_ids, show->Length(), geometry, arr->Length());
+  delete[] geometry;
+  delete[] show_ids;
+  delete[] hide_ids;
+  return Undefined();
+}
+
+// restack([id, ...]) stacks the windows in that order, bottom to top, relative
+// to each other; only the windows that are out of order are moved
+static Handle<Value> Restack(const Arguments& args) {
+  HandleScope scope;
+  Local<v8::Array> arr = Local<v8::Array>::Cast(args[0]);
+  Window* ids = ReadIds(arr);
+  nwm_restack(Self(args)->nwm, ids, arr->Length());
+  delete[] ids;
+  return Undefined();
+}
+
+// getStacking() returns the ids of the managed windows, bottom to top
+static Handle<Value> GetStacking(const Arguments& args) {
+  HandleScope scope;
+  unsigned int count;
+  const Window* ids = nwm_get_stacking(Self(args)->nwm, &count);
+  Local<v8::Array> result = v8::Array::New(count);
+  for(unsigned int i = 0; i < count; i++) {
+    result->Set(i, Integer::NewFromUnsigned(ids[i]));
+  }
+  return scope.Close(result);
+}
+
+// layout(name, { x, y, width, height }, [id, ...], scale, border)
+// Computes and applies one of the bundled layouts, ids[0] being the main window.
+// Returns the applied geometry as [{ id, x, y, width, height }, ...].
+static Handle<Value> Layout(const Arguments& args) {
+  HandleScope scope;
+  int layout = nwm_layout_lookup(*v8::String::AsciiValue(args[0]));
+  Local<v8::Object> screen = Local<v8::Object>::Cast(args[1]);
+  Local<v8::Array> arr = Local<v8::Array>::Cast(args[2]);
+  unsigned int i, placed, count = arr->Length();
+  nwm_monitor monitor;
+
+  if(layout == -1) {
+    return ThrowException(Exception::TypeError(String::New("Unknown layout")));
+  }
+  monitor.id = 0;
+  monitor.x = monitor.y = monitor.width = monitor.height = 0;
+  IntegerField(screen, fieldX, &monitor.x);
+  IntegerField(screen, fieldY, &monitor.y);
+  IntegerField(screen, fieldWidth, &monitor.width);
+  IntegerField(screen, fieldHeight, &monitor.height);
+
+  Window* ids = new Window[count > 0 ? count : 1];
+  nwm_geometry* geometry = new nwm_geometry[count > 0 ? count : 1];
+  for(i = 0; i < count; i++) {
+    ids[i] = arr->Get(i)->Uint32Value();
+  }
+  placed = nwm_layout((layout_map) layout, &monitor, ids, count,
+    (args[3]->IsUndefined() ? 50 : args[3]->IntegerValue()),
+    (args[4]->IsUndefined() ? -1 : args[4]->IntegerValue()), geometry);
+  nwm_apply_layout(Self(args)->nwm, geometry, placed);
+
+  Local<v8::Array> result = v8::Array::New(placed);
+  for(i = 0; i < placed; i++) {
+    Local<Object> o = Object::New();
+    o->Set(fields[fieldId], Integer::NewFromUnsigned(geometry[i].id));
+    o->Set(fields[fieldX], Integer::New(geometry[i].x));
+    o->Set(fields[fieldY], Integer::New(geometry[i].y));
+    o->Set(fields[fieldWidth], Integer::New(geometry[i].width));
+    o->Set(fields[fieldHeight], Integer::New(geometry[i].height));
+    result->Set(i, o);
+  }
+  delete[] ids;
+  delete[] geometry;
+  return scope.Close(result);
+}
+
+// returns the configure_policy named by the value, or -1 (forward when undefined)
+static int PolicyValue(Local<Value> value) {
+  if(value->IsUndefined()) {
+    return ConfigureForward;
+  }
+  return nwm_configure_policy_lookup(*v8::String::AsciiValue(value));
+}
+
+// configurePolicy({ unmanaged: 'allow', floating: 'allow', tiled: 'deny',
+//   classes: { MPlayer: 'allow' } }) sets how configure requests are answered
+// natively; each policy is 'allow', 'deny' or 'forward' (the default, which
+// emits configureRequest). Replaces any earlier policy.
+static Handle<Value> ConfigurePolicy(const Arguments& args) {
+  HandleScope scope;
+  if(!args[0]->IsObject()) {
+    return ThrowException(Exception::TypeError(String::New("configurePolicy expects an object")));
+  }
+  NodeWinMan *nwm = Self(args)->nwm;
+  Local<Object> obj = args[0]->ToObject();
+  int unmanaged = PolicyValue(obj->Get(String::NewSymbol("unmanaged")));
+  int floating = PolicyValue(obj->Get(String::NewSymbol("floating")));
+  int tiled = PolicyValue(obj->Get(String::NewSymbol("tiled")));
+  if(unmanaged < 0 || floating < 0 || tiled < 0) {
+    return ThrowException(Exception::TypeError(String::New("Unknown configure policy")));
+  }
+  nwm_clear_configure_rules(nwm);
+  Local<Value> classes = obj->Get(String::NewSymbol("classes"));
+  if(classes->IsObject()) {
+    Local<v8::Array> names = classes->ToObject()->GetPropertyNames();
+    for(unsigned int i = 0; i < names->Length(); i++) {
+      Local<Value> name = names->Get(i);
+      int policy = PolicyValue(classes->ToObject()->Get(name));
+      if(policy < 0) {
+        return ThrowException(Exception::TypeError(String::New("Unknown configure policy")));
+      }
+      if(nwm_add_configure_rule(nwm, *v8::String::AsciiValue(name), (configure_policy) policy) != 0) {
+        return ThrowException(Exception::RangeError(String::New("Too many configure policy classes")));
+      }
+    }
+  }
+  nwm_set_configure_policy(nwm, (configure_policy) unmanaged, (configure_policy) floating, (configure_policy) tiled);
+  return Undefined();
+}
+
+// dragModifier(mask): hold mask and drag with button 1 to move, button 3 to
+// resize a window; the drag runs natively, stepping at the refresh rate of the
+// fastest monitor, and ends with one mouseDrag event
+static Handle<Value> SetDragModifier(const Arguments& args) {
+  HandleScope scope;
+  nwm_set_drag_modifier(Self(args)->nwm, args[0]->Uint32Value());
+  return Undefined();
+}
+
+// focusFollowsMouse(bool): focus windows natively when the pointer enters them;
+// enterNotify then only reports what was focused
+static Handle<Value> SetFocusFollowsMouse(const Arguments& args) {
+  HandleScope scope;
+  nwm_set_focus_follows_mouse(Self(args)->nwm, args[0]->BooleanValue());
+  return Undefined();
+}
+
+// threaded(bool): read X events on a separate thread; must be set before start()
+static Handle<Value> SetThreaded(const Arguments& args) {
+  HandleScope scope;
+  nwm_set_threaded(Self(args)->nwm, args[0]->BooleanValue());
   return Undefined();
 }
 
 static Handle<Value> FocusWindow(const Arguments& args) {
   HandleScope scope;
-  nwm_focus_window(args[0]->Uint32Value());
+  nwm_focus_window(Self(args)->nwm, args[0]->Uint32Value());
   return Undefined();
 }
 
 static Handle<Value> KillWindow(const Arguments& args) {
   HandleScope scope;
-  nwm_kill_window(args[0]->Uint32Value());
+  nwm_kill_window(Self(args)->nwm, args[0]->Uint32Value());
   return Undefined();
 }
 
+static Handle<Value> SetBorderColors(const Arguments& args) {
+  HandleScope scope;
+  int result = nwm_set_border_colors(Self(args)->nwm, *v8::String::AsciiValue(args[0]),
+    *v8::String::AsciiValue(args[1]));
+  return scope.Close(Boolean::New(result == 0));
+}
+
 static Handle<Value> ConfigureWindow(const Arguments& args) {
   HandleScope scope;
-  nwm_configure_window(args[0]->Uint32Value(), args[1]->IntegerValue(),
+  nwm_configure_window(Self(args)->nwm, args[0]->Uint32Value(), args[1]->IntegerValue(),
     args[2]->IntegerValue(), args[3]->IntegerValue(), args[4]->IntegerValue(),
     args[5]->IntegerValue(), args[6]->IntegerValue(), args[7]->IntegerValue(),
     args[8]->IntegerValue());
@@ -246,32 +1113,75 @@ static Handle<Value> ConfigureWindow(const Arguments& args) {
 
 static Handle<Value> NotifyWindow(const Arguments& args) {
   HandleScope scope;
-  nwm_notify_window(args[0]->Uint32Value(), args[1]->IntegerValue(),
+  nwm_notify_window(Self(args)->nwm, args[0]->Uint32Value(), args[1]->IntegerValue(),
     args[2]->IntegerValue(), args[3]->IntegerValue(), args[4]->IntegerValue(),
     args[5]->IntegerValue(), args[6]->IntegerValue(), args[7]->IntegerValue(),
     args[8]->IntegerValue());
   return Undefined();
 }
 
+// Sets the functions of self on target
+static void Bind(Handle<Object> target, Instance *self) {
+  Local<Value> data = External::New(self);
+  // Callbacks
+  target->Set(String::New("on"), FunctionTemplate::New(OnCallback, data)->GetFunction());
+  target->Set(String::New("onBatch"), FunctionTemplate::New(OnBatch, data)->GetFunction());
+  target->Set(String::New("rawEvents"), FunctionTemplate::New(RawEvents, data)->GetFunction());
+  // API
+  target->Set(String::New("moveWindow"), FunctionTemplate::New(MoveWindow, data)->GetFunction());
+  target->Set(String::New("resizeWindow"), FunctionTemplate::New(ResizeWindow, data)->GetFunction());
+  target->Set(String::New("applyLayout"), FunctionTemplate::New(ApplyLayout, data)->GetFunction());
+  target->Set(String::New("switchWorkspace"), FunctionTemplate::New(SwitchWorkspace, data)->GetFunction());
+  target->Set(String::New("layout"), FunctionTemplate::New(Layout, data)->GetFunction());
+  target->Set(String::New("restack"), FunctionTemplate::New(Restack, data)->GetFunction());
+  target->Set(String::New("getStacking"), FunctionTemplate::New(GetStacking, data)->GetFunction());
+  target->Set(String::New("focusWindow"), FunctionTemplate::New(FocusWindow, data)->GetFunction());
+  target->Set(String::New("killWindow"), FunctionTemplate::New(KillWindow, data)->GetFunction());
+  target->Set(String::New("configureWindow"), FunctionTemplate::New(ConfigureWindow, data)->GetFunction());
+  target->Set(String::New("notifyWindow"), FunctionTemplate::New(NotifyWindow, data)->GetFunction());
+  target->Set(String::New("atoms"), FunctionTemplate::New(GetAtoms, data)->GetFunction());
+  target->Set(String::New("setBorderColors"), FunctionTemplate::New(SetBorderColors, data)->GetFunction());
+  // Setting up
+  target->Set(String::New("start"), FunctionTemplate::New(Start, data)->GetFunction());
+  target->Set(String::New("stop"), FunctionTemplate::New(Stop, data)->GetFunction());
+  target->Set(String::New("keys"), FunctionTemplate::New(SetGrabKeys, data)->GetFunction());
+  target->Set(String::New("dragModifier"), FunctionTemplate::New(SetDragModifier, data)->GetFunction());
+  target->Set(String::New("focusFollowsMouse"), FunctionTemplate::New(SetFocusFollowsMouse, data)->GetFunction());
+  target->Set(String::New("threaded"), FunctionTemplate::New(SetThreaded, data)->GetFunction());
+  target->Set(String::New("configurePolicy"), FunctionTemplate::New(ConfigurePolicy, data)->GetFunction());
+  // Logging is process-wide, shared by all instances
+  target->Set(String::New("setLogLevel"), FunctionTemplate::New(SetLogLevel, data)->GetFunction());
+  target->Set(String::New("flushLog"), FunctionTemplate::New(FlushLog, data)->GetFunction());
+  // Instrumentation, per instance
+  target->Set(String::New("counters"), FunctionTemplate::New(GetCounters, data)->GetFunction());
+  target->Set(String::New("stats"), FunctionTemplate::New(GetStats, data)->GetFunction());
+  target->Set(String::New("resetStats"), FunctionTemplate::New(ResetStats, data)->GetFunction());
+  target->Set(String::New("shareStats"), FunctionTemplate::New(ShareStats, data)->GetFunction());
+  target->Set(String::New("sessionFile"), FunctionTemplate::New(SetSessionFile, data)->GetFunction());
+  target->Set(String::New("sessionState"), FunctionTemplate::New(GetSessionState, data)->GetFunction());
+  target->Set(String::New("saveSession"), FunctionTemplate::New(SaveSession, data)->GetFunction());
+}
+
+// create(): a new object with the functions of this module, for another
+// window manager (e.g. on another display) in the same process
+static Handle<Value> Create(const Arguments& args) {
+  HandleScope scope;
+  Local<Object> o = Object::New();
+  Bind(o, NewInstance());
+  return scope.Close(o);
+}
+
 extern "C" {
   void init(Handle<Object> target) {
     HandleScope scope;
 
-    for(int i = 0; i < onLast; i++) {
-      callbacks[i] = NULL;
+    // before any instance opens a display, so that any of them can be threaded
+    if(nwm_init_threads() != 0) {
+      nwm_log(NWM_LOG_WARN, "XInitThreads failed, threaded(true) will be ignored\n");
     }
-    // Callbacks
-    target->Set(String::New("on"), FunctionTemplate::New(OnCallback)->GetFunction());
-    // API
-    target->Set(String::New("moveWindow"), FunctionTemplate::New(MoveWindow)->GetFunction());
-    target->Set(String::New("resizeWindow"), FunctionTemplate::New(ResizeWindow)->GetFunction());
-    target->Set(String::New("focusWindow"), FunctionTemplate::New(FocusWindow)->GetFunction());
-    target->Set(String::New("killWindow"), FunctionTemplate::New(KillWindow)->GetFunction());
-    target->Set(String::New("configureWindow"), FunctionTemplate::New(ConfigureWindow)->GetFunction());
-    target->Set(String::New("notifyWindow"), FunctionTemplate::New(NotifyWindow)->GetFunction());
-    // Setting up
-    target->Set(String::New("start"), FunctionTemplate::New(Start)->GetFunction());
-    target->Set(String::New("keys"), FunctionTemplate::New(SetGrabKeys)->GetFunction());
+    InitTemplates();
+    Bind(target, NewInstance());
+    target->Set(String::New("create"), FunctionTemplate::New(Create)->GetFunction());
   }
 
   NODE_MODULE(nwm, init);
@@ -0,0 +1,57 @@
+#include <stdlib.h>
+#include "ring.h"
+
+// head and tail only ever increase (wrapping); the slot is the index masked by
+// capacity - 1. The release store of an index publishes everything written to
+// the slot before it, the acquire load on the other side makes it visible.
+#define LOAD(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define STORE(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+
+int Ring_init(Ring *ring, size_t item_size, unsigned int capacity) {
+  unsigned int size = 2;
+  while(size < capacity) {
+    size <<= 1;
+  }
+  if(!(ring->items = malloc(size * item_size))) {
+    return -1;
+  }
+  ring->item_size = item_size;
+  ring->capacity = size;
+  ring->head = 0;
+  ring->tail = 0;
+  return 0;
+}
+
+void* Ring_reserve(Ring *ring) {
+  unsigned int tail = ring->tail;
+  if(tail - LOAD(&ring->head) >= ring->capacity) {
+    return NULL;
+  }
+  return ring->items + (tail & (ring->capacity - 1)) * ring->item_size;
+}
+
+void Ring_push(Ring *ring) {
+  STORE(&ring->tail, ring->tail + 1);
+}
+
+void* Ring_peek(Ring *ring) {
+  unsigned int head = ring->head;
+  if(head == LOAD(&ring->tail)) {
+    return NULL;
+  }
+  return ring->items + (head & (ring->capacity - 1)) * ring->item_size;
+}
+
+void Ring_pop(Ring *ring) {
+  STORE(&ring->head, ring->head + 1);
+}
+
+unsigned int Ring_length(Ring *ring) {
+  return LOAD(&ring->tail) - LOAD(&ring->head);
+}
+
+void Ring_free(Ring *ring) {
+  free(ring->items);
+  ring->items = NULL;
+  ring->capacity = 0;
+}
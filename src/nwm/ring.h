@@ -0,0 +1,36 @@
+#include <stddef.h>
+
+// Lock-free single-producer/single-consumer ring of fixed-size items.
+// One thread may reserve and push, another may peek and pop; neither blocks.
+// Items are written and read in place, so large records are never copied.
+
+typedef struct {
+  unsigned char *items;
+  size_t item_size;
+  // always a power of two
+  unsigned int capacity;
+  // next slot to read, written by the consumer only
+  unsigned int head;
+  // keeps head and tail on separate cache lines
+  char pad[64];
+  // next slot to write, written by the producer only
+  unsigned int tail;
+} Ring;
+
+// Returns 0 on success, -1 if the items cannot be allocated.
+// capacity is rounded up to a power of two.
+extern int Ring_init(Ring *ring, size_t item_size, unsigned int capacity);
+
+// Producer: returns the slot to fill next, or NULL if the ring is full.
+// The item becomes visible to the consumer on Ring_push.
+extern void* Ring_reserve(Ring *ring);
+extern void Ring_push(Ring *ring);
+
+// Consumer: returns the oldest item, or NULL if the ring is empty.
+// The slot stays valid until Ring_pop.
+extern void* Ring_peek(Ring *ring);
+extern void Ring_pop(Ring *ring);
+
+extern unsigned int Ring_length(Ring *ring);
+
+extern void Ring_free(Ring *ring);
@@ -0,0 +1,89 @@
+#define _POSIX_C_SOURCE 200112L
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "fetch.h"
+#include "session.h"
+
+nwm_session* nwm_session_open(const char *path) {
+  nwm_session *session;
+  int fd = open(path, O_RDWR|O_CREAT, 0644);
+  if(fd < 0) {
+    return NULL;
+  }
+  // a file of another size is not a snapshot this build can read; it is
+  // resized here and fails nwm_session_valid
+  if(ftruncate(fd, sizeof(nwm_session)) != 0) {
+    close(fd);
+    return NULL;
+  }
+  session = mmap(NULL, sizeof(nwm_session), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  // the mapping stays valid after the descriptor is closed
+  close(fd);
+  if(session == MAP_FAILED) {
+    return NULL;
+  }
+  return session;
+}
+
+void nwm_session_close(nwm_session *session) {
+  munmap(session, sizeof(nwm_session));
+}
+
+int nwm_session_valid(nwm_session *session, Window root) {
+  return (session->magic == NWM_SESSION_MAGIC
+    && session->version == NWM_SESSION_VERSION
+    && session->size == sizeof(nwm_session)
+    && !(session->sequence & 1)
+    && session->root == root
+    && session->count <= NWM_SESSION_WINDOWS
+    && session->state_length <= NWM_SESSION_STATE_LEN);
+}
+
+void nwm_session_begin(nwm_session *session, Window root) {
+  if(!nwm_session_valid(session, root)) {
+    // start from scratch, also if the snapshot is from another display
+    session->count = 0;
+    session->state_length = 0;
+  }
+  session->sequence |= 1;
+  session->magic = NWM_SESSION_MAGIC;
+  session->version = NWM_SESSION_VERSION;
+  session->size = sizeof(nwm_session);
+  session->root = root;
+}
+
+static int compare_windows(const void *a, const void *b) {
+  Window x = ((const nwm_session_window *) a)->id;
+  Window y = ((const nwm_session_window *) b)->id;
+  return (x < y ? -1 : (x > y ? 1 : 0));
+}
+
+void nwm_session_end(nwm_session *session) {
+  qsort(session->windows, session->count, sizeof(nwm_session_window), compare_windows);
+  session->sequence++;
+}
+
+nwm_session_window* nwm_session_append(nwm_session *session) {
+  if(session->count >= NWM_SESSION_WINDOWS) {
+    return NULL;
+  }
+  return &session->windows[session->count++];
+}
+
+int nwm_session_set_state(nwm_session *session, const char *state, unsigned long length) {
+  if(length > NWM_SESSION_STATE_LEN) {
+    return -1;
+  }
+  memcpy(session->state, state, length);
+  session->state_length = length;
+  return 0;
+}
+
+nwm_session_window* nwm_session_find(nwm_session *session, Window id) {
+  nwm_session_window key;
+  key.id = id;
+  return bsearch(&key, session->windows, session->count, sizeof(nwm_session_window), compare_windows);
+}
@@ -0,0 +1,72 @@
+// Session snapshot for hot restarts. Include after fetch.h.
+//
+// The managed windows and an opaque JS state string are kept in a file
+// mapping (e.g. /dev/shm/nwm-session) that is rewritten whenever they change,
+// so that the next nwm started on the same display can take the windows over
+// without reading their properties again, and JS can put them back on their
+// workspaces.
+
+#include <X11/X.h>
+
+#define NWM_SESSION_MAGIC 0x524d574eUL // "NWMR"
+#define NWM_SESSION_VERSION 1
+// windows beyond this are not saved; they are adopted as new windows
+#define NWM_SESSION_WINDOWS 512
+#define NWM_SESSION_STATE_LEN 65536
+
+typedef struct {
+  Window id;
+  Window transient_for;
+  // geometry including the border
+  int x;
+  int y;
+  int width;
+  int height;
+  unsigned char isfloating;
+  unsigned char fullscreen;
+  // unmapped by nwm_switch_workspace (IconicState)
+  unsigned char hidden;
+  // fetch_protocols flags
+  unsigned char protocols;
+  char title[NWM_TEXT_LEN];
+  char instance[NWM_TEXT_LEN];
+  char klass[NWM_TEXT_LEN];
+} nwm_session_window;
+
+typedef struct {
+  // NWM_SESSION_MAGIC, NWM_SESSION_VERSION and sizeof(nwm_session)
+  unsigned long magic;
+  unsigned long version;
+  unsigned long size;
+  // incremented before and after every write: a snapshot left with an odd
+  // value (nwm died while writing it) is not used
+  unsigned long sequence;
+  // the root window the windows belong to
+  Window root;
+  // windows[0..count), sorted by id
+  unsigned long count;
+  nwm_session_window windows[NWM_SESSION_WINDOWS];
+  // JS state, not null-terminated
+  unsigned long state_length;
+  char state[NWM_SESSION_STATE_LEN];
+} nwm_session;
+
+// maps the session file at path, creating it if needed; NULL on failure
+extern nwm_session* nwm_session_open(const char *path);
+extern void nwm_session_close(nwm_session *session);
+
+// 1 if session holds a complete snapshot of windows on root
+extern int nwm_session_valid(nwm_session *session, Window root);
+
+// wrap every change: begin marks the snapshot as incomplete, end sorts the
+// windows and marks it complete again
+extern void nwm_session_begin(nwm_session *session, Window root);
+extern void nwm_session_end(nwm_session *session);
+
+// next free window record, or NULL if the snapshot is full
+extern nwm_session_window* nwm_session_append(nwm_session *session);
+// returns 0 on success, -1 if state does not fit
+extern int nwm_session_set_state(nwm_session *session, const char *state, unsigned long length);
+
+// the saved record of id (binary search), or NULL
+extern nwm_session_window* nwm_session_find(nwm_session *session, Window id);
@@ -0,0 +1,79 @@
+#define _POSIX_C_SOURCE 200112L
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "nwm.h"
+#include "stats.h"
+
+unsigned long nwm_stats_now() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (unsigned long) now.tv_sec * 1000000UL + now.tv_nsec / 1000;
+}
+
+void nwm_histogram_add(nwm_histogram *h, unsigned long value) {
+  unsigned int bucket = 0;
+  unsigned long v = value;
+  while(v && bucket < NWM_STATS_BUCKETS - 1) {
+    v >>= 1;
+    bucket++;
+  }
+  h->buckets[bucket]++;
+  h->count++;
+  h->total += value;
+  if(value > h->max) {
+    h->max = value;
+  }
+}
+
+unsigned long nwm_histogram_percentile(nwm_histogram *h, double fraction) {
+  unsigned long seen = 0, rank;
+  unsigned int i;
+  if(!h->count) {
+    return 0;
+  }
+  rank = (unsigned long) (fraction * h->count);
+  rank = (rank < 1 ? 1 : rank);
+  for(i = 0; i < NWM_STATS_BUCKETS - 1; i++) {
+    seen += h->buckets[i];
+    if(seen >= rank) {
+      // the bucket bound, but never more than the largest value seen
+      unsigned long bound = (i == 0 ? 0 : (1UL << i) - 1);
+      return (bound < h->max ? bound : h->max);
+    }
+  }
+  return h->max;
+}
+
+void nwm_stats_reset(nwm_stats *stats) {
+  memset(stats, 0, sizeof(nwm_stats));
+  stats->magic = NWM_STATS_MAGIC;
+  stats->version = NWM_STATS_VERSION;
+  stats->size = sizeof(nwm_stats);
+}
+
+nwm_stats* nwm_stats_share(nwm_stats *stats, const char *path) {
+  nwm_stats *shared;
+  int fd = open(path, O_RDWR|O_CREAT, 0644);
+  if(fd < 0) {
+    return NULL;
+  }
+  if(ftruncate(fd, sizeof(nwm_stats)) != 0) {
+    close(fd);
+    return NULL;
+  }
+  shared = mmap(NULL, sizeof(nwm_stats), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  // the mapping stays valid after the descriptor is closed
+  close(fd);
+  if(shared == MAP_FAILED) {
+    return NULL;
+  }
+  memcpy(shared, stats, sizeof(nwm_stats));
+  return shared;
+}
+
+void nwm_stats_unshare(nwm_stats *shared) {
+  munmap(shared, sizeof(nwm_stats));
+}
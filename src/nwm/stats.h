@@ -0,0 +1,85 @@
+// Latency and throughput instrumentation. Include after nwm.h.
+//
+// Every instance records into its own nwm_stats struct from the thread
+// running nwm_loop, using the monotonic clock. The struct normally lives in
+// the instance; nwm_share_stats() moves it into a file mapping so that an
+// external tool can read it while nwm is running.
+
+#include <X11/X.h>
+
+// bucket 0 counts values below 1, bucket i values in [2^(i-1), 2^i), and the
+// last bucket everything from 2^(NWM_STATS_BUCKETS-2) up
+#define NWM_STATS_BUCKETS 24
+
+typedef struct {
+  unsigned long count;
+  unsigned long total;
+  unsigned long max;
+  unsigned long buckets[NWM_STATS_BUCKETS];
+} nwm_histogram;
+
+#define NWM_STATS_MAGIC 0x534d574eUL // "NWMS"
+#define NWM_STATS_VERSION 4
+// X request codes, core and extension
+#define NWM_STATS_REQUESTS 256
+
+typedef struct {
+  // NWM_STATS_MAGIC, NWM_STATS_VERSION and sizeof(nwm_stats), for external readers
+  unsigned long magic;
+  unsigned long version;
+  unsigned long size;
+  // incremented before and after every nwm_loop batch is recorded: an odd
+  // value means an update is in progress, so readers should retry
+  unsigned long sequence;
+  // per X event type: time from being read off the queue to the end of its
+  // handler (usec), the number of requests the handler sent, and how many of
+  // those waited for their reply (round trips); the rest are fire-and-forget
+  nwm_histogram handler[LASTEvent];
+  unsigned long requests[LASTEvent];
+  unsigned long round_trips[LASTEvent];
+  // per callback: time spent in the binding and JS for each emit (usec)
+  nwm_histogram callback[onLast];
+  // events per nwm_loop batch
+  nwm_histogram batch_size;
+  // one batch-mode delivery (usec)
+  nwm_histogram batch_delivery;
+  // rearrange callback including the JS layouts (usec)
+  nwm_histogram rearrange;
+  // nwm_apply_layout (usec)
+  nwm_histogram apply_layout;
+  // windows adopted at startup and how long adopting them took (usec);
+  // adopt_done is set once the startup scan has finished
+  unsigned long adopted;
+  unsigned long adopt_usec;
+  unsigned long adopt_done;
+  // X errors that did not stop nwm: benign ones are for windows that were
+  // already gone, unexpected ones came from a tracked request but are not
+  // benign; tracked counts both kinds matched to a tracked request by serial.
+  // These are also written by the reader thread in threaded mode.
+  unsigned long errors_benign;
+  unsigned long errors_unexpected;
+  unsigned long errors_tracked;
+  // benign errors by request code
+  unsigned long errors_by_request[NWM_STATS_REQUESTS];
+} nwm_stats;
+
+// monotonic time in microseconds
+extern unsigned long nwm_stats_now();
+
+extern void nwm_histogram_add(nwm_histogram *h, unsigned long value);
+// upper bound of the bucket holding the given fraction (0-1) of the values
+extern unsigned long nwm_histogram_percentile(nwm_histogram *h, double fraction);
+
+// zeroes stats, keeping the header
+extern void nwm_stats_reset(nwm_stats *stats);
+// a shared file mapping at path (e.g. /dev/shm/nwm-stats) holding a copy of
+// stats, or NULL if the file cannot be created or mapped
+extern nwm_stats* nwm_stats_share(nwm_stats *stats, const char *path);
+// unmaps what nwm_stats_share returned
+extern void nwm_stats_unshare(nwm_stats *shared);
+
+// the stats of an instance
+extern nwm_stats* nwm_get_stats(NodeWinMan *nwm);
+// moves the stats of an instance into a shared file mapping at path, where
+// it keeps recording; returns 0 on success, -1 on failure
+extern int nwm_share_stats(NodeWinMan *nwm, const char *path);
@@ -0,0 +1,102 @@
+#include <stdlib.h>
+#include <string.h>
+#include "track.h"
+
+#define TRACK_MIN_CAPACITY 16
+
+int RequestTrack_init(RequestTrack *track, unsigned int capacity) {
+  if(capacity < TRACK_MIN_CAPACITY) {
+    capacity = TRACK_MIN_CAPACITY;
+  }
+  if(!(track->ranges = malloc(capacity * sizeof(TrackedRange)))) {
+    return -1;
+  }
+  track->capacity = capacity;
+  track->start = 0;
+  track->count = 0;
+  return 0;
+}
+
+void RequestTrack_free(RequestTrack *track) {
+  free(track->ranges);
+  track->ranges = NULL;
+  track->capacity = 0;
+  track->start = 0;
+  track->count = 0;
+}
+
+void RequestTrack_retire(RequestTrack *track, unsigned long processed) {
+  TrackedRange *r;
+  // ranges end in serial order, so only the oldest ones can be done
+  while(track->count > 0) {
+    r = &track->ranges[track->start];
+    if(!r->last || r->last > processed) {
+      break;
+    }
+    track->start++;
+    track->count--;
+  }
+  if(track->count == 0) {
+    track->start = 0;
+  }
+}
+
+int RequestTrack_begin(RequestTrack *track, Window window, unsigned long first) {
+  TrackedRange *r, *grown;
+  unsigned int capacity;
+
+  if(track->start + track->count == track->capacity) {
+    if(track->start > 0) {
+      // reuse the room of the retired ranges
+      memmove(track->ranges, &track->ranges[track->start], track->count * sizeof(TrackedRange));
+      track->start = 0;
+    } else {
+      capacity = track->capacity * 2;
+      if(!(grown = realloc(track->ranges, capacity * sizeof(TrackedRange)))) {
+        return -1;
+      }
+      track->ranges = grown;
+      track->capacity = capacity;
+    }
+  }
+  r = &track->ranges[track->start + track->count];
+  r->first = first;
+  r->last = 0;
+  r->window = window;
+  track->count++;
+  return 0;
+}
+
+void RequestTrack_end(RequestTrack *track, unsigned long last) {
+  TrackedRange *r;
+  if(track->count == 0) {
+    return;
+  }
+  r = &track->ranges[track->start + track->count - 1];
+  if(last < r->first) {
+    track->count--;
+  } else {
+    r->last = last;
+  }
+}
+
+TrackedRange* RequestTrack_find(RequestTrack *track, unsigned long serial) {
+  TrackedRange *ranges = track->ranges + track->start;
+  unsigned int low = 0, high = track->count, mid;
+  // the last range starting at or before serial
+  while(low < high) {
+    mid = low + (high - low) / 2;
+    if(ranges[mid].first <= serial) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  if(low == 0) {
+    return NULL;
+  }
+  if(ranges[low - 1].last && serial > ranges[low - 1].last) {
+    return NULL;
+  }
+  return &ranges[low - 1];
+}
@@ -0,0 +1,40 @@
+#include <X11/X.h>
+
+// Serial ranges of the requests sent about client windows, which may be
+// destroyed at any time, so that their errors can be told apart from real
+// ones. Ranges are kept in serial order until the server has processed past
+// them: by then any error they caused has been delivered, so a range is never
+// dropped while its errors can still arrive.
+
+// the requests first..last were about window; last is 0 while the range is open
+typedef struct {
+  unsigned long first;
+  unsigned long last;
+  Window window;
+} TrackedRange;
+
+typedef struct {
+  TrackedRange *ranges;
+  // the live ranges are ranges[start .. start + count - 1], oldest first
+  unsigned int start;
+  unsigned int count;
+  unsigned int capacity;
+} RequestTrack;
+
+extern int RequestTrack_init(RequestTrack *track, unsigned int capacity);
+extern void RequestTrack_free(RequestTrack *track);
+
+// Drops the ranges that ended at or before processed, the last serial the
+// server is known to have processed.
+extern void RequestTrack_retire(RequestTrack *track, unsigned long processed);
+
+// Opens a range at serial first; at most one range is open at a time. Returns
+// -1 if there is no room and the ranges cannot grow.
+extern int RequestTrack_begin(RequestTrack *track, Window window, unsigned long first);
+// Closes the open range at last. A range in which nothing was sent (last <
+// first) is dropped again.
+extern void RequestTrack_end(RequestTrack *track, unsigned long last);
+
+// The range serial belongs to, or NULL. An open range matches any serial from
+// its first one on.
+extern TrackedRange* RequestTrack_find(RequestTrack *track, unsigned long serial);
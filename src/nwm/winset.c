@@ -0,0 +1,145 @@
+#include <stdlib.h>
+#include <string.h>
+#include "winset.h"
+
+#define WINSET_MIN_CAPACITY 16
+
+// Fibonacci hashing: XIDs are a client resource base plus a small counter,
+// so the low bits alone would cluster badly.
+static unsigned int winset_hash(WinSet *set, Window id) {
+  unsigned long long h = (unsigned long long) id * 11400714819323198485ULL;
+  return (unsigned int) (h >> 32) & (set->capacity - 1);
+}
+
+static int winset_alloc(WinSet *set, unsigned int capacity) {
+  if(!(set->slots = calloc(capacity, sizeof(WinRecord)))) {
+    return -1;
+  }
+  if(!(set->state = calloc(capacity, sizeof(unsigned char)))) {
+    free(set->slots);
+    set->slots = NULL;
+    return -1;
+  }
+  set->capacity = capacity;
+  set->count = 0;
+  set->deleted = 0;
+  return 0;
+}
+
+int WinSet_init(WinSet *set, unsigned int capacity) {
+  unsigned int size = WINSET_MIN_CAPACITY;
+  while(size < capacity) {
+    size <<= 1;
+  }
+  return winset_alloc(set, size);
+}
+
+// returns the slot containing id, or -1
+static int winset_find(WinSet *set, Window id) {
+  unsigned int i, probes;
+  if(!set->capacity) {
+    return -1;
+  }
+  i = winset_hash(set, id);
+  for(probes = 0; probes < set->capacity; probes++) {
+    if(set->state[i] == WINSET_EMPTY) {
+      return -1;
+    }
+    if(set->state[i] == WINSET_USED && set->slots[i].id == id) {
+      return i;
+    }
+    i = (i + 1) & (set->capacity - 1);
+  }
+  return -1;
+}
+
+// rebuild the table at the given capacity, dropping tombstones
+static int winset_rehash(WinSet *set, unsigned int capacity) {
+  WinSet old = *set;
+  unsigned int i;
+
+  if(winset_alloc(set, capacity) != 0) {
+    *set = old;
+    return -1;
+  }
+  for(i = 0; i < old.capacity; i++) {
+    if(old.state[i] == WINSET_USED) {
+      unsigned int j = winset_hash(set, old.slots[i].id);
+      while(set->state[j] == WINSET_USED) {
+        j = (j + 1) & (set->capacity - 1);
+      }
+      set->slots[j] = old.slots[i];
+      set->state[j] = WINSET_USED;
+      set->count++;
+    }
+  }
+  free(old.slots);
+  free(old.state);
+  return 0;
+}
+
+WinRecord* WinSet_get(WinSet *set, Window id) {
+  int i = winset_find(set, id);
+  return (i < 0 ? NULL : &set->slots[i]);
+}
+
+WinRecord* WinSet_add(WinSet *set, Window id) {
+  unsigned int i;
+  int tombstone = -1;
+  int found = winset_find(set, id);
+
+  if(found >= 0) {
+    return &set->slots[found];
+  }
+  // keep the load factor (including tombstones) under 3/4
+  if(!set->capacity || (set->count + set->deleted + 1) * 4 > set->capacity * 3) {
+    unsigned int size = (set->capacity ? set->capacity : WINSET_MIN_CAPACITY);
+    if((set->count + 1) * 2 > size) {
+      size <<= 1;
+    }
+    if(winset_rehash(set, size) != 0) {
+      return NULL;
+    }
+  }
+  i = winset_hash(set, id);
+  while(set->state[i] != WINSET_EMPTY) {
+    if(set->state[i] == WINSET_DELETED && tombstone < 0) {
+      tombstone = i;
+    }
+    i = (i + 1) & (set->capacity - 1);
+  }
+  if(tombstone >= 0) {
+    i = tombstone;
+    set->deleted--;
+  }
+  memset(&set->slots[i], 0, sizeof(WinRecord));
+  set->slots[i].id = id;
+  set->state[i] = WINSET_USED;
+  set->count++;
+  return &set->slots[i];
+}
+
+int WinSet_remove(WinSet *set, Window id) {
+  int i = winset_find(set, id);
+  if(i < 0) {
+    return -1;
+  }
+  set->state[i] = WINSET_DELETED;
+  set->count--;
+  set->deleted++;
+  return 0;
+}
+
+unsigned int WinSet_length(WinSet *set) {
+  return set->count;
+}
+
+void WinSet_free(WinSet *set) {
+  free(set->slots);
+  free(set->state);
+  set->slots = NULL;
+  set->state = NULL;
+  set->capacity = 0;
+  set->count = 0;
+  set->deleted = 0;
+}
@@ -0,0 +1,66 @@
+#include <X11/Xlib.h>
+
+// Open-addressing hash set of managed windows, keyed by Window id.
+// Each slot stores the per-window record inline, so a lookup is a single
+// probe sequence over one contiguous array.
+
+// title, class and instance of a window; defined by the window manager
+// (nwm.c) and kept out of line so the slots stay small
+struct WinMeta;
+
+typedef struct {
+  Window id;
+  Bool isfloating;
+  Bool fullscreen;
+  // WM_TRANSIENT_FOR at map time, or None
+  Window transient_for;
+  // fetch_protocols flags from WM_PROTOCOLS, kept current on PropertyNotify
+  unsigned char protocols;
+  // unmapped by nwm_switch_workspace; serial of that XUnmapWindow, so that
+  // the UnmapNotify it causes does not unmanage the window
+  Bool hidden;
+  unsigned long unmap_serial;
+  // last geometry sent to the server; width and height include the border
+  int x;
+  int y;
+  int width;
+  int height;
+  int border_width;
+  struct WinMeta *meta;
+} WinRecord;
+
+typedef struct {
+  WinRecord *slots;
+  // one byte per slot: WINSET_EMPTY, WINSET_USED or WINSET_DELETED
+  unsigned char *state;
+  // always a power of two
+  unsigned int capacity;
+  // number of used slots
+  unsigned int count;
+  // number of tombstones (deleted slots still on probe paths)
+  unsigned int deleted;
+} WinSet;
+
+#define WINSET_EMPTY 0
+#define WINSET_USED 1
+#define WINSET_DELETED 2
+
+extern int WinSet_init(WinSet *set, unsigned int capacity);
+
+// Returns the record for id, or NULL if the window is not in the set.
+// Record pointers stay valid until the next WinSet_add (which may grow the table).
+extern WinRecord* WinSet_get(WinSet *set, Window id);
+
+// Returns the record for id, inserting a zeroed record if it does not exist yet.
+// Returns NULL only if the table could not be grown.
+extern WinRecord* WinSet_add(WinSet *set, Window id);
+
+extern int WinSet_remove(WinSet *set, Window id);
+
+extern unsigned int WinSet_length(WinSet *set);
+
+extern void WinSet_free(WinSet *set);
+
+#define WinSet_for_each(set, i) \
+ for((i) = 0; (i) < (set)->capacity; (i)++) \
+   if((set)->state[(i)] == WINSET_USED)
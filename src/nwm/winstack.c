@@ -0,0 +1,182 @@
+#include <stdlib.h>
+#include <string.h>
+#include "winstack.h"
+
+#define WINSTACK_MIN_CAPACITY 16
+
+int WinStack_init(WinStack *stack, unsigned int capacity) {
+  if(capacity < WINSTACK_MIN_CAPACITY) {
+    capacity = WINSTACK_MIN_CAPACITY;
+  }
+  if(!(stack->ids = malloc(capacity * sizeof(Window)))) {
+    return -1;
+  }
+  stack->capacity = capacity;
+  stack->count = 0;
+  return 0;
+}
+
+void WinStack_free(WinStack *stack) {
+  free(stack->ids);
+  stack->ids = NULL;
+  stack->capacity = 0;
+  stack->count = 0;
+}
+
+void WinStack_clear(WinStack *stack) {
+  stack->count = 0;
+}
+
+int WinStack_index(WinStack *stack, Window id) {
+  unsigned int i;
+  // searched from the top, where raised and new windows are
+  for(i = stack->count; i > 0; i--) {
+    if(stack->ids[i - 1] == id) {
+      return i - 1;
+    }
+  }
+  return -1;
+}
+
+Window WinStack_top(WinStack *stack) {
+  return (stack->count ? stack->ids[stack->count - 1] : None);
+}
+
+// moves the window at from to position to, shifting the ones in between
+static void winstack_move(WinStack *stack, unsigned int from, unsigned int to) {
+  Window id = stack->ids[from];
+  if(from < to) {
+    memmove(&stack->ids[from], &stack->ids[from + 1], (to - from) * sizeof(Window));
+  } else if(from > to) {
+    memmove(&stack->ids[to + 1], &stack->ids[to], (from - to) * sizeof(Window));
+  }
+  stack->ids[to] = id;
+}
+
+int WinStack_push(WinStack *stack, Window id) {
+  int i = WinStack_index(stack, id);
+  if(i >= 0) {
+    winstack_move(stack, i, stack->count - 1);
+    return 0;
+  }
+  if(stack->count == stack->capacity) {
+    Window *ids = realloc(stack->ids, stack->capacity * 2 * sizeof(Window));
+    if(!ids) {
+      return -1;
+    }
+    stack->ids = ids;
+    stack->capacity *= 2;
+  }
+  stack->ids[stack->count++] = id;
+  return 0;
+}
+
+int WinStack_remove(WinStack *stack, Window id) {
+  int i = WinStack_index(stack, id);
+  if(i < 0) {
+    return -1;
+  }
+  winstack_move(stack, i, stack->count - 1);
+  stack->count--;
+  return 0;
+}
+
+int WinStack_place(WinStack *stack, Window id, Window sibling, int stack_mode) {
+  int from = WinStack_index(stack, id), to;
+  if(from < 0 || sibling == id || (stack_mode != Above && stack_mode != Below)) {
+    return 0;
+  }
+  if(sibling == None) {
+    to = (stack_mode == Above ? (int) stack->count - 1 : 0);
+  } else {
+    if((to = WinStack_index(stack, sibling)) < 0) {
+      return 0;
+    }
+    // the sibling shifts down by one once id is taken out below it
+    if(stack_mode == Above && from > to) {
+      to++;
+    } else if(stack_mode == Below && from < to) {
+      to--;
+    }
+  }
+  if(from == to) {
+    return 0;
+  }
+  winstack_move(stack, from, to);
+  return 1;
+}
+
+static void winstack_change(WinStack *stack, WinStackChange *change, Window id, Window sibling, int stack_mode) {
+  change->id = id;
+  change->sibling = sibling;
+  change->stack_mode = stack_mode;
+  WinStack_place(stack, id, sibling, stack_mode);
+}
+
+int WinStack_restack(WinStack *stack, Window *ids, unsigned int count, WinStackChange *changes) {
+  unsigned int i, n = 0, length = 0, total = 0, first;
+  int k, lo, hi, mid;
+  // order: the known ids, pos: their current positions, tails[l]: the last
+  // element of the best increasing run of length l + 1, prev: the element
+  // before i in its run
+  Window *order = malloc((count ? count : 1) * sizeof(Window));
+  int *pos = malloc((count ? count : 1) * 3 * sizeof(int));
+  unsigned char *seen = calloc(stack->count ? stack->count : 1, 1);
+  int *tails = pos + count, *prev = tails + count;
+  unsigned char *keep;
+
+  if(!order || !pos || !seen) {
+    free(order);
+    free(pos);
+    free(seen);
+    return -1;
+  }
+  for(i = 0; i < count; i++) {
+    if((k = WinStack_index(stack, ids[i])) >= 0 && !seen[k]) {
+      seen[k] = 1;
+      order[n] = ids[i];
+      pos[n++] = k;
+    }
+  }
+  // longest increasing run of positions: those windows already are in order
+  for(i = 0; i < n; i++) {
+    lo = 0;
+    hi = length;
+    while(lo < hi) {
+      mid = (lo + hi) / 2;
+      if(pos[tails[mid]] < pos[i]) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    prev[i] = (lo > 0 ? tails[lo - 1] : -1);
+    tails[lo] = i;
+    if((unsigned int) lo == length) {
+      length++;
+    }
+  }
+  // seen is reused to mark the kept elements of order
+  memset(seen, 0, stack->count ? stack->count : 1);
+  keep = seen;
+  if(length > 0) {
+    for(k = tails[length - 1]; k >= 0; k = prev[k]) {
+      keep[k] = 1;
+    }
+  }
+  // the windows before the first kept one go below their successor, the
+  // others right above their predecessor
+  for(first = 0; first < n && !keep[first]; first++);
+  for(i = first; i > 0; i--) {
+    winstack_change(stack, &changes[total++], order[i - 1], order[i], Below);
+  }
+  for(i = first + 1; i < n; i++) {
+    if(!keep[i]) {
+      winstack_change(stack, &changes[total++], order[i], order[i - 1], Above);
+    }
+  }
+  free(order);
+  free(pos);
+  free(seen);
+  return total;
+}
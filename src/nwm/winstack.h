@@ -0,0 +1,46 @@
+#include <X11/X.h>
+
+// Stacking order of the managed windows, bottom to top, as last sent to the
+// server. Used to skip restacking requests that would not change anything,
+// and to turn a desired order into the fewest sibling changes.
+
+typedef struct {
+  Window *ids;
+  unsigned int count;
+  unsigned int capacity;
+} WinStack;
+
+// one XConfigureWindow with CWSibling|CWStackMode
+typedef struct {
+  Window id;
+  Window sibling;
+  // Above or Below
+  int stack_mode;
+} WinStackChange;
+
+extern int WinStack_init(WinStack *stack, unsigned int capacity);
+extern void WinStack_free(WinStack *stack);
+extern void WinStack_clear(WinStack *stack);
+
+// Returns the position of id (0 is the bottom), or -1.
+extern int WinStack_index(WinStack *stack, Window id);
+// The topmost window, or None if the stack is empty.
+extern Window WinStack_top(WinStack *stack);
+
+// Puts id on top, adding it if needed. Returns -1 if the stack could not grow.
+extern int WinStack_push(WinStack *stack, Window id);
+extern int WinStack_remove(WinStack *stack, Window id);
+
+// Applies a stack_mode as XConfigureWindow would: Above or Below sibling, or
+// to the top or bottom when sibling is None. Returns 1 if the order changed,
+// 0 if it did not or cannot be known here (TopIf, BottomIf and Opposite
+// depend on overlap; unmanaged siblings are not tracked).
+extern int WinStack_place(WinStack *stack, Window id, Window sibling, int stack_mode);
+
+// Reorders the listed windows into the given order (bottom to top) relative
+// to each other, leaving the others in place. Only the windows outside the
+// longest run already in order are moved, each directly above (or, before the
+// first kept window, below) its neighbour in ids. Fills changes (room for
+// count entries) with the requests to send, in order, and returns their
+// number, or -1 if out of memory. Unknown and repeated ids are ignored.
+extern int WinStack_restack(WinStack *stack, Window *ids, unsigned int count, WinStackChange *changes);
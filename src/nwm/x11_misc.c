@@ -7,21 +7,13 @@ static const char *event_names[] = { "", "", "KeyPress", "KeyRelease",
   "ConfigureRequest", "GravityNotify", "ResizeRequest",
   "CirculateNotify", "CirculateRequest", "PropertyNotify",
   "SelectionClear", "SelectionRequest", "SelectionNotify",
-  "ColormapNotify", "ClientMessage", "MappingNotify"
+  "ColormapNotify", "ClientMessage", "MappingNotify", "GenericEvent"
 };
 
-static Bool isuniquegeom(XineramaScreenInfo *unique, size_t len, XineramaScreenInfo *info) {
-  unsigned int i;
-
-  for(i = 0; i < len; i++)
-    if(unique[i].x_org == info->x_org && unique[i].y_org == info->y_org
-    && unique[i].width == info->width && unique[i].height == info->height)
-      return False;
-  return True;
-}
-
-int xerror(Display *dpy, XErrorEvent *ee) {
-  if(ee->error_code == BadWindow
+// errors that are harmless whatever request caused them: the window or
+// drawable was destroyed in the meantime, or a grab is held by another client
+static int xerror_benign(XErrorEvent *ee) {
+  return (ee->error_code == BadWindow
   || (ee->request_code == X_SetInputFocus && ee->error_code == BadMatch)
   || (ee->request_code == X_PolyText8 && ee->error_code == BadDrawable)
   || (ee->request_code == X_PolyFillRectangle && ee->error_code == BadDrawable)
@@ -29,7 +21,13 @@ int xerror(Display *dpy, XErrorEvent *ee) {
   || (ee->request_code == X_ConfigureWindow && ee->error_code == BadMatch)
   || (ee->request_code == X_GrabButton && ee->error_code == BadAccess)
   || (ee->request_code == X_GrabKey && ee->error_code == BadAccess)
-  || (ee->request_code == X_CopyArea && ee->error_code == BadDrawable))
+  || (ee->request_code == X_KillClient && ee->error_code == BadValue)
+  || (ee->request_code == X_CopyArea && ee->error_code == BadDrawable));
+}
+
+int xerror(Display *dpy, XErrorEvent *ee) {
+  // benign and tracked errors are counted in the stats
+  if(nwm_handle_error(dpy, ee))
     return 0;
   fprintf(stdout, "nwm: fatal error: request code=%d, error code=%d\n",
       ee->request_code, ee->error_code);
@@ -38,34 +36,6 @@ int xerror(Display *dpy, XErrorEvent *ee) {
   return 0;
 }
 
-int xerrordummy(Display *dpy, XErrorEvent *ee) {
-  return 0;
-}
-
-Bool gettextprop(Display* dpy, Window w, Atom atom, char *text, unsigned int size) {
-  char **list = NULL;
-  int n;
-  XTextProperty name;
-
-  if(!text || size == 0)
-    return False;
-  text[0] = '\0';
-  XGetTextProperty(dpy, w, &name, atom);
-  if(!name.nitems)
-    return False;
-  if(name.encoding == XA_STRING)
-    strncpy(text, (char *)name.value, size - 1);
-  else {
-    if(XmbTextPropertyToTextList(dpy, &name, &list, &n) >= Success && n > 0 && *list) {
-      strncpy(text, *list, size - 1);
-      XFreeStringList(list);
-    }
-  }
-  text[size - 1] = '\0';
-  XFree(name.value);
-  return True;
-}
-
 int updatenumlockmask(Display* dpy) {
   unsigned int i;
   int j;
@@ -83,42 +53,32 @@ int updatenumlockmask(Display* dpy) {
   return numlockmask;
 }
 
-static Bool isprotodel(Display* dpy, Window win) {
+static Bool isprotodel(NodeWinMan *nwm, Display* dpy, Window win) {
   int i, n;
   Atom *protocols;
   Bool ret = False;
 
+  nwm->round_trips++;
   if(XGetWMProtocols(dpy, win, &protocols, &n)) {
     for(i = 0; !ret && i < n; i++)
-      if(protocols[i] == XInternAtom(dpy, "WM_DELETE_WINDOW", False))
+      if(protocols[i] == nwm->atoms[WMDelete])
         ret = True;
     XFree(protocols);
   }
   return ret;
 }
 
-static Bool SendEvent(Display* dpy, Window wnd, Atom proto) {
-  int n;
-  Atom *protocols;
-  Bool exists = False;
+// sends a WM_PROTOCOLS message; the caller checks that the window supports proto
+static void sendprotocol(NodeWinMan *nwm, Display* dpy, Window wnd, Atom proto) {
   XEvent ev;
 
-  if(XGetWMProtocols(dpy, wnd, &protocols, &n)) {
-    while(!exists && n--)
-      exists = protocols[n] == proto;
-    XFree(protocols);
-  }
-  if(exists) {
-    ev.type = ClientMessage;
-    ev.xclient.window = wnd;
-    Atom atom = XInternAtom(dpy, "WM_PROTOCOLS", False);
-    ev.xclient.message_type = atom;
-    ev.xclient.format = 32;
-    ev.xclient.data.l[0] = proto;
-    ev.xclient.data.l[1] = CurrentTime;
-    XSendEvent(dpy, wnd, False, NoEventMask, &ev);
-  }
-  return exists;
+  ev.type = ClientMessage;
+  ev.xclient.window = wnd;
+  ev.xclient.message_type = nwm->atoms[WMProtocols];
+  ev.xclient.format = 32;
+  ev.xclient.data.l[0] = proto;
+  ev.xclient.data.l[1] = CurrentTime;
+  XSendEvent(dpy, wnd, False, NoEventMask, &ev);
 }
 
 Bool getrootptr(Display* dpy, Window root, int *x, int *y) {
@@ -129,37 +89,71 @@ Bool getrootptr(Display* dpy, Window root, int *x, int *y) {
   return XQueryPointer(dpy, root, &dummy, &dummy, x, y, &di, &di, &dui);
 }
 
-void grabButtons(Window wnd, Bool focused) {
-  return; // TODO TODO
-  // updatenumlockmask();
-//    {
-//      unsigned int i;
-//      unsigned int modifiers[] = { 0, LockMask, this->numlockmask, this->numlockmask|LockMask };
-//      XUngrabButton(this->dpy, AnyButton, AnyModifier, wnd);
-// If focused, then we only grab the modifier keys. Otherwise, we grab all buttons..
-//      if(focused) {
-//        fprintf( stdout, "GRABBUTTONS - focused: true\n");
-//          for(i = 0; i < 4; i++) {
-//            XGrabButton(dpy, Button1,
-//                              Mod4Mask|ControlMask|modifiers[i],
-//                              wnd, False, (ButtonPressMask|ButtonReleaseMask),
-//                              GrabModeAsync, GrabModeSync, None, None);
-//          }
-//      } else {
-//        fprintf( stdout, "GRABBUTTONS - focused: false\n");
-//        XGrabButton(this->dpy, AnyButton, AnyModifier, wnd, False,
-//                    (ButtonPressMask|ButtonReleaseMask), GrabModeAsync, GrabModeSync, None, None);
-//      }
-//    }
+// Grabs the drag buttons (drag modifier + Button1 / Button3) on a managed window.
+void grabButtons(NodeWinMan *nwm, Window wnd, Bool focused) {
+  unsigned int i;
+  unsigned int modifiers[] = { 0, LockMask, nwm->numlockmask, nwm->numlockmask|LockMask };
+  XUngrabButton(nwm->dpy, AnyButton, AnyModifier, wnd);
+  if(!nwm->drag_modifier) {
+    return;
+  }
+  for(i = 0; i < 4; i++) {
+    XGrabButton(nwm->dpy, Button1, nwm->drag_modifier|modifiers[i], wnd, False,
+        ButtonPressMask|ButtonReleaseMask, GrabModeAsync, GrabModeAsync, None, None);
+    XGrabButton(nwm->dpy, Button3, nwm->drag_modifier|modifiers[i], wnd, False,
+        ButtonPressMask|ButtonReleaseMask, GrabModeAsync, GrabModeAsync, None, None);
+  }
 }
 
-unsigned long getcolor(const char *colstr) {
-  Colormap cmap = DefaultColormap(nwm.dpy, nwm.screen);
+// Looks up an allocated color by name, allocating it on a cache miss.
+Bool lookupcolor(NodeWinMan *nwm, const char *colstr, unsigned long *pixel) {
+  Colormap cmap = DefaultColormap(nwm->dpy, nwm->screen);
   XColor color;
+  unsigned int i;
+  ColorCacheEntry *entry;
+
+  for(i = 0; i < nwm->total_colors; i++) {
+    if(strcmp(nwm->colors[i].name, colstr) == 0) {
+      *pixel = nwm->colors[i].pixel;
+      return True;
+    }
+  }
+  if(strlen(colstr) >= COLOR_NAME_LEN) {
+    return False;
+  }
+  nwm->round_trips++;
+  if(!XAllocNamedColor(nwm->dpy, cmap, colstr, &color, &color)) {
+    return False;
+  }
+  *pixel = color.pixel;
+  if(nwm->total_colors < COLOR_CACHE_SIZE) {
+    entry = &nwm->colors[nwm->total_colors++];
+  } else {
+    // evict round-robin, but never the pixels currently used for borders
+    for(i = 0; i < COLOR_CACHE_SIZE; i++) {
+      entry = &nwm->colors[nwm->next_color];
+      nwm->next_color = (nwm->next_color + 1) % COLOR_CACHE_SIZE;
+      if(entry->pixel != nwm->normal_pixel && entry->pixel != nwm->active_pixel) {
+        break;
+      }
+    }
+    if(i == COLOR_CACHE_SIZE) {
+      // everything cached is in use, so leave this color uncached
+      return True;
+    }
+    XFreeColors(nwm->dpy, cmap, &entry->pixel, 1, 0);
+  }
+  strcpy(entry->name, colstr);
+  entry->pixel = color.pixel;
+  return True;
+}
+
+unsigned long getcolor(NodeWinMan *nwm, const char *colstr) {
+  unsigned long pixel;
 
-  if(!XAllocNamedColor(nwm.dpy, cmap, colstr, &color, &color)) {
+  if(!lookupcolor(nwm, colstr, &pixel)) {
     fprintf( stdout, "error, cannot allocate color '%s'\n", colstr);
     exit( -1 );
   }
-  return color.pixel;
+  return pixel;
 }
@@ -0,0 +1,123 @@
+#include <math.h>
+#include <stdio.h>
+#include "nwm.h"
+#include "layout.h"
+#include "minunit.h"
+
+int tests_run = 0;
+
+static Window ids[] = { 1, 2, 3, 4, 5, 6, 7 };
+static nwm_geometry out[7];
+
+static void monitor(nwm_monitor *m, int x, int y, int width, int height) {
+  m->id = 0;
+  m->x = x;
+  m->y = y;
+  m->width = width;
+  m->height = height;
+}
+
+// expected holds x, y, width, height per window, as the JS layout places them
+static int placed(int *expected, unsigned int count) {
+  unsigned int i;
+  for(i = 0; i < count; i++) {
+    int *e = &expected[i * 4];
+    if(out[i].id != ids[i] || out[i].x != e[0] || out[i].y != e[1] || out[i].width != e[2] || out[i].height != e[3]) {
+      printf("window %u: %d, %d, %d, %d\n", i, out[i].x, out[i].y, out[i].width, out[i].height);
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static char * test_layout_tile() {
+  nwm_monitor m;
+  // from lib/layouts/tile.js; 1000 * 3 / 100 would be 30
+  int four[] = { 0, 0, 29, 768, 29, 0, 971, 256, 29, 256, 971, 256, 29, 512, 971, 256 };
+  int one[] = { 0, 0, 1000, 768 };
+  int scale, width;
+
+  monitor(&m, 0, 0, 1000, 768);
+  mu_assert("Tile places every window", nwm_layout(layoutTile, &m, ids, 4, 3, -1, out) == 4);
+  mu_assert("Tile as in JS", placed(four, 4));
+  mu_assert("A single window fills the monitor", nwm_layout(layoutTile, &m, ids, 1, 3, -1, out) == 1 && placed(one, 1));
+
+  // the main window width is Math.floor(width / (100 / scale)) for every scale
+  for(scale = 1; scale < 100; scale++) {
+    for(width = 1; width <= 4000; width += 7) {
+      monitor(&m, 0, 0, width, 768);
+      nwm_layout(layoutTile, &m, ids, 2, scale, -1, out);
+      mu_assert("Main width as in JS", out[0].width == (int) floor(width / (100.0 / scale)));
+      mu_assert("The stack takes the rest", out[1].x == out[0].width && out[1].width == width - out[0].width);
+    }
+  }
+  return 0;
+}
+
+static char * test_layout_wide() {
+  nwm_monitor m;
+  // from lib/layouts/wide.js
+  int three[] = { 0, 0, 1024, 26, 0, 26, 512, 874, 512, 26, 512, 874 };
+  int scale, height;
+
+  monitor(&m, 0, 0, 1024, 900);
+  mu_assert("Wide places every window", nwm_layout(layoutWide, &m, ids, 3, 3, -1, out) == 3);
+  mu_assert("Wide as in JS", placed(three, 3));
+
+  for(scale = 1; scale < 100; scale++) {
+    for(height = 1; height <= 4000; height += 7) {
+      monitor(&m, 0, 0, 1024, height);
+      nwm_layout(layoutWide, &m, ids, 2, scale, -1, out);
+      mu_assert("Main height as in JS", out[0].height == (int) floor(height / (100.0 / scale)));
+    }
+  }
+  return 0;
+}
+
+static char * test_layout_grid() {
+  nwm_monitor m;
+  // from lib/layouts/grid.js, on an odd sized monitor that is not at the origin
+  int three[] = { 10, 20, 500, 383, 510, 20, 500, 383, 10, 403, 1001, 383 };
+  int five[] = { 10, 20, 333, 383, 343, 20, 333, 383, 677, 20, 333, 383,
+    10, 403, 500, 383, 510, 403, 500, 383 };
+  int seven[] = { 10, 20, 333, 255, 343, 20, 333, 255, 677, 20, 333, 255,
+    10, 275, 333, 255, 343, 275, 333, 255, 677, 275, 333, 255, 10, 531, 1001, 255 };
+
+  monitor(&m, 10, 20, 1001, 767);
+  mu_assert("Grid of 3", nwm_layout(layoutGrid, &m, ids, 3, 50, -1, out) == 3 && placed(three, 3));
+  mu_assert("Grid of 5", nwm_layout(layoutGrid, &m, ids, 5, 50, -1, out) == 5 && placed(five, 5));
+  mu_assert("Grid of 7", nwm_layout(layoutGrid, &m, ids, 7, 50, -1, out) == 7 && placed(seven, 7));
+  return 0;
+}
+
+static char * test_layout_monocle() {
+  nwm_monitor m;
+  int main_window[] = { 10, 20, 1001, 767 };
+
+  monitor(&m, 10, 20, 1001, 767);
+  mu_assert("Monocle only places the main window", nwm_layout(layoutMonocle, &m, ids, 5, 50, -1, out) == 1);
+  mu_assert("Monocle fills the monitor", placed(main_window, 1));
+  mu_assert("Unknown layout", nwm_layout(layoutLast, &m, ids, 5, 50, -1, out) == 0);
+  mu_assert("Lookup by name", nwm_layout_lookup("monocle") == layoutMonocle && nwm_layout_lookup("spiral") == -1);
+  return 0;
+}
+
+static char * all_tests() {
+  mu_run_test(test_layout_tile);
+  mu_run_test(test_layout_wide);
+  mu_run_test(test_layout_grid);
+  mu_run_test(test_layout_monocle);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  char *result = all_tests();
+  if (result != 0) {
+    printf("\033[41m\t\tFAIL:\033[m %s\n", result);
+  } else {
+    printf("\033[42m\t\tPASS\t\t\033[m\n");
+  }
+  printf("%d tests\n", tests_run);
+
+  return result != 0;
+}
@@ -1,4 +1,6 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
 #include "list.h"
 #include "minunit.h"
 
@@ -22,7 +24,8 @@ const char *a = "A";
  List* keys;
 
 static char * test_list_create() {
-  items = List_list((void*) a);
+  items = NULL;
+  List_push(&items, (void*) a);
 
   mu_assert("Length is 1", List_length(items) == 1);
 
@@ -31,20 +34,150 @@ static char * test_list_create() {
 }
 
 static char * test_list_push_remove() {
-  items = List_list((void*) a);
+  items = NULL;
+  List_push(&items, (void*) a);
 
-  List *second = List_push(items, (void*) "B");
+  List *second = List_push(&items, (void*) "B");
   mu_assert("Length is 2", List_length(items) == 2);
-  List_remove(items, second);
+  List_remove(&items, second);
   mu_assert("Length is 1", List_length(items) == 1);
 
   List_free(items);
   return 0;
 }
 
+static char * test_list_remove_missing() {
+  List *other = NULL;
+  items = NULL;
+  List_push(&items, (void*) a);
+  List_push(&items, (void*) "B");
+  List_push(&other, (void*) "C");
+
+  mu_assert("Removing a foreign node fails", List_remove(&items, other) == -1);
+  mu_assert("Length is 2", List_length(items) == 2);
+  mu_assert("Removing from an empty list fails", List_remove(&windows, other) == -1);
+
+  List_free(items);
+  List_free(other);
+  return 0;
+}
+
+static char * test_list_node_recycling() {
+  items = NULL;
+  List_push(&items, (void*) a);
+  List *node = List_push(&items, (void*) "B");
+  List_remove(&items, node);
+  // the released node is handed out again instead of new heap memory
+  mu_assert("Released node is reused", List_push(&items, (void*) "C") == node);
+  mu_assert("Reused node is initialized", node->data == (void*) "C" && node->next != NULL);
+
+  List_free(items);
+  return 0;
+}
+
+typedef struct {
+  unsigned int mod;
+  unsigned long keysym;
+  void *next;
+} KeyRecord;
+
+static char * test_pool_items() {
+  Pool pool;
+  KeyRecord *records[200];
+  int i;
+  Pool_init(&pool, sizeof(KeyRecord), 32);
+
+  // spans several blocks; every item must hold a full record
+  for(i = 0; i < 200; i++) {
+    records[i] = Pool_alloc(&pool);
+    mu_assert("Pool hands out an item", records[i] != NULL);
+    records[i]->mod = i;
+    records[i]->keysym = i * 2;
+    records[i]->next = records[i];
+  }
+  for(i = 0; i < 200; i++) {
+    mu_assert("Items do not overlap", records[i]->mod == (unsigned int) i
+      && records[i]->keysym == (unsigned long) i * 2 && records[i]->next == records[i]);
+  }
+  mu_assert("Live count is 200", pool.live == 200);
+  Pool_release(&pool, records[10]);
+  mu_assert("Released item is reused", Pool_alloc(&pool) == records[10]);
+
+  Pool_free(&pool);
+  mu_assert("Pool is empty after free", pool.live == 0 && pool.blocks == NULL);
+  return 0;
+}
+
+// Map/unmap churn benchmark: keep a working set of windows and repeatedly
+// add a window and remove an older one, as nwm does while windows come and go.
+#define CHURN_WORKING_SET 150
+#define CHURN_ROUNDS 2000000
+
+typedef struct Malloc_List_T {
+  struct Malloc_List_T *next;
+  void *data;
+} MallocList;
+
+static void malloc_push(MallocList **list, void *data) {
+  MallocList *node = malloc(sizeof(MallocList));
+  node->data = data;
+  node->next = *list;
+  *list = node;
+}
+
+static void malloc_remove_second(MallocList **list) {
+  MallocList *node = (*list)->next;
+  (*list)->next = node->next;
+  free(node);
+}
+
+static double churn_pool() {
+  List *list = NULL;
+  long i;
+  clock_t start = clock();
+  for(i = 0; i < CHURN_WORKING_SET; i++) {
+    List_push(&list, (void *) i);
+  }
+  for(i = 0; i < CHURN_ROUNDS; i++) {
+    List_push(&list, (void *) i);
+    List_remove(&list, list->next);
+  }
+  List_free(list);
+  return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+static double churn_malloc() {
+  MallocList *list = NULL, *next;
+  long i;
+  clock_t start = clock();
+  for(i = 0; i < CHURN_WORKING_SET; i++) {
+    malloc_push(&list, (void *) i);
+  }
+  for(i = 0; i < CHURN_ROUNDS; i++) {
+    malloc_push(&list, (void *) i);
+    malloc_remove_second(&list);
+  }
+  for( ; list; list = next) {
+    next = list->next;
+    free(list);
+  }
+  return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+static void bench_churn() {
+  double pooled = churn_pool();
+  double plain = churn_malloc();
+  printf("churn (%d rounds, %d live nodes): pool %.3fs (%.1f ns/op), malloc %.3fs (%.1f ns/op)\n",
+    CHURN_ROUNDS, CHURN_WORKING_SET,
+    pooled, pooled * 1e9 / CHURN_ROUNDS, plain, plain * 1e9 / CHURN_ROUNDS);
+}
+
 static char * all_tests() {
   mu_run_test(test_list_create);
   mu_run_test(test_list_push_remove);
+  mu_run_test(test_list_remove_missing);
+  mu_run_test(test_list_node_recycling);
+  mu_run_test(test_pool_items);
   return 0;
 }
 
@@ -56,6 +189,9 @@ int main(int argc, char **argv) {
     printf("\033[42m\t\tPASS\t\t\033[m\n");
   }
   printf("%d tests\n", tests_run);
+  if (result == 0) {
+    bench_churn();
+  }
 
   return result != 0;
 }
@@ -0,0 +1,63 @@
+#include <stdio.h>
+#include "log.h"
+#include "minunit.h"
+
+int tests_run = 0;
+
+static char * test_log_levels() {
+  nwm_set_log_level(NWM_LOG_WARN);
+  nwm_log(NWM_LOG_ERROR, "error %d\n", 1);
+  nwm_log(NWM_LOG_WARN, "warn %d\n", 2);
+  nwm_log(NWM_LOG_INFO, "info %d\n", 3);
+  nwm_log(NWM_LOG_TRACE, "trace %d\n", 4);
+  mu_assert("Only enabled levels are buffered", nwm_log_flush() == 2);
+  mu_assert("Flushing twice writes nothing", nwm_log_flush() == 0);
+  return 0;
+}
+
+static char * test_log_arguments_not_evaluated() {
+  int calls = 0;
+  nwm_set_log_level(NWM_LOG_ERROR);
+  nwm_log(NWM_LOG_DEBUG, "%d\n", calls++);
+  mu_assert("Disabled sites do not evaluate arguments", calls == 0);
+  return 0;
+}
+
+static char * test_log_overflow() {
+  int i;
+  nwm_set_log_level(NWM_LOG_INFO);
+  for(i = 0; i < 1000; i++) {
+    nwm_log(NWM_LOG_INFO, "message %d", i);
+  }
+  // the buffer holds 256 messages, the rest are counted as dropped
+  mu_assert("Full buffer keeps the oldest messages", nwm_log_flush() == 256);
+  nwm_log(NWM_LOG_INFO, "after overflow");
+  mu_assert("Buffer is usable after a flush", nwm_log_flush() == 1);
+  return 0;
+}
+
+static char * test_log_level_lookup() {
+  mu_assert("Known level", nwm_log_level_lookup("debug") == NWM_LOG_DEBUG);
+  mu_assert("Unknown level", nwm_log_level_lookup("verbose") == -1);
+  return 0;
+}
+
+static char * all_tests() {
+  mu_run_test(test_log_levels);
+  mu_run_test(test_log_arguments_not_evaluated);
+  mu_run_test(test_log_overflow);
+  mu_run_test(test_log_level_lookup);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  char *result = all_tests();
+  if (result != 0) {
+    printf("\033[41m\t\tFAIL:\033[m %s\n", result);
+  } else {
+    printf("\033[42m\t\tPASS\t\t\033[m\n");
+  }
+  printf("%d tests\n", tests_run);
+
+  return result != 0;
+}
@@ -0,0 +1,117 @@
+#define _POSIX_C_SOURCE 200112L
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include "ring.h"
+#include "minunit.h"
+
+int tests_run = 0;
+
+static char * test_ring_push_pop() {
+  Ring ring;
+  int *slot;
+  Ring_init(&ring, sizeof(int), 3);
+
+  mu_assert("Capacity is a power of two", ring.capacity == 4);
+  mu_assert("Empty ring has nothing to peek", Ring_peek(&ring) == NULL);
+  *(int *) Ring_reserve(&ring) = 1;
+  mu_assert("Reserved item is not visible yet", Ring_peek(&ring) == NULL);
+  Ring_push(&ring);
+  *(int *) Ring_reserve(&ring) = 2;
+  Ring_push(&ring);
+  mu_assert("Length is 2", Ring_length(&ring) == 2);
+  slot = Ring_peek(&ring);
+  mu_assert("Oldest item first", slot && *slot == 1);
+  mu_assert("Peek does not consume", Ring_peek(&ring) == slot);
+  Ring_pop(&ring);
+  slot = Ring_peek(&ring);
+  mu_assert("Then the next one", slot && *slot == 2);
+  Ring_pop(&ring);
+  mu_assert("Empty again", Ring_peek(&ring) == NULL && Ring_length(&ring) == 0);
+
+  Ring_free(&ring);
+  return 0;
+}
+
+static char * test_ring_full_and_wrap() {
+  Ring ring;
+  int i;
+  Ring_init(&ring, sizeof(int), 4);
+
+  for(i = 0; i < 4; i++) {
+    *(int *) Ring_reserve(&ring) = i;
+    Ring_push(&ring);
+  }
+  mu_assert("Full ring has no slot", Ring_reserve(&ring) == NULL);
+  // keep one item in flight while wrapping around many times
+  for(i = 4; i < 1000; i++) {
+    mu_assert("In order across the wrap", *(int *) Ring_peek(&ring) == i - 4);
+    Ring_pop(&ring);
+    *(int *) Ring_reserve(&ring) = i;
+    Ring_push(&ring);
+  }
+  mu_assert("Still full", Ring_length(&ring) == 4);
+
+  Ring_free(&ring);
+  return 0;
+}
+
+#define THREADED_ITEMS 100000
+
+static void* produce(void *arg) {
+  Ring *ring = arg;
+  unsigned long i;
+  for(i = 0; i < THREADED_ITEMS; i++) {
+    unsigned long *slot;
+    while(!(slot = Ring_reserve(ring))) {
+      sched_yield();
+    }
+    slot[0] = i;
+    slot[1] = i * 3;
+    Ring_push(ring);
+  }
+  return NULL;
+}
+
+static char * test_ring_threaded() {
+  Ring ring;
+  pthread_t producer;
+  unsigned long i, ordered = 1;
+  Ring_init(&ring, 2 * sizeof(unsigned long), 64);
+
+  pthread_create(&producer, NULL, produce, &ring);
+  for(i = 0; i < THREADED_ITEMS; i++) {
+    unsigned long *slot;
+    while(!(slot = Ring_peek(&ring))) {
+      sched_yield();
+    }
+    // both words must be complete when the item becomes visible
+    ordered &= (slot[0] == i && slot[1] == i * 3);
+    Ring_pop(&ring);
+  }
+  pthread_join(producer, NULL);
+  mu_assert("Items arrive complete and in order", ordered);
+  mu_assert("Nothing is left", Ring_length(&ring) == 0);
+
+  Ring_free(&ring);
+  return 0;
+}
+
+static char * all_tests() {
+  mu_run_test(test_ring_push_pop);
+  mu_run_test(test_ring_full_and_wrap);
+  mu_run_test(test_ring_threaded);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  char *result = all_tests();
+  if (result != 0) {
+    printf("\033[41m\t\tFAIL:\033[m %s\n", result);
+  } else {
+    printf("\033[42m\t\tPASS\t\t\033[m\n");
+  }
+  printf("%d tests\n", tests_run);
+
+  return result != 0;
+}
@@ -0,0 +1,94 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "fetch.h"
+#include "session.h"
+#include "minunit.h"
+
+int tests_run = 0;
+
+static const char *path = "./tests/session.test.snapshot";
+
+static void add(nwm_session *session, Window id, const char *title) {
+  nwm_session_window *saved = nwm_session_append(session);
+  memset(saved, 0, sizeof(nwm_session_window));
+  saved->id = id;
+  strcpy(saved->title, title);
+}
+
+static char * test_session_write_and_reopen() {
+  nwm_session *session;
+  nwm_session_window *saved;
+
+  unlink(path);
+  session = nwm_session_open(path);
+  mu_assert("Opens a new file", session != NULL);
+  mu_assert("A new file is not a snapshot", !nwm_session_valid(session, 1));
+
+  nwm_session_begin(session, 1);
+  mu_assert("Incomplete while writing", !nwm_session_valid(session, 1));
+  add(session, 30, "c");
+  add(session, 10, "a");
+  add(session, 20, "b");
+  mu_assert("State is stored", nwm_session_set_state(session, "{}", 2) == 0);
+  nwm_session_end(session);
+  mu_assert("Valid once written", nwm_session_valid(session, 1));
+  mu_assert("Windows are sorted", session->windows[0].id == 10 && session->windows[2].id == 30);
+  nwm_session_close(session);
+
+  session = nwm_session_open(path);
+  mu_assert("Reopens the file", session != NULL);
+  mu_assert("Still valid", nwm_session_valid(session, 1));
+  mu_assert("Not valid for another root", !nwm_session_valid(session, 2));
+  saved = nwm_session_find(session, 20);
+  mu_assert("Finds a window", saved && !strcmp(saved->title, "b"));
+  mu_assert("Misses unknown windows", nwm_session_find(session, 25) == NULL);
+  mu_assert("State survives", session->state_length == 2 && !memcmp(session->state, "{}", 2));
+  nwm_session_close(session);
+  unlink(path);
+  return 0;
+}
+
+static char * test_session_limits() {
+  nwm_session *session;
+  int i;
+
+  unlink(path);
+  session = nwm_session_open(path);
+  nwm_session_begin(session, 1);
+  for(i = 0; i < NWM_SESSION_WINDOWS; i++) {
+    add(session, i + 1, "");
+  }
+  mu_assert("Full snapshot takes no more windows", nwm_session_append(session) == NULL);
+  mu_assert("Oversized state is refused", nwm_session_set_state(session, "", NWM_SESSION_STATE_LEN + 1) == -1);
+  nwm_session_end(session);
+
+  // an interrupted write is not used, and the next write starts over
+  session->sequence++;
+  mu_assert("Interrupted snapshot is invalid", !nwm_session_valid(session, 1));
+  nwm_session_begin(session, 1);
+  mu_assert("Starts over", session->count == 0 && session->state_length == 0);
+  nwm_session_end(session);
+  mu_assert("Valid again", nwm_session_valid(session, 1));
+  nwm_session_close(session);
+  unlink(path);
+  return 0;
+}
+
+static char * all_tests() {
+  mu_run_test(test_session_write_and_reopen);
+  mu_run_test(test_session_limits);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  char *result = all_tests();
+  if (result != 0) {
+    printf("\033[41m\t\tFAIL:\033[m %s\n", result);
+  } else {
+    printf("\033[42m\t\tPASS\t\t\033[m\n");
+  }
+  printf("%d tests\n", tests_run);
+
+  return result != 0;
+}
@@ -0,0 +1,83 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "nwm.h"
+#include "stats.h"
+#include "minunit.h"
+
+int tests_run = 0;
+
+static char * test_histogram_buckets() {
+  nwm_histogram h;
+  memset(&h, 0, sizeof(nwm_histogram));
+  nwm_histogram_add(&h, 0);
+  nwm_histogram_add(&h, 1);
+  nwm_histogram_add(&h, 3);
+  nwm_histogram_add(&h, 1000);
+  mu_assert("Zero goes to bucket 0", h.buckets[0] == 1);
+  mu_assert("1 goes to bucket 1", h.buckets[1] == 1);
+  mu_assert("3 goes to bucket 2", h.buckets[2] == 1);
+  mu_assert("1000 goes to bucket 10", h.buckets[10] == 1);
+  mu_assert("Count, total and max are kept", h.count == 4 && h.total == 1004 && h.max == 1000);
+  nwm_histogram_add(&h, ~0UL);
+  mu_assert("Huge values go to the last bucket", h.buckets[NWM_STATS_BUCKETS - 1] == 1);
+  return 0;
+}
+
+static char * test_histogram_percentile() {
+  nwm_histogram h;
+  int i;
+  memset(&h, 0, sizeof(nwm_histogram));
+  mu_assert("Empty histogram", nwm_histogram_percentile(&h, 0.5) == 0);
+  for(i = 0; i < 99; i++) {
+    nwm_histogram_add(&h, 10);
+  }
+  nwm_histogram_add(&h, 5000);
+  // 10 is in [8, 16)
+  mu_assert("p50 is the bucket bound", nwm_histogram_percentile(&h, 0.5) == 15);
+  mu_assert("p99 is still in the common bucket", nwm_histogram_percentile(&h, 0.99) == 15);
+  mu_assert("p100 is the max", nwm_histogram_percentile(&h, 1.0) == 5000);
+  return 0;
+}
+
+static char * test_stats_share() {
+  char path[] = "/tmp/nwm-stats-test";
+  FILE *f;
+  nwm_stats stats, copy, *shared;
+  nwm_stats_reset(&stats);
+  nwm_histogram_add(&stats.rearrange, 42);
+  shared = nwm_stats_share(&stats, path);
+  mu_assert("Sharing succeeds", shared != NULL);
+  mu_assert("Shared stats keep the recorded values", shared->rearrange.count == 1);
+  nwm_histogram_add(&shared->rearrange, 7);
+  // an external reader sees the live values
+  f = fopen(path, "rb");
+  mu_assert("Shared file exists", f != NULL);
+  mu_assert("Shared file has the whole struct", fread(&copy, sizeof(nwm_stats), 1, f) == 1);
+  fclose(f);
+  unlink(path);
+  nwm_stats_unshare(shared);
+  mu_assert("Header is set", copy.magic == NWM_STATS_MAGIC && copy.size == sizeof(nwm_stats));
+  mu_assert("Reader sees updates", copy.rearrange.count == 2 && copy.rearrange.total == 49);
+  mu_assert("The original is left alone", stats.rearrange.count == 1);
+  return 0;
+}
+
+static char * all_tests() {
+  mu_run_test(test_histogram_buckets);
+  mu_run_test(test_histogram_percentile);
+  mu_run_test(test_stats_share);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  char *result = all_tests();
+  if (result != 0) {
+    printf("\033[41m\t\tFAIL:\033[m %s\n", result);
+  } else {
+    printf("\033[42m\t\tPASS\t\t\033[m\n");
+  }
+  printf("%d tests\n", tests_run);
+
+  return result != 0;
+}
@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include "track.h"
+#include "minunit.h"
+
+int tests_run = 0;
+
+static char * test_track_find() {
+  RequestTrack track;
+  RequestTrack_init(&track, 0);
+
+  mu_assert("Nothing tracked", RequestTrack_find(&track, 1) == NULL);
+  RequestTrack_begin(&track, 10, 5);
+  mu_assert("An open range matches from its first serial on",
+    RequestTrack_find(&track, 5) && RequestTrack_find(&track, 100)->window == 10);
+  mu_assert("But not before", RequestTrack_find(&track, 4) == NULL);
+  RequestTrack_end(&track, 7);
+  mu_assert("Closed", RequestTrack_find(&track, 7)->window == 10 && RequestTrack_find(&track, 8) == NULL);
+
+  // nothing sent between begin and end
+  RequestTrack_begin(&track, 11, 8);
+  RequestTrack_end(&track, 7);
+  mu_assert("Empty range is dropped", track.count == 1 && RequestTrack_find(&track, 8) == NULL);
+
+  RequestTrack_begin(&track, 12, 10);
+  RequestTrack_end(&track, 12);
+  mu_assert("Gap between ranges", RequestTrack_find(&track, 9) == NULL);
+  mu_assert("Second range", RequestTrack_find(&track, 10)->window == 12);
+  mu_assert("First range", RequestTrack_find(&track, 6)->window == 10);
+
+  RequestTrack_free(&track);
+  return 0;
+}
+
+static char * test_track_retire() {
+  RequestTrack track;
+  unsigned int i;
+  RequestTrack_init(&track, 0);
+
+  // one layout over many more windows than the initial capacity
+  for(i = 0; i < 1000; i++) {
+    mu_assert("Grows", RequestTrack_begin(&track, 100 + i, 1 + i * 2) == 0);
+    RequestTrack_end(&track, 2 + i * 2);
+  }
+  mu_assert("Every range is kept until processed", track.count == 1000);
+  mu_assert("The first window is still matched", RequestTrack_find(&track, 2)->window == 100);
+  mu_assert("And the last", RequestTrack_find(&track, 1999)->window == 1099);
+
+  RequestTrack_retire(&track, 1001);
+  mu_assert("Retired up to the processed serial", track.count == 500);
+  mu_assert("Retired ranges no longer match", RequestTrack_find(&track, 1000) == NULL);
+  mu_assert("A range that ended later is kept", RequestTrack_find(&track, 1002)->window == 600);
+
+  RequestTrack_begin(&track, 5, 3000);
+  RequestTrack_retire(&track, 5000);
+  mu_assert("The open range is kept", track.count == 1 && RequestTrack_find(&track, 3000)->window == 5);
+  RequestTrack_end(&track, 3001);
+  RequestTrack_retire(&track, 5000);
+  mu_assert("All retired", track.count == 0);
+
+  // the space of the retired ranges is reused
+  for(i = 0; i < track.capacity; i++) {
+    RequestTrack_begin(&track, 1, 6000 + i);
+    RequestTrack_end(&track, 6000 + i);
+  }
+  RequestTrack_retire(&track, 6000);
+  i = track.capacity;
+  RequestTrack_begin(&track, 2, 9000);
+  RequestTrack_end(&track, 9000);
+  mu_assert("Compacted instead of grown", track.capacity == i && track.start == 0);
+  mu_assert("Still in order", RequestTrack_find(&track, 6001)->first == 6001
+    && RequestTrack_find(&track, 9000)->window == 2);
+
+  RequestTrack_free(&track);
+  return 0;
+}
+
+static char * all_tests() {
+  mu_run_test(test_track_find);
+  mu_run_test(test_track_retire);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  char *result = all_tests();
+  if (result != 0) {
+    printf("\033[41m\t\tFAIL:\033[m %s\n", result);
+  } else {
+    printf("\033[42m\t\tPASS\t\t\033[m\n");
+  }
+  printf("%d tests\n", tests_run);
+
+  return result != 0;
+}
@@ -0,0 +1,89 @@
+#include <stdio.h>
+#include "winset.h"
+#include "minunit.h"
+
+int tests_run = 0;
+
+static char * test_winset_add_get() {
+  WinSet set;
+  WinSet_init(&set, 0);
+
+  WinRecord *record = WinSet_add(&set, 0x1200001);
+  mu_assert("Add returns a record", record != NULL);
+  mu_assert("Record has the id", record->id == 0x1200001);
+  record->isfloating = True;
+  mu_assert("Get finds the record", WinSet_get(&set, 0x1200001) == record);
+  mu_assert("Record is stored inline", WinSet_get(&set, 0x1200001)->isfloating == True);
+  mu_assert("Adding twice returns the same record", WinSet_add(&set, 0x1200001) == record);
+  mu_assert("Length is 1", WinSet_length(&set) == 1);
+  mu_assert("Unknown id is not found", WinSet_get(&set, 0x1200002) == NULL);
+
+  WinSet_free(&set);
+  return 0;
+}
+
+static char * test_winset_remove() {
+  WinSet set;
+  WinSet_init(&set, 0);
+
+  WinSet_add(&set, 1);
+  WinSet_add(&set, 2);
+  mu_assert("Remove known id", WinSet_remove(&set, 1) == 0);
+  mu_assert("Remove unknown id", WinSet_remove(&set, 1) == -1);
+  mu_assert("Removed id is gone", WinSet_get(&set, 1) == NULL);
+  mu_assert("Other id remains", WinSet_get(&set, 2) != NULL);
+  mu_assert("Length is 1", WinSet_length(&set) == 1);
+
+  WinSet_free(&set);
+  return 0;
+}
+
+static char * test_winset_grow_and_churn() {
+  WinSet set;
+  Window i;
+  unsigned int slot, seen = 0;
+  WinSet_init(&set, 0);
+
+  // XIDs from the same client share a resource base
+  for(i = 0; i < 1000; i++) {
+    WinSet_add(&set, 0x1a00000 + i);
+  }
+  mu_assert("Length is 1000", WinSet_length(&set) == 1000);
+  for(i = 0; i < 1000; i++) {
+    mu_assert("Every id is found after growing", WinSet_get(&set, 0x1a00000 + i) != NULL);
+  }
+  WinSet_for_each(&set, slot) {
+    seen++;
+  }
+  mu_assert("Iteration visits every record", seen == 1000);
+
+  // map/unmap churn must not fill the table with tombstones
+  for(i = 0; i < 100000; i++) {
+    WinSet_add(&set, 0x2000000 + i);
+    WinSet_remove(&set, 0x2000000 + i);
+  }
+  mu_assert("Churn keeps the length", WinSet_length(&set) == 1000);
+  mu_assert("Churn does not grow the table", set.capacity <= 4096);
+
+  WinSet_free(&set);
+  return 0;
+}
+
+static char * all_tests() {
+  mu_run_test(test_winset_add_get);
+  mu_run_test(test_winset_remove);
+  mu_run_test(test_winset_grow_and_churn);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  char *result = all_tests();
+  if (result != 0) {
+    printf("\033[41m\t\tFAIL:\033[m %s\n", result);
+  } else {
+    printf("\033[42m\t\tPASS\t\t\033[m\n");
+  }
+  printf("%d tests\n", tests_run);
+
+  return result != 0;
+}
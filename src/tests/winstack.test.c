@@ -0,0 +1,100 @@
+#include <stdio.h>
+#include "winstack.h"
+#include "minunit.h"
+
+int tests_run = 0;
+
+static int in_order(WinStack *stack, Window *ids, unsigned int count) {
+  unsigned int i;
+  if(stack->count != count) {
+    return 0;
+  }
+  for(i = 0; i < count; i++) {
+    if(stack->ids[i] != ids[i]) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static char * test_winstack_place() {
+  WinStack stack;
+  Window start[] = { 1, 2, 3, 4 };
+  Window raised[] = { 1, 3, 4, 2 };
+  Window below[] = { 4, 1, 3, 2 };
+  unsigned int i;
+  WinStack_init(&stack, 0);
+
+  for(i = 0; i < 4; i++) {
+    WinStack_push(&stack, start[i]);
+  }
+  mu_assert("Pushed bottom to top", in_order(&stack, start, 4));
+  mu_assert("Top is the last push", WinStack_top(&stack) == 4);
+  mu_assert("Raising the top changes nothing", WinStack_place(&stack, 4, None, Above) == 0);
+  mu_assert("Raise", WinStack_place(&stack, 2, None, Above) == 1);
+  mu_assert("Raised to the top", in_order(&stack, raised, 4));
+  mu_assert("Below a sibling", WinStack_place(&stack, 4, 1, Below) == 1);
+  mu_assert("Placed below the sibling", in_order(&stack, below, 4));
+  mu_assert("Unknown sibling is ignored", WinStack_place(&stack, 4, 9, Above) == 0);
+  mu_assert("TopIf is not tracked", WinStack_place(&stack, 4, None, TopIf) == 0);
+  mu_assert("Remove", WinStack_remove(&stack, 1) == 0 && WinStack_index(&stack, 1) == -1);
+  mu_assert("Remove unknown", WinStack_remove(&stack, 1) == -1);
+  mu_assert("Others keep their order", stack.count == 3 && stack.ids[0] == 4 && stack.ids[2] == 2);
+
+  WinStack_free(&stack);
+  return 0;
+}
+
+static char * test_winstack_restack() {
+  WinStack stack;
+  WinStackChange changes[8];
+  Window wanted[] = { 2, 3, 4, 5, 1 };
+  Window reversed[] = { 5, 4, 3, 2, 1 };
+  Window unknown[] = { 9, 2, 2, 3 };
+  Window mixed[] = { 1, 2, 4, 5, 3 };
+  unsigned int i;
+  WinStack_init(&stack, 2);
+
+  for(i = 1; i <= 5; i++) {
+    WinStack_push(&stack, i);
+  }
+  mu_assert("Order already there", WinStack_restack(&stack, stack.ids, stack.count, changes) == 0);
+  mu_assert("One window out of place takes one change", WinStack_restack(&stack, wanted, 5, changes) == 1);
+  mu_assert("It goes above its predecessor",
+    changes[0].id == 1 && changes[0].sibling == 5 && changes[0].stack_mode == Above);
+  mu_assert("Restacked", in_order(&stack, wanted, 5));
+
+  // 1 is already on top of the others
+  mu_assert("Reversing the other four takes three changes", WinStack_restack(&stack, reversed, 5, changes) == 3);
+  mu_assert("Reversed", in_order(&stack, reversed, 5));
+
+  // 2 goes right below 3; 9 and the repeated 2 are skipped
+  mu_assert("Partial restack", WinStack_restack(&stack, unknown, 4, changes) == 1);
+  mu_assert("Below its successor",
+    changes[0].id == 2 && changes[0].sibling == 3 && changes[0].stack_mode == Below);
+  mu_assert("Unlisted windows stay", stack.ids[0] == 5 && stack.ids[1] == 4 && stack.ids[4] == 1);
+
+  mu_assert("Windows before the first kept one go below it", WinStack_restack(&stack, mixed, 5, changes) == 3);
+  mu_assert("Mixed", in_order(&stack, mixed, 5));
+
+  WinStack_free(&stack);
+  return 0;
+}
+
+static char * all_tests() {
+  mu_run_test(test_winstack_place);
+  mu_run_test(test_winstack_restack);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  char *result = all_tests();
+  if (result != 0) {
+    printf("\033[41m\t\tFAIL:\033[m %s\n", result);
+  } else {
+    printf("\033[42m\t\tPASS\t\t\033[m\n");
+  }
+  printf("%d tests\n", tests_run);
+
+  return result != 0;
+}
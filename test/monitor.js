@@ -6,6 +6,7 @@ var Monitor = function(nwm, monitor) {
   this.height = monitor.height;
   this.x = monitor.x;
   this.y = monitor.y;
+  this.workarea = { x: monitor.x, y: monitor.y, width: monitor.width, height: monitor.height };
   // List of window ids
   this.window_ids = [];
   // List of workspaces